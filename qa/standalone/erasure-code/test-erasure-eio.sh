@@ -70,9 +70,10 @@ function create_erasure_coded_pool() {
     shift
     local m=$1
     shift
+    local plugin=${1:-jerasure}
 
     ceph osd erasure-code-profile set myprofile \
-        plugin=jerasure \
+        plugin=$plugin \
         k=$k m=$m \
         crush-failure-domain=osd || return 1
     create_pool $poolname 1 1 erasure myprofile \
@@ -275,6 +276,28 @@ function TEST_rados_get_subread_eio_shard_1() {
     delete_erasure_coded_pool $poolname
 }
 
+# The object fits in the first data chunk, so with osd_ec_partial_reads the
+# read only goes to shard 0; when that fails it must be redone as a decoding
+# read of the other shards.
+function TEST_ec_partial_read_fallback() {
+    local dir=$1
+    setup_osds 4 || return 1
+
+    local poolname=pool-jerasure
+    create_erasure_coded_pool $poolname 2 1 || return 1
+    ceph config set osd osd_ec_partial_reads true || return 1
+    local objname=obj-partial-read-$$
+    rados_put $dir $poolname $objname || return 1
+    inject_eio ec data $poolname $objname $dir 0 || return 1
+    rados_get $dir $poolname $objname || return 1
+
+    local primary=$(get_primary $poolname $objname)
+    CEPH_ARGS='' ceph --admin-daemon $(get_asok_path osd.$primary) log flush || return 1
+    grep -q "$objname.*direct read failed" $dir/osd.$primary.log || return 1
+    rm $dir/ORIGINAL
+    delete_erasure_coded_pool $poolname
+}
+
 # We don't remove the object from the primary because
 # that just causes it to appear to be missing
 
@@ -445,6 +468,69 @@ function TEST_ec_recovery_multiple_errors() {
     delete_erasure_coded_pool $poolname
 }
 
+# Test a CLAY single shard repair, which reads only some of the planes
+# of the helper shards, of an object much smaller than the recovery chunk
+function TEST_ec_clay_single_recovery() {
+    local dir=$1
+    local objname=myobject
+
+    setup_osds 7 || return 1
+
+    local poolname=pool-clay
+    create_erasure_coded_pool $poolname 4 2 clay || return 1
+
+    rados_put $dir $poolname $objname || return 1
+
+    local -a initial_osds=($(get_osds $poolname $objname))
+    local last_osd=${initial_osds[-1]}
+    # Kill OSD
+    kill_daemons $dir TERM osd.${last_osd} >&2 < /dev/null || return 1
+    ceph osd down ${last_osd} || return 1
+    ceph osd out ${last_osd} || return 1
+
+    # Cluster should recover this object, without any helper crashing
+    wait_for_clean || return 1
+    for osd in "${initial_osds[@]}" ; do
+        if [ $osd != $last_osd ]; then
+            ceph tell osd.$osd version > /dev/null || return 1
+        fi
+    done
+
+    rados_get $dir $poolname $objname || return 1
+
+    delete_erasure_coded_pool $poolname
+}
+
+# Test a CLAY single shard repair losing a helper to EIO: there are not
+# enough helpers left to repair, so the helpers already read for their
+# planes are read again in full for a regular decode
+function TEST_ec_clay_recovery_error() {
+    local dir=$1
+    local objname=myobject
+
+    setup_osds 7 || return 1
+
+    local poolname=pool-clay
+    create_erasure_coded_pool $poolname 4 2 clay || return 1
+
+    rados_put $dir $poolname $objname || return 1
+    inject_eio ec data $poolname $objname $dir 0 || return 1
+
+    local -a initial_osds=($(get_osds $poolname $objname))
+    local last_osd=${initial_osds[-1]}
+    # Kill OSD
+    kill_daemons $dir TERM osd.${last_osd} >&2 < /dev/null || return 1
+    ceph osd down ${last_osd} || return 1
+    ceph osd out ${last_osd} || return 1
+
+    # Cluster should recover this object
+    wait_for_clean || return 1
+
+    rados_get $dir $poolname $objname || return 1
+
+    delete_erasure_coded_pool $poolname
+}
+
 # Test recovery when there's only one shard to recover, but multiple
 # objects recovering in one RecoveryOp
 function TEST_ec_recovery_multiple_objects() {
@@ -34,6 +34,7 @@ struct aio_t {
     boost::container::small_vector<iovec, 4> iov;
     uint64_t offset, length;
     long rval;
+    int fixed_buf_index = -1; ///< io_uring registered buffer backing this io, if any
     ceph::buffer::list bl;  ///< write payload (so that it remains stable for duration)
 
     boost::intrusive::list_member_hook<> queue_item;
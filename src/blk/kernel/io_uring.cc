@@ -6,6 +6,7 @@
 #if defined(HAVE_LIBURING)
 
 #include "liburing.h"
+#include <cstring>
 #include <sys/epoll.h>
 
 using std::list;
@@ -17,8 +18,58 @@ struct ioring_data {
     pthread_mutex_t sq_mutex;
     int epoll_fd = -1;
     std::map<int, int> fixed_fds_map;
+
+    // buffers registered with io_uring_register_buffers(), the kernel
+    // keeps them pinned so small ios skip the per-io page mapping
+    void *fixed_bufs_arena = nullptr;
+    std::vector<struct iovec> fixed_bufs;
+    std::vector<int> free_fixed_bufs;
+    pthread_mutex_t buf_mutex;
 };
 
+static int get_fixed_buf(struct ioring_data *d, uint64_t length)
+{
+    if (d->fixed_bufs.empty() || length > d->fixed_bufs[0].iov_len) {
+        return -1;
+    }
+    int index = -1;
+    pthread_mutex_lock(&d->buf_mutex);
+    if (!d->free_fixed_bufs.empty()) {
+        index = d->free_fixed_bufs.back();
+        d->free_fixed_bufs.pop_back();
+    }
+    pthread_mutex_unlock(&d->buf_mutex);
+    return index;
+}
+
+static void put_fixed_buf(struct ioring_data *d, int index)
+{
+    pthread_mutex_lock(&d->buf_mutex);
+    d->free_fixed_bufs.push_back(index);
+    pthread_mutex_unlock(&d->buf_mutex);
+}
+
+static void finish_fixed_buf(struct ioring_data *d, struct aio_t *io)
+{
+    auto &fb = d->fixed_bufs[io->fixed_buf_index];
+    if (io->iocb.aio_lio_opcode == IO_CMD_PREADV && io->rval > 0) {
+        // scatter the data back to the caller's buffers
+        const char *src = static_cast<const char *>(fb.iov_base);
+        uint64_t left = io->rval;
+        for (auto &iov : io->iov) {
+            uint64_t len = std::min<uint64_t>(iov.iov_len, left);
+            memcpy(iov.iov_base, src, len);
+            src += len;
+            left -= len;
+            if (left == 0) {
+                break;
+            }
+        }
+    }
+    put_fixed_buf(d, io->fixed_buf_index);
+    io->fixed_buf_index = -1;
+}
+
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
                           struct aio_t **paio)
 {
@@ -30,6 +81,9 @@ static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
     io_uring_for_each_cqe(ring, head, cqe) {
         struct aio_t *io = (struct aio_t *)(uintptr_t) io_uring_cqe_get_data(cqe);
         io->rval = cqe->res;
+        if (io->fixed_buf_index >= 0) {
+            finish_fixed_buf(d, io);
+        }
 
         paio[nr++] = io;
 
@@ -59,14 +113,31 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 
     ceph_assert(fixed_fd != -1);
 
-    if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+    bool is_write = io->iocb.aio_lio_opcode == IO_CMD_PWRITEV;
+    ceph_assert(is_write || io->iocb.aio_lio_opcode == IO_CMD_PREADV);
+
+    io->fixed_buf_index = get_fixed_buf(d, io->length);
+    if (io->fixed_buf_index >= 0) {
+        auto &fb = d->fixed_bufs[io->fixed_buf_index];
+        if (is_write) {
+            // gather the payload into the registered buffer
+            char *dst = static_cast<char *>(fb.iov_base);
+            for (auto &iov : io->iov) {
+                memcpy(dst, iov.iov_base, iov.iov_len);
+                dst += iov.iov_len;
+            }
+            io_uring_prep_write_fixed(sqe, fixed_fd, fb.iov_base, io->length,
+                                      io->offset, io->fixed_buf_index);
+        } else {
+            io_uring_prep_read_fixed(sqe, fixed_fd, fb.iov_base, io->length,
+                                     io->offset, io->fixed_buf_index);
+        }
+    } else if (is_write) {
         io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
                              io->iov.size(), io->offset);
-    else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
+    } else {
         io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
                             io->iov.size(), io->offset);
-    else {
-        ceph_assert(0);
     }
 
     io_uring_sqe_set_data(sqe, io);
@@ -74,33 +145,94 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 }
 
 static int ioring_queue(struct ioring_data *d, void *priv,
-                        list<aio_t>::iterator beg, list<aio_t>::iterator end)
+                        list<aio_t>::iterator beg, list<aio_t>::iterator end,
+                        int *retries)
 {
     struct io_uring *ring = &d->io_uring;
-    struct aio_t *io = nullptr;
+    // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+    int attempts = 16;
+    int delay = 125;
+    int queued = 0;
 
     ceph_assert(beg != end);
 
-    do {
+    // queue the whole batch, handing it to the kernel with a single
+    // io_uring_submit() unless the SQ ring fills up on the way
+    while (beg != end) {
         struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
         if (!sqe) {
-            break;
+            /* Queue is full, flush what we have and retry */
+            int r = io_uring_submit(ring);
+            if (r < 0) {
+                return r;
+            }
+            if (r == 0) {
+                if (attempts-- == 0) {
+                    return -EAGAIN;
+                }
+                usleep(delay);
+                delay *= 2;
+                (*retries)++;
+            } else {
+                attempts = 16;
+                delay = 125;
+            }
+            continue;
         }
 
-        io = &*beg;
+        struct aio_t *io = &*beg;
         io->priv = priv;
 
         init_sqe(d, sqe, io);
+        ++queued;
+        ++beg;
+    }
 
-    } while (++beg != end);
+    int r = io_uring_submit(ring);
+    if (r < 0) {
+        return r;
+    }
+    return queued;
+}
 
-    if (!io)
-        /* Queue is full, go and reap something first */
-    {
-        return 0;
+static int register_fixed_bufs(struct ioring_data *d, unsigned count,
+                               unsigned size)
+{
+    size = p2roundup<unsigned>(size, CEPH_PAGE_SIZE);
+    int r = posix_memalign(&d->fixed_bufs_arena, CEPH_PAGE_SIZE,
+                           (size_t)count * size);
+    if (r) {
+        d->fixed_bufs_arena = nullptr;
+        return -r;
+    }
+    d->fixed_bufs.resize(count);
+    d->free_fixed_bufs.reserve(count);
+    for (unsigned i = 0; i < count; i++) {
+        d->fixed_bufs[i].iov_base = (char *)d->fixed_bufs_arena + (size_t)i * size;
+        d->fixed_bufs[i].iov_len = size;
+        d->free_fixed_bufs.push_back(count - 1 - i);
+    }
+    r = io_uring_register_buffers(&d->io_uring, d->fixed_bufs.data(),
+                                  d->fixed_bufs.size());
+    if (r < 0) {
+        d->fixed_bufs.clear();
+        d->free_fixed_bufs.clear();
+        free(d->fixed_bufs_arena);
+        d->fixed_bufs_arena = nullptr;
     }
+    return r;
+}
 
-    return io_uring_submit(ring);
+static void unregister_fixed_bufs(struct ioring_data *d)
+{
+    if (d->fixed_bufs.empty()) {
+        return;
+    }
+    io_uring_unregister_buffers(&d->io_uring);
+    d->fixed_bufs.clear();
+    d->free_fixed_bufs.clear();
+    free(d->fixed_bufs_arena);
+    d->fixed_bufs_arena = nullptr;
 }
 
 static void build_fixed_fds_map(struct ioring_data *d,
@@ -112,11 +244,14 @@ static void build_fixed_fds_map(struct ioring_data *d,
     }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_) :
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+                               unsigned fixed_buffers_, unsigned fixed_buffer_size_) :
     d(make_unique<ioring_data>()),
     iodepth(iodepth_),
     hipri(hipri_),
-    sq_thread(sq_thread_)
+    sq_thread(sq_thread_),
+    fixed_buffers(fixed_buffers_),
+    fixed_buffer_size(fixed_buffer_size_)
 {
 }
 
@@ -130,6 +265,7 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
     pthread_mutex_init(&d->cq_mutex, NULL);
     pthread_mutex_init(&d->sq_mutex, NULL);
+    pthread_mutex_init(&d->buf_mutex, NULL);
 
     if (hipri) {
         flags |= IORING_SETUP_IOPOLL;
@@ -152,6 +288,15 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
     build_fixed_fds_map(d.get(), fds);
 
+    if (fixed_buffers && fixed_buffer_size) {
+        // not fatal: e.g. RLIMIT_MEMLOCK may be too low to pin the buffers,
+        // ios then just go through the regular readv/writev path
+        ret = register_fixed_bufs(d.get(), fixed_buffers, fixed_buffer_size);
+        if (ret < 0) {
+            fixed_buffers = 0;
+        }
+    }
+
     d->epoll_fd = epoll_create1(0);
     if (d->epoll_fd < 0) {
         ret = -errno;
@@ -178,6 +323,7 @@ close_ring_fd:
 
 void ioring_queue_t::shutdown()
 {
+    unregister_fixed_bufs(d.get());
     d->fixed_fds_map.clear();
     close(d->epoll_fd);
     d->epoll_fd = -1;
@@ -189,10 +335,9 @@ int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
                                  int *retries)
 {
     (void)aios_size;
-    (void)retries;
 
     pthread_mutex_lock(&d->sq_mutex);
-    int rc = ioring_queue(d.get(), priv, beg, end);
+    int rc = ioring_queue(d.get(), priv, beg, end, retries);
     pthread_mutex_unlock(&d->sq_mutex);
 
     return rc;
@@ -235,7 +380,8 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+                               unsigned fixed_buffers_, unsigned fixed_buffer_size_)
 {
     ceph_assert(0);
 }
@@ -4,9 +4,12 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <algorithm>
+
 #include "include/buffer.h"
 #include "include/byteorder.h"
 #include "include/ceph_assert.h"
+#include "include/crc32c.h"
 
 #include "xxHash/xxhash.h"
 
@@ -103,9 +106,52 @@ public:
         }
     }
 
+    // csum blocks the crc32c flavours hand to ceph_crc32c_multi() at once
+    static constexpr unsigned CRC32C_BATCH = 16;
+
+    // crc32c of n consecutive len-sized blocks starting at p.  Blocks
+    // that are contiguous in memory are done in one multi-buffer call,
+    // the odd one straddling two buffers is done on its own.
+    static void crc32c_multi(
+        uint32_t init_value,
+        size_t len,
+        ceph::buffer::list::const_iterator &p,
+        unsigned n,
+        uint32_t *out
+    )
+    {
+        const unsigned char *data[CRC32C_BATCH];
+        unsigned lengths[CRC32C_BATCH];
+        uint32_t crcs[CRC32C_BATCH];
+        unsigned slot[CRC32C_BATCH];
+        unsigned m = 0;
+        ceph_assert(n <= CRC32C_BATCH);
+        for (unsigned i = 0; i < n; ++i) {
+            const char *d;
+            size_t l = p.get_ptr_and_advance(len, &d);
+            if (l == len) {
+                data[m] = reinterpret_cast<const unsigned char *>(d);
+                lengths[m] = len;
+                crcs[m] = init_value;
+                slot[m++] = i;
+            } else {
+                uint32_t crc = ceph_crc32c(
+                    init_value, reinterpret_cast<const unsigned char *>(d), l);
+                out[i] = p.crc32c(len - l, crc);
+            }
+        }
+        if (m) {
+            ceph_crc32c_multi(crcs, data, lengths, m);
+        }
+        for (unsigned j = 0; j < m; ++j) {
+            out[slot[j]] = crcs[j];
+        }
+    }
+
     struct crc32c {
         typedef uint32_t init_value_t;
         typedef ceph_le32 value_t;
+        static constexpr unsigned batch = CRC32C_BATCH;
 
         // we have no execution context/state.
         typedef int state_t;
@@ -125,11 +171,24 @@ public:
         {
             return p.crc32c(len, init_value);
         }
+
+        static void calc_multi(
+            state_t state,
+            init_value_t init_value,
+            size_t len,
+            ceph::buffer::list::const_iterator &p,
+            unsigned n,
+            init_value_t *out
+        )
+        {
+            crc32c_multi(init_value, len, p, n, out);
+        }
     };
 
     struct crc32c_16 {
         typedef uint32_t init_value_t;
         typedef ceph_le16 value_t;
+        static constexpr unsigned batch = CRC32C_BATCH;
 
         // we have no execution context/state.
         typedef int state_t;
@@ -149,11 +208,27 @@ public:
         {
             return p.crc32c(len, init_value) & 0xffff;
         }
+
+        static void calc_multi(
+            state_t state,
+            init_value_t init_value,
+            size_t len,
+            ceph::buffer::list::const_iterator &p,
+            unsigned n,
+            init_value_t *out
+        )
+        {
+            crc32c_multi(init_value, len, p, n, out);
+            for (unsigned i = 0; i < n; ++i) {
+                out[i] &= 0xffff;
+            }
+        }
     };
 
     struct crc32c_8 {
         typedef uint32_t init_value_t;
         typedef __u8 value_t;
+        static constexpr unsigned batch = CRC32C_BATCH;
 
         // we have no execution context/state.
         typedef int state_t;
@@ -173,11 +248,27 @@ public:
         {
             return p.crc32c(len, init_value) & 0xff;
         }
+
+        static void calc_multi(
+            state_t state,
+            init_value_t init_value,
+            size_t len,
+            ceph::buffer::list::const_iterator &p,
+            unsigned n,
+            init_value_t *out
+        )
+        {
+            crc32c_multi(init_value, len, p, n, out);
+            for (unsigned i = 0; i < n; ++i) {
+                out[i] &= 0xff;
+            }
+        }
     };
 
     struct xxhash32 {
         typedef uint32_t init_value_t;
         typedef ceph_le32 value_t;
+        static constexpr unsigned batch = 1;
 
         typedef XXH32_state_t *state_t;
         static void init(state_t *s)
@@ -210,6 +301,7 @@ public:
     struct xxhash64 {
         typedef uint64_t init_value_t;
         typedef ceph_le64 value_t;
+        static constexpr unsigned batch = 1;
 
         typedef XXH64_state_t *state_t;
         static void init(state_t *s)
@@ -239,6 +331,26 @@ public:
         }
     };
 
+    // checksum the next n blocks, n <= Alg::batch
+    template<class Alg>
+    static void calc_blocks(
+        typename Alg::state_t state,
+        typename Alg::init_value_t init_value,
+        size_t csum_block_size,
+        ceph::buffer::list::const_iterator &p,
+        unsigned n,
+        typename Alg::init_value_t *out
+    )
+    {
+        if constexpr (Alg::batch > 1) {
+            Alg::calc_multi(state, init_value, csum_block_size, p, n, out);
+        } else {
+            for (unsigned i = 0; i < n; ++i) {
+                out[i] = Alg::calc(state, init_value, csum_block_size, p);
+            }
+        }
+    }
+
     template<class Alg>
     static int calculate(
         size_t csum_block_size,
@@ -274,9 +386,15 @@ public:
         typename Alg::value_t *pv =
             reinterpret_cast<typename Alg::value_t *>(csum_data->c_str());
         pv += offset / csum_block_size;
-        while (blocks--) {
-            *pv = Alg::calc(state, init_value, csum_block_size, p);
-            ++pv;
+        typename Alg::init_value_t v[Alg::batch];
+        while (blocks > 0) {
+            unsigned n = std::min<size_t>(blocks, Alg::batch);
+            calc_blocks<Alg>(state, init_value, csum_block_size, p, n, v);
+            for (unsigned i = 0; i < n; ++i) {
+                *pv = v[i];
+                ++pv;
+            }
+            blocks -= n;
         }
         Alg::fini(&state);
         return 0;
@@ -303,18 +421,22 @@ public:
             reinterpret_cast<const typename Alg::value_t *>(csum_data.c_str());
         pv += offset / csum_block_size;
         size_t pos = offset;
+        typename Alg::init_value_t v[Alg::batch];
         while (length > 0) {
-            typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
-            if (*pv != v) {
-                if (bad_csum) {
-                    *bad_csum = v;
+            unsigned n = std::min<size_t>(length / csum_block_size, Alg::batch);
+            calc_blocks<Alg>(state, -1, csum_block_size, p, n, v);
+            for (unsigned i = 0; i < n; ++i) {
+                if (*pv != v[i]) {
+                    if (bad_csum) {
+                        *bad_csum = v[i];
+                    }
+                    Alg::fini(&state);
+                    return pos;
                 }
-                Alg::fini(&state);
-                return pos;
+                ++pv;
+                pos += csum_block_size;
+                length -= csum_block_size;
             }
-            ++pv;
-            pos += csum_block_size;
-            length -= csum_block_size;
         }
         Alg::fini(&state);
         return -1;  // no errors
@@ -18,6 +18,11 @@
 #include <limits.h>
 
 #include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "include/ceph_assert.h"
 #include "include/types.h"
@@ -194,6 +199,323 @@ public:
 };
 #endif
 
+#if defined(__linux__)
+namespace {
+/*
+ * Page aligned data buffers carved out of 2 MiB chunks, each of them a
+ * hugepage (or at least THP eligible) placed on one NUMA node and faulted
+ * in up front, so fresh messenger and BlueStore buffers don't pay for page
+ * faults and TLB misses.
+ *
+ * Buffers come in power of two size classes from 4 KiB to 2 MiB.  Every
+ * thread keeps its own free list per class; a thread that frees more than
+ * it keeps (say an OSD worker freeing messenger buffers) moves the excess
+ * to a shared list that the other threads refill from.  Chunks are never
+ * unmapped, so the pool is capped at max_bytes; past that we fall back to
+ * posix_memalign.  Idle bytes are accounted in mempool buffer_pool, and so
+ * is the tail of every block in use past the length it was asked for, which
+ * the buffer's own mempool never sees.
+ */
+class hugepage_pool_t {
+public:
+    static constexpr size_t CHUNK_SIZE = 2 << 20;
+    static constexpr unsigned MIN_ORDER = 12;
+    static constexpr unsigned NUM_CLASSES = 10;
+    static constexpr size_t THREAD_CLASS_BYTES = 1 << 20;
+
+    hugepage_pool_t(size_t max_bytes, int node)
+        : max_bytes(max_bytes), node(node) {}
+
+    static int size_class(size_t len, size_t align)
+    {
+        size_t want = std::max(len, align);
+        if (want > CHUNK_SIZE) {
+            return -1;
+        }
+        if (want <= (size_t(1) << MIN_ORDER)) {
+            return 0;
+        }
+        return cbits(want - 1) - MIN_ORDER;
+    }
+    static size_t class_size(unsigned c)
+    {
+        return size_t(1) << (MIN_ORDER + c);
+    }
+
+    char *allocate(unsigned c, size_t len)
+    {
+        if (tcache_gone) {
+            return nullptr;
+        }
+        auto &l = tcache.lists[c];
+        if (!l.head && !refill(c)) {
+            return nullptr;
+        }
+        free_block *b = l.head;
+        l.head = b->next;
+        --l.count;
+        // the rounding slack stays in buffer_pool until the block comes back
+        pool().adjust_count(-1, -(ssize_t)len);
+        return reinterpret_cast<char *>(b);
+    }
+
+    void release(char *p, unsigned c, size_t len)
+    {
+        auto b = reinterpret_cast<free_block *>(p);
+        pool().adjust_count(1, len);
+        if (tcache_gone) {
+            // freed by a thread local destructor running after ours
+            free_list l;
+            b->next = nullptr;
+            l.head = b;
+            l.count = 1;
+            give_back(c, l, 1);
+            return;
+        }
+        auto &l = tcache.lists[c];
+        tcache.owner = this;
+        b->next = l.head;
+        l.head = b;
+        ++l.count;
+        if (l.count > thread_max(c)) {
+            // keep half, share the rest
+            give_back(c, l, l.count / 2);
+        }
+    }
+
+    void set_node(int n)
+    {
+        node = n;
+    }
+
+private:
+    struct free_block {
+        free_block *next;
+    };
+    struct free_list {
+        free_block *head = nullptr;
+        size_t count = 0;
+    };
+    struct thread_cache_t {
+        hugepage_pool_t *owner = nullptr;
+        free_list lists[NUM_CLASSES];
+        ~thread_cache_t()
+        {
+            tcache_gone = true;
+            if (owner) {
+                for (unsigned c = 0; c < NUM_CLASSES; ++c) {
+                    owner->give_back(c, lists[c], lists[c].count);
+                }
+            }
+        }
+    };
+    static thread_local thread_cache_t tcache;
+    static thread_local bool tcache_gone;
+
+    ceph::spinlock lock;
+    free_list shared[NUM_CLASSES];
+    const size_t max_bytes;
+    std::atomic<size_t> mapped = {0};
+    std::atomic<int> node;
+
+    static mempool::pool_t &pool()
+    {
+        return mempool::get_pool(mempool::mempool_buffer_pool);
+    }
+    static size_t thread_max(unsigned c)
+    {
+        return std::max<size_t>(2, THREAD_CLASS_BYTES / class_size(c));
+    }
+
+    // move n blocks from the head of l to the shared list
+    void give_back(unsigned c, free_list &l, size_t n)
+    {
+        if (!n) {
+            return;
+        }
+        free_block *first = l.head, *last = l.head;
+        for (size_t i = 1; i < n; ++i) {
+            last = last->next;
+        }
+        l.head = last->next;
+        l.count -= n;
+        std::lock_guard g(lock);
+        last->next = shared[c].head;
+        shared[c].head = first;
+        shared[c].count += n;
+    }
+
+    bool refill(unsigned c)
+    {
+        auto &l = tcache.lists[c];
+        tcache.owner = this;
+        {
+            std::lock_guard g(lock);
+            auto &s = shared[c];
+            size_t n = std::min(s.count, thread_max(c) / 2 + 1);
+            for (; n; --n) {
+                free_block *b = s.head;
+                s.head = b->next;
+                --s.count;
+                b->next = l.head;
+                l.head = b;
+                ++l.count;
+            }
+        }
+        if (l.head) {
+            return true;
+        }
+        char *chunk = map_chunk();
+        if (!chunk) {
+            return false;
+        }
+        size_t bs = class_size(c);
+        size_t n = CHUNK_SIZE / bs;
+        for (size_t off = CHUNK_SIZE; off; off -= bs) {
+            auto b = reinterpret_cast<free_block *>(chunk + off - bs);
+            b->next = l.head;
+            l.head = b;
+        }
+        l.count += n;
+        pool().adjust_count(n, CHUNK_SIZE);
+        return true;
+    }
+
+    char *map_chunk()
+    {
+        size_t m = mapped.load();
+        do {
+            if (m + CHUNK_SIZE > max_bytes) {
+                return nullptr;
+            }
+        } while (!mapped.compare_exchange_weak(m, m + CHUNK_SIZE));
+
+        void *p = ::mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            // no hugetlbfs pages reserved; map twice the size to get a
+            // 2 MiB aligned range and ask for a transparent hugepage
+            p = ::mmap(nullptr, 2 * CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                mapped -= CHUNK_SIZE;
+                return nullptr;
+            }
+            char *raw = static_cast<char *>(p);
+            char *start = reinterpret_cast<char *>(
+                              round_up_to(reinterpret_cast<uintptr_t>(raw), CHUNK_SIZE));
+            if (start > raw) {
+                ::munmap(raw, start - raw);
+            }
+            ::munmap(start + CHUNK_SIZE, raw + 2 * CHUNK_SIZE - (start + CHUNK_SIZE));
+            p = start;
+            ::madvise(p, CHUNK_SIZE, MADV_HUGEPAGE);
+        }
+
+        int n = node;
+        if (n < 0) {
+            unsigned cpu, cur;
+            if (::syscall(SYS_getcpu, &cpu, &cur, nullptr) == 0) {
+                n = cur;
+            }
+        }
+        if (n >= 0) {
+            // MPOL_PREFERRED: fall back to other nodes rather than fail
+            constexpr int mpol_preferred = 1;
+            constexpr size_t bits = sizeof(unsigned long) * CHAR_BIT;
+            std::vector<unsigned long> mask(n / bits + 1);
+            mask[n / bits] = 1ul << (n % bits);
+            ::syscall(SYS_mbind, p, CHUNK_SIZE, mpol_preferred, mask.data(),
+                      mask.size() * bits + 1, 0);
+        }
+        // fault it in now, not in the fast path
+        for (size_t off = 0; off < CHUNK_SIZE; off += CEPH_PAGE_SIZE) {
+            static_cast<volatile char *>(p)[off] = 0;
+        }
+        return static_cast<char *>(p);
+    }
+};
+
+thread_local hugepage_pool_t::thread_cache_t hugepage_pool_t::tcache;
+thread_local bool hugepage_pool_t::tcache_gone = false;
+
+std::atomic<hugepage_pool_t *> hugepage_pool = {nullptr};
+hugepage_pool_t *hugepage_pool_mapped = nullptr; // kept while disabled
+ceph::spinlock hugepage_pool_lock;
+}
+
+class buffer::raw_hugepage : public buffer::raw
+{
+    hugepage_pool_t *pool;
+    unsigned size_class;
+    unsigned alloc_len;
+public:
+    MEMPOOL_CLASS_HELPERS();
+
+    raw_hugepage(hugepage_pool_t *pool, char *d, unsigned size_class,
+                 unsigned l, int mempool)
+        : raw(d, l, mempool), pool(pool), size_class(size_class), alloc_len(l)
+    {
+        bdout << "raw_hugepage " << this << " alloc " << (void *)data
+              << " l=" << l << ", class=" << size_class << bendl;
+    }
+    ~raw_hugepage() override
+    {
+        pool->release(data, size_class, alloc_len);
+        bdout << "raw_hugepage " << this << " free " << (void *)data << bendl;
+    }
+
+    static ceph::unique_leakable_ptr<buffer::raw> create(unsigned len,
+            unsigned align,
+            int mempool)
+    {
+        hugepage_pool_t *pool = hugepage_pool.load(std::memory_order_relaxed);
+        if (!pool) {
+            return nullptr;
+        }
+        int c = hugepage_pool_t::size_class(len, align);
+        if (c < 0) {
+            return nullptr;
+        }
+        char *d = pool->allocate(c, len);
+        if (!d) {
+            return nullptr;
+        }
+        return ceph::unique_leakable_ptr<buffer::raw>(
+                   new raw_hugepage(pool, d, c, len, mempool));
+    }
+};
+
+int buffer::enable_hugepage_pool(size_t max_bytes, int numa_node)
+{
+    std::lock_guard l(hugepage_pool_lock);
+    if (hugepage_pool_mapped) {
+        hugepage_pool_mapped->set_node(numa_node);
+    } else {
+        // never freed: buffers may be released after everything else is gone
+        hugepage_pool_mapped = new hugepage_pool_t(max_bytes, numa_node);
+    }
+    hugepage_pool = hugepage_pool_mapped;
+    return 0;
+}
+
+void buffer::disable_hugepage_pool()
+{
+    // buffers already handed out still go back to the pool when released
+    std::lock_guard l(hugepage_pool_lock);
+    hugepage_pool = nullptr;
+}
+#else
+int buffer::enable_hugepage_pool(size_t max_bytes, int numa_node)
+{
+    return -EOPNOTSUPP;
+}
+
+void buffer::disable_hugepage_pool()
+{
+}
+#endif
+
 #ifdef __CYGWIN__
 class buffer::raw_hack_aligned : public buffer::raw
 {
@@ -316,6 +638,11 @@ ceph::unique_leakable_ptr<buffer::raw> buffer::create_aligned_in_mempool(
     // size passes 8KB.
     if ((align & ~CEPH_PAGE_MASK) == 0 ||
         len >= CEPH_PAGE_SIZE * 2) {
+#if defined(__linux__)
+        if (auto r = raw_hugepage::create(len, align, mempool); r) {
+            return r;
+        }
+#endif
 #ifndef __CYGWIN__
         return ceph::unique_leakable_ptr<buffer::raw>(new raw_posix_aligned(len, align));
 #else
@@ -2120,12 +2447,55 @@ __u32 buffer::list::crc32c(__u32 crc) const
     int cache_hits = 0;
     int cache_adjusts = 0;
 
-    for (const auto &node : _buffers) {
-        if (node.length()) {
-            raw *const r = node._raw;
-            pair<size_t, size_t> ofs(node.offset(), node.offset() + node.length());
-            pair<uint32_t, uint32_t> ccrc;
-            if (r->get_crc(ofs, &ccrc)) {
+    /* Nodes are taken a window at a time.  When more than one node of a
+     * window misses the cache, the misses are checksummed from a zero
+     * seed in a single ceph_crc32c_multi() call and chained in below with
+     * the same seed adjustment as cached values.
+     */
+    static constexpr unsigned WINDOW = 16;
+    const ptr_node *nodes[WINDOW];
+    pair<uint32_t, uint32_t> ccrcs[WINDOW];
+    bool cached[WINDOW];
+    const unsigned char *data[WINDOW];
+    unsigned lengths[WINDOW];
+    uint32_t crcs[WINDOW];
+    unsigned slot[WINDOW];
+
+    auto it = _buffers.begin();
+    while (it != _buffers.end()) {
+        unsigned n = 0;
+        unsigned m = 0;
+        for (; it != _buffers.end() && n < WINDOW; ++it) {
+            if (!it->length()) {
+                continue;
+            }
+            pair<size_t, size_t> ofs(it->offset(), it->offset() + it->length());
+            nodes[n] = &*it;
+            cached[n] = it->_raw->get_crc(ofs, &ccrcs[n]);
+            if (!cached[n]) {
+                data[m] = (const unsigned char *)it->c_str();
+                lengths[m] = it->length();
+                crcs[m] = 0;
+                slot[m++] = n;
+            }
+            n++;
+        }
+        const bool batched = m > 1;
+        if (batched) {
+            ceph_crc32c_multi(crcs, data, lengths, m);
+            for (unsigned j = 0; j < m; j++) {
+                const ptr_node &node = *nodes[slot[j]];
+                ccrcs[slot[j]] = make_pair(0u, crcs[j]);
+                node._raw->set_crc(
+                    make_pair(node.offset(), node.offset() + node.length()),
+                    ccrcs[slot[j]]);
+            }
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            const ptr_node &node = *nodes[i];
+            const pair<uint32_t, uint32_t> &ccrc = ccrcs[i];
+            if (cached[i]) {
                 if (ccrc.first == crc) {
                     // got it already
                     crc = ccrc.second;
@@ -2142,11 +2512,17 @@ __u32 buffer::list::crc32c(__u32 crc) const
                     crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, node.length());
                     cache_adjusts++;
                 }
+            } else if (batched) {
+                // same adjustment as above, from the zero seed
+                cache_misses++;
+                crc = ccrc.second ^ ceph_crc32c(crc, NULL, node.length());
             } else {
                 cache_misses++;
                 uint32_t base = crc;
                 crc = ceph_crc32c(crc, (unsigned char *)node.c_str(), node.length());
-                r->set_crc(ofs, make_pair(base, crc));
+                node._raw->set_crc(
+                    make_pair(node.offset(), node.offset() + node.length()),
+                    make_pair(base, crc));
             }
         }
     }
@@ -2375,6 +2751,10 @@ MEMPOOL_DEFINE_OBJECT_FACTORY(buffer::raw_malloc, buffer_raw_malloc,
                               buffer_meta);
 MEMPOOL_DEFINE_OBJECT_FACTORY(buffer::raw_posix_aligned,
                               buffer_raw_posix_aligned, buffer_meta);
+#if defined(__linux__)
+MEMPOOL_DEFINE_OBJECT_FACTORY(buffer::raw_hugepage, buffer_raw_hugepage,
+                              buffer_meta);
+#endif
 MEMPOOL_DEFINE_OBJECT_FACTORY(buffer::raw_claimed_char, buffer_raw_claimed_char,
                               buffer_meta);
 MEMPOOL_DEFINE_OBJECT_FACTORY(buffer::raw_static, buffer_raw_static,
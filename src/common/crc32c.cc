@@ -8,6 +8,7 @@
 #include "arch/ppc.h"
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_multi.h"
 #include "common/crc32c_aarch64.h"
 #include "common/crc32c_ppc.h"
 
@@ -52,6 +53,43 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+/*
+ * fallback for ceph_crc32c_multi(): one buffer after the other.
+ */
+static void ceph_crc32c_multi_serial(uint32_t *crcs,
+                                     unsigned char const *const *data,
+                                     unsigned const *lengths,
+                                     unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        crcs[i] = ceph_crc32c_func(crcs[i], data[i], lengths[i]);
+    }
+}
+
+/*
+ * choose best multi-buffer implementation based on the CPU architecture.
+ */
+ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void)
+{
+    ceph_arch_probe();
+
+#if defined(__i386__) || defined(__x86_64__)
+    if (ceph_arch_intel_sse42 && ceph_crc32c_intel_multi_exists()) {
+        return ceph_crc32c_intel_multi;
+    }
+#elif defined(__arm__) || defined(__aarch64__)
+# if defined(HAVE_ARMV8_CRC)
+    if (ceph_arch_aarch64_crc32) {
+        return ceph_crc32c_aarch64_multi;
+    }
+# endif
+#endif
+    // default
+    return ceph_crc32c_multi_serial;
+}
+
+ceph_crc32c_multi_func_t ceph_crc32c_multi_func = ceph_choose_crc32_multi();
+
 
 /*
  * Look: http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
@@ -15,10 +15,12 @@
 #ifndef CEPH_COMPRESSOR_H
 #define CEPH_COMPRESSOR_H
 
+#include <cerrno>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 #include "include/ceph_assert.h"    // boost clobbers this
 #include "include/common_fwd.h"
 #include "include/buffer.h"
@@ -103,6 +105,72 @@ public:
     virtual int decompress(ceph::bufferlist::const_iterator &p, size_t compressed_len, ceph::bufferlist &out,
                            std::optional<int32_t> compressor_message) = 0;
 
+    /**
+     * A preset dictionary, prepared once for repeated use.
+     *
+     * Dictionaries help most with small inputs that share structure
+     * with each other but are compressed one at a time.  Data
+     * compressed with a dictionary can only be decompressed with the
+     * same dictionary.
+     */
+    class Dictionary
+    {
+    public:
+        virtual ~Dictionary() {}
+        /// algorithm specific id of the dictionary, 0 if it has none
+        virtual uint32_t get_id() const = 0;
+    };
+    using DictionaryRef = std::shared_ptr<const Dictionary>;
+
+    /**
+     * Prepare a dictionary from its raw content.
+     *
+     * @returns nullptr if the algorithm does not support dictionaries
+     *          or the content is not a usable dictionary
+     */
+    virtual DictionaryRef create_dictionary(const ceph::bufferlist &content)
+    {
+        return nullptr;
+    }
+
+    /**
+     * Train a dictionary on sample inputs.
+     *
+     * @param samples inputs representative of what will be compressed
+     * @param max_size upper bound for the size of the dictionary
+     * @param content raw content of the dictionary, for create_dictionary()
+     * @returns 0 on success, -EOPNOTSUPP if the algorithm has no
+     *          dictionary support, other negative errors if training failed
+     */
+    virtual int train_dictionary(const std::vector<ceph::bufferlist> &samples,
+                                 size_t max_size,
+                                 ceph::bufferlist *content)
+    {
+        return -EOPNOTSUPP;
+    }
+
+    // compress/decompress with an optional dictionary, a nullptr dict is
+    // the same as the variants above
+    virtual int compress(const ceph::bufferlist &in, ceph::bufferlist &out,
+                         std::optional<int32_t> &compressor_message,
+                         const Dictionary *dict)
+    {
+        if (dict) {
+            return -EOPNOTSUPP;
+        }
+        return compress(in, out, compressor_message);
+    }
+    virtual int decompress(ceph::bufferlist::const_iterator &p, size_t compressed_len,
+                           ceph::bufferlist &out,
+                           std::optional<int32_t> compressor_message,
+                           const Dictionary *dict)
+    {
+        if (dict) {
+            return -EOPNOTSUPP;
+        }
+        return decompress(p, compressed_len, out, compressor_message);
+    }
+
     static CompressorRef create(CephContext *cct, const std::string &type);
     static CompressorRef create(CephContext *cct, int alg);
 
@@ -15,6 +15,8 @@
 #ifndef CEPH_LZ4COMPRESSOR_H
 #define CEPH_LZ4COMPRESSOR_H
 
+#include <cstring>
+#include <memory>
 #include <optional>
 #include <lz4.h>
 
@@ -44,10 +46,12 @@ public:
         // older versions of liblz4 introduce bit errors when compressing
         // fragmented buffers.  this was fixed in lz4 commit
         // af127334670a5e7b710bbd6adb71aa7c3ef0cd72, which first
-        // appeared in v1.8.2.
+        // appeared in v1.8.2.  ask the library we run against, not the
+        // headers we were built with, the two may differ.
         //
         // workaround: rebuild if not contiguous.
-        if (!src.is_contiguous()) {
+        static const bool fragments_broken = LZ4_versionNumber() < 10802;
+        if (fragments_broken && !src.is_contiguous()) {
             ceph::buffer::list new_src = src;
             new_src.rebuild();
             return compress(new_src, dst, compressor_message);
@@ -60,8 +64,7 @@ public:
 #endif
         ceph::buffer::ptr outptr = ceph::buffer::create_small_page_aligned(
                                        LZ4_compressBound(src.length()));
-        LZ4_stream_t lz4_stream;
-        LZ4_resetStream(&lz4_stream);
+        LZ4_stream_t &lz4_stream = thread_stream();
 
         using ceph::encode;
 
@@ -117,33 +120,41 @@ public:
         decode(count, p);
         std::vector<std::pair<uint32_t, uint32_t> > compressed_pairs(count);
         uint32_t total_origin = 0;
+        size_t total_compressed = 0;
         for (auto& [dst_size, src_size] : compressed_pairs) {
             decode(dst_size, p);
             decode(src_size, p);
             total_origin += dst_size;
+            total_compressed += src_size;
         }
         compressed_len -= (sizeof(uint32_t) + sizeof(uint32_t) * count * 2);
+        if (total_compressed > compressed_len) {
+            return -1;
+        }
 
         ceph::buffer::ptr dstptr(total_origin);
         LZ4_streamDecode_t lz4_stream_decode;
         LZ4_setStreamDecode(&lz4_stream_decode, nullptr, 0);
 
-        ceph::buffer::ptr cur_ptr = p.get_current_ptr();
-        ceph::buffer::ptr *ptr = &cur_ptr;
-        std::optional<ceph::buffer::ptr> data_holder;
-        if (compressed_len != cur_ptr.length()) {
-            data_holder.emplace(compressed_len);
-            p.copy_deep(compressed_len, *data_holder);
-            ptr = &*data_holder;
-        }
-
-        char *c_in = ptr->c_str();
+        // blocks are decompressed straight out of the input buffers, only
+        // one that straddles two of them is copied out first
+        ceph::buffer::ptr scratch;
         char *c_out = dstptr.c_str();
         for (unsigned i = 0; i < count; ++i) {
+            uint32_t src_size = compressed_pairs[i].second;
+            const char *c_in;
+            size_t l = p.get_ptr_and_advance(src_size, &c_in);
+            if (l < src_size) {
+                if (scratch.length() < src_size) {
+                    scratch = ceph::buffer::create(src_size);
+                }
+                memcpy(scratch.c_str(), c_in, l);
+                p.copy(src_size - l, scratch.c_str() + l);
+                c_in = scratch.c_str();
+            }
             int r = LZ4_decompress_safe_continue(
-                        &lz4_stream_decode, c_in, c_out, compressed_pairs[i].second, compressed_pairs[i].first);
+                        &lz4_stream_decode, c_in, c_out, src_size, compressed_pairs[i].first);
             if (r == (int)compressed_pairs[i].first) {
-                c_in += compressed_pairs[i].second;
                 c_out += compressed_pairs[i].first;
             } else if (r < 0) {
                 return -1;
@@ -154,6 +165,25 @@ public:
         dst.push_back(std::move(dstptr));
         return 0;
     }
+
+private:
+    // An LZ4_stream_t is 16K that LZ4_resetStream() clears in full;
+    // keep one per thread and only fast-reset it between calls.
+    static LZ4_stream_t &thread_stream()
+    {
+        static thread_local std::unique_ptr<LZ4_stream_t> stream;
+        if (!stream) {
+            stream = std::make_unique<LZ4_stream_t>();
+            LZ4_resetStream(stream.get());
+        } else {
+#if LZ4_VERSION_NUMBER >= 10900
+            LZ4_resetStream_fast(stream.get());
+#else
+            LZ4_resetStream(stream.get());
+#endif
+        }
+        return *stream;
+    }
 };
 
 #endif
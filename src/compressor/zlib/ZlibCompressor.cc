@@ -51,26 +51,114 @@ static ostream &_prefix(std::ostream *_dout)
 // compression ratio.
 #define ZLIB_MEMORY_LEVEL 8
 
+// -----------------------------------------------------------------------------
+// zlib allocates and clears a few hundred KB of state on each
+// deflateInit2()/inflateInit2().  Each thread keeps one stream of each
+// kind and resets it between calls instead, as long as the parameters it
+// was set up with still apply.
+
+namespace {
+
+class ZlibThreadStreams
+{
+    z_stream deflate_strm;
+    z_stream inflate_strm;
+    bool deflate_ready = false;
+    bool inflate_ready = false;
+    int deflate_level = 0;
+    int deflate_winsize = 0;
+
+public:
+    ~ZlibThreadStreams()
+    {
+        discard_deflate();
+        discard_inflate();
+    }
+
+    int get_deflate(int level, int winsize, z_stream **strm)
+    {
+        if (deflate_ready && level == deflate_level && winsize == deflate_winsize &&
+            deflateReset(&deflate_strm) == Z_OK) {
+            *strm = &deflate_strm;
+            return Z_OK;
+        }
+        discard_deflate();
+        deflate_strm.zalloc = Z_NULL;
+        deflate_strm.zfree = Z_NULL;
+        deflate_strm.opaque = Z_NULL;
+        int ret = deflateInit2(&deflate_strm, level, Z_DEFLATED, winsize,
+                               ZLIB_MEMORY_LEVEL, Z_DEFAULT_STRATEGY);
+        if (ret != Z_OK) {
+            return ret;
+        }
+        deflate_ready = true;
+        deflate_level = level;
+        deflate_winsize = winsize;
+        *strm = &deflate_strm;
+        return Z_OK;
+    }
+
+    int get_inflate(int winsize, z_stream **strm)
+    {
+        if (inflate_ready && inflateReset2(&inflate_strm, winsize) == Z_OK) {
+            *strm = &inflate_strm;
+            return Z_OK;
+        }
+        discard_inflate();
+        inflate_strm.zalloc = Z_NULL;
+        inflate_strm.zfree = Z_NULL;
+        inflate_strm.opaque = Z_NULL;
+        inflate_strm.avail_in = 0;
+        inflate_strm.next_in = Z_NULL;
+        int ret = inflateInit2(&inflate_strm, winsize);
+        if (ret != Z_OK) {
+            return ret;
+        }
+        inflate_ready = true;
+        *strm = &inflate_strm;
+        return Z_OK;
+    }
+
+    // drop a stream that failed mid-way rather than trust a reset of it
+    void discard_deflate()
+    {
+        if (deflate_ready) {
+            deflateEnd(&deflate_strm);
+            deflate_ready = false;
+        }
+    }
+
+    void discard_inflate()
+    {
+        if (inflate_ready) {
+            inflateEnd(&inflate_strm);
+            inflate_ready = false;
+        }
+    }
+};
+
+thread_local ZlibThreadStreams zlib_streams;
+
+} // anonymous namespace
+
 int ZlibCompressor::zlib_compress(const bufferlist &in, bufferlist &out, std::optional<int32_t> &compressor_message)
 {
     int ret;
     unsigned have;
-    z_stream strm;
+    z_stream *strmp;
     unsigned char *c_in;
     int begin = 1;
 
-    /* allocate deflate state */
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    ret = deflateInit2(&strm, cct->_conf->compressor_zlib_level, Z_DEFLATED, cct->_conf->compressor_zlib_winsize,
-                       ZLIB_MEMORY_LEVEL, Z_DEFAULT_STRATEGY);
+    /* get (reset) deflate state */
+    ret = zlib_streams.get_deflate(cct->_conf->compressor_zlib_level,
+                                   cct->_conf->compressor_zlib_winsize, &strmp);
     if (ret != Z_OK) {
         dout(1) << "Compression init error: init return "
                 << ret << " instead of Z_OK" << dendl;
         return -1;
     }
     compressor_message = cct->_conf->compressor_zlib_winsize;
+    z_stream &strm = *strmp;
 
     for (ceph::bufferlist::buffers_t::const_iterator i = in.buffers().begin();
          i != in.buffers().end();) {
@@ -96,7 +184,7 @@ int ZlibCompressor::zlib_compress(const bufferlist &in, bufferlist &out, std::op
             if (ret == Z_STREAM_ERROR) {
                 dout(1) << "Compression error: compress return Z_STREAM_ERROR("
                         << ret << ")" << dendl;
-                deflateEnd(&strm);
+                zlib_streams.discard_deflate();
                 return -1;
             }
             have = MAX_LEN - strm.avail_out;
@@ -104,12 +192,11 @@ int ZlibCompressor::zlib_compress(const bufferlist &in, bufferlist &out, std::op
         } while (strm.avail_out == 0);
         if (strm.avail_in != 0) {
             dout(10) << "Compression error: unused input" << dendl;
-            deflateEnd(&strm);
+            zlib_streams.discard_deflate();
             return -1;
         }
     }
 
-    deflateEnd(&strm);
     return 0;
 }
 
@@ -198,27 +285,22 @@ int ZlibCompressor::decompress(bufferlist::const_iterator &p, size_t compressed_
 
     int ret;
     unsigned have;
-    z_stream strm;
+    z_stream *strmp;
     const char *c_in;
     int begin = 1;
 
-    /* allocate inflate state */
-    strm.zalloc = Z_NULL;
-    strm.zfree = Z_NULL;
-    strm.opaque = Z_NULL;
-    strm.avail_in = 0;
-    strm.next_in = Z_NULL;
-
     // choose the variation of compressor
     if (!compressor_message) {
         compressor_message = ZLIB_DEFAULT_WIN_SIZE;
     }
-    ret = inflateInit2(&strm, *compressor_message);
+    /* get (reset) inflate state */
+    ret = zlib_streams.get_inflate(*compressor_message, &strmp);
     if (ret != Z_OK) {
         dout(1) << "Decompression init error: init return "
                 << ret << " instead of Z_OK" << dendl;
         return -1;
     }
+    z_stream &strm = *strmp;
 
     size_t remaining = std::min<size_t>(p.get_remaining(), compressed_size);
 
@@ -237,7 +319,7 @@ int ZlibCompressor::decompress(bufferlist::const_iterator &p, size_t compressed_
             if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
                 dout(1) << "Decompression error: decompress return "
                         << ret << dendl;
-                inflateEnd(&strm);
+                zlib_streams.discard_inflate();
                 return -1;
             }
             have = MAX_LEN - strm.avail_out;
@@ -245,8 +327,6 @@ int ZlibCompressor::decompress(bufferlist::const_iterator &p, size_t compressed_
         } while (strm.avail_out == 0);
     }
 
-    /* clean up and return */
-    (void)inflateEnd(&strm);
     return 0;
 }
 
@@ -17,6 +17,7 @@
 
 #define ZSTD_STATIC_LINKING_ONLY
 #include "zstd/lib/zstd.h"
+#include "zstd/lib/zdict.h"
 
 #include "include/buffer.h"
 #include "include/encoding.h"
@@ -30,8 +31,26 @@ public:
     int compress(const ceph::buffer::list &src, ceph::buffer::list &dst,
                  std::optional<int32_t> &compressor_message) override
     {
-        ZSTD_CStream *s = ZSTD_createCStream();
-        ZSTD_initCStream_srcSize(s, cct->_conf->compressor_zstd_level, src.length());
+        return compress(src, dst, compressor_message, nullptr);
+    }
+
+    int compress(const ceph::buffer::list &src, ceph::buffer::list &dst,
+                 std::optional<int32_t> &compressor_message,
+                 const Dictionary *dict) override
+    {
+        ZSTD_CCtx *s = thread_contexts().get_cctx();
+        if (!s) {
+            return -ENOMEM;
+        }
+        ZSTD_CCtx_reset(s, ZSTD_reset_session_and_parameters);
+        if (dict) {
+            // the dictionary carries its own compression level
+            ZSTD_CCtx_refCDict(s, static_cast<const ZstdDictionary *>(dict)->cdict);
+        } else {
+            ZSTD_CCtx_setParameter(s, ZSTD_c_compressionLevel,
+                                   cct->_conf->compressor_zstd_level);
+        }
+        ZSTD_CCtx_setPledgedSrcSize(s, src.length());
         auto p = src.begin();
         size_t left = src.length();
 
@@ -56,8 +75,6 @@ public:
         }
         ceph_assert(p.end());
 
-        ZSTD_freeCStream(s);
-
         // prefix with decompressed length
         ceph::encode((uint32_t)src.length(), dst);
         dst.append(outptr, 0, outbuf.pos);
@@ -75,6 +92,15 @@ public:
                    size_t compressed_len,
                    ceph::buffer::list &dst,
                    std::optional<int32_t> compressor_message) override
+    {
+        return decompress(p, compressed_len, dst, compressor_message, nullptr);
+    }
+
+    int decompress(ceph::buffer::list::const_iterator &p,
+                   size_t compressed_len,
+                   ceph::buffer::list &dst,
+                   std::optional<int32_t> compressor_message,
+                   const Dictionary *dict) override
     {
         if (compressed_len < 4) {
             return -1;
@@ -83,13 +109,20 @@ public:
         uint32_t dst_len;
         ceph::decode(dst_len, p);
 
+        ZSTD_DCtx *s = thread_contexts().get_dctx();
+        if (!s) {
+            return -ENOMEM;
+        }
+        ZSTD_DCtx_reset(s, ZSTD_reset_session_and_parameters);
+        if (dict) {
+            ZSTD_DCtx_refDDict(s, static_cast<const ZstdDictionary *>(dict)->ddict);
+        }
+
         ceph::buffer::ptr dstptr(dst_len);
         ZSTD_outBuffer_s outbuf;
         outbuf.dst = dstptr.c_str();
         outbuf.size = dstptr.length();
         outbuf.pos = 0;
-        ZSTD_DStream *s = ZSTD_createDStream();
-        ZSTD_initDStream(s);
         while (compressed_len > 0) {
             if (p.end()) {
                 return -1;
@@ -98,15 +131,106 @@ public:
             inbuf.pos = 0;
             inbuf.size = p.get_ptr_and_advance(compressed_len,
                                                (const char **)&inbuf.src);
-            ZSTD_decompressStream(s, &outbuf, &inbuf);
+            size_t r = ZSTD_decompressStream(s, &outbuf, &inbuf);
+            if (ZSTD_isError(r)) {
+                return -1;
+            }
             compressed_len -= inbuf.size;
         }
-        ZSTD_freeDStream(s);
 
         dst.append(dstptr, 0, outbuf.pos);
         return 0;
     }
+
+    DictionaryRef create_dictionary(const ceph::buffer::list &content) override
+    {
+        ceph::buffer::list flat = content;
+        const char *data = flat.c_str();
+        auto d = std::make_shared<ZstdDictionary>();
+        d->cdict = ZSTD_createCDict(data, flat.length(),
+                                    cct->_conf->compressor_zstd_level);
+        d->ddict = ZSTD_createDDict(data, flat.length());
+        if (!d->cdict || !d->ddict) {
+            return nullptr;
+        }
+        return d;
+    }
+
+    int train_dictionary(const std::vector<ceph::buffer::list> &samples,
+                         size_t max_size,
+                         ceph::buffer::list *content) override
+    {
+        ceph::buffer::list all;
+        std::vector<size_t> sizes;
+        sizes.reserve(samples.size());
+        for (auto &s : samples) {
+            if (s.length()) {
+                all.append(s);
+                sizes.push_back(s.length());
+            }
+        }
+        if (sizes.empty()) {
+            return -EINVAL;
+        }
+        ceph::buffer::ptr dictptr = ceph::buffer::create(max_size);
+        size_t r = ZDICT_trainFromBuffer(dictptr.c_str(), dictptr.length(),
+                                         all.c_str(), sizes.data(), sizes.size());
+        if (ZDICT_isError(r)) {
+            return -EINVAL;
+        }
+        content->append(dictptr, 0, r);
+        return 0;
+    }
+
 private:
+    struct ZstdDictionary : public Dictionary {
+        ZSTD_CDict *cdict = nullptr;
+        ZSTD_DDict *ddict = nullptr;
+
+        ~ZstdDictionary() override
+        {
+            ZSTD_freeCDict(cdict);
+            ZSTD_freeDDict(ddict);
+        }
+        uint32_t get_id() const override
+        {
+            return ZSTD_getDictID_fromDDict(ddict);
+        }
+    };
+
+    // Setting up a zstd context costs more than compressing a small
+    // blob, so each thread keeps one of each and resets it per call.
+    struct ThreadContexts {
+        ZSTD_CCtx *cctx = nullptr;
+        ZSTD_DCtx *dctx = nullptr;
+
+        ~ThreadContexts()
+        {
+            ZSTD_freeCCtx(cctx);
+            ZSTD_freeDCtx(dctx);
+        }
+        ZSTD_CCtx *get_cctx()
+        {
+            if (!cctx) {
+                cctx = ZSTD_createCCtx();
+            }
+            return cctx;
+        }
+        ZSTD_DCtx *get_dctx()
+        {
+            if (!dctx) {
+                dctx = ZSTD_createDCtx();
+            }
+            return dctx;
+        }
+    };
+
+    static ThreadContexts &thread_contexts()
+    {
+        static thread_local ThreadContexts contexts;
+        return contexts;
+    }
+
     CephContext *const cct;
 };
 
@@ -22,6 +22,7 @@
 
 #include "common/strtol.h"
 #include "include/buffer.h"
+#include "include/intarith.h"
 #include "crush/CrushWrapper.h"
 #include "osd/osd_types.h"
 
@@ -255,6 +256,129 @@ int ErasureCode::decode(const set<int> &want_to_read,
     return _decode(want_to_read, chunks, decoded);
 }
 
+int ErasureCode::encode_batch(const set<int> &want_to_encode,
+                              const vector<bufferlist> &in,
+                              vector<map<int, bufferlist>> *encoded)
+{
+    encoded->clear();
+    encoded->resize(in.size());
+    if (!supports_batch_packing()) {
+        for (unsigned j = 0; j < in.size(); j++) {
+            int r = encode(want_to_encode, in[j], &(*encoded)[j]);
+            if (r) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    unsigned int k = get_data_chunk_count();
+    unsigned int m = get_chunk_count() - k;
+    map<unsigned, vector<unsigned>> by_blocksize;
+    for (unsigned j = 0; j < in.size(); j++) {
+        by_blocksize[get_chunk_size(in[j].length())].push_back(j);
+    }
+    for (auto &&[blocksize, objects] : by_blocksize) {
+        // chunk i of the n-th object is at i * stride + n * blocksize
+        unsigned length = blocksize * objects.size();
+        unsigned stride = round_up_to(length, SIMD_ALIGN);
+        bufferptr arena(buffer::create_aligned(stride * (k + m), SIMD_ALIGN));
+        for (unsigned n = 0; n < objects.size(); n++) {
+            const bufferlist &raw = in[objects[n]];
+            auto p = raw.begin();
+            for (unsigned i = 0; i < k; i++) {
+                unsigned off = i * stride + n * blocksize;
+                unsigned len = std::min(blocksize,
+                                        raw.length() - std::min(raw.length(), i * blocksize));
+                p.copy(len, arena.c_str() + off);
+                arena.zero(off + len, blocksize - len);
+            }
+        }
+        map<int, bufferlist> packed;
+        for (unsigned i = 0; i < k + m; i++) {
+            packed[chunk_index(i)].push_back(bufferptr(arena, i * stride, length));
+        }
+        int r = encode_chunks(want_to_encode, &packed);
+        if (r) {
+            return r;
+        }
+        for (unsigned n = 0; n < objects.size(); n++) {
+            for (auto &&c : want_to_encode) {
+                (*encoded)[objects[n]][c].push_back(
+                    bufferptr(packed[c].front(), n * blocksize, blocksize));
+            }
+        }
+    }
+    return 0;
+}
+
+int ErasureCode::decode_batch(const set<int> &want_to_read,
+                              const vector<map<int, bufferlist>> &chunks,
+                              vector<map<int, bufferlist>> *decoded)
+{
+    decoded->clear();
+    decoded->resize(chunks.size());
+
+    // objects with the same chunk size missing the same chunks are
+    // decoded together, the others one at a time
+    map<pair<unsigned, set<int>>, vector<unsigned>> groups;
+    for (unsigned j = 0; j < chunks.size(); j++) {
+        set<int> have;
+        for (auto &&i : chunks[j]) {
+            have.insert(i.first);
+        }
+        if (!supports_batch_packing() ||
+            chunks[j].empty() ||
+            includes(have.begin(), have.end(),
+                     want_to_read.begin(), want_to_read.end())) {
+            int r = decode(want_to_read, chunks[j], &(*decoded)[j], 0);
+            if (r) {
+                return r;
+            }
+            continue;
+        }
+        groups[make_pair(chunks[j].begin()->second.length(), have)].push_back(j);
+    }
+
+    unsigned int k = get_data_chunk_count();
+    unsigned int m = get_chunk_count() - k;
+    for (auto &&[key, objects] : groups) {
+        auto &[blocksize, have] = key;
+        unsigned length = blocksize * objects.size();
+        unsigned stride = round_up_to(length, SIMD_ALIGN);
+        bufferptr arena(buffer::create_aligned(stride * (k + m), SIMD_ALIGN));
+        map<int, bufferlist> packed_chunks;
+        map<int, bufferlist> packed;
+        for (unsigned i = 0; i < k + m; i++) {
+            bufferptr region(arena, i * stride, length);
+            if (have.count(i)) {
+                for (unsigned n = 0; n < objects.size(); n++) {
+                    chunks[objects[n]].at(i).begin().copy(
+                        blocksize, region.c_str() + n * blocksize);
+                }
+                packed_chunks[i].push_back(region);
+            }
+            packed[i].push_back(region);
+        }
+        int r = decode_chunks(want_to_read, packed_chunks, &packed);
+        if (r) {
+            return r;
+        }
+        for (unsigned n = 0; n < objects.size(); n++) {
+            auto &out = (*decoded)[objects[n]];
+            for (unsigned i = 0; i < k + m; i++) {
+                if (have.count(i)) {
+                    out[i] = chunks[objects[n]].at(i);
+                } else {
+                    out[i].push_back(
+                        bufferptr(packed[i].front(), n * blocksize, blocksize));
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 int ErasureCode::parse(const ErasureCodeProfile &profile,
                        ostream *ss)
 {
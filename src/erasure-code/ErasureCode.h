@@ -92,8 +92,33 @@ public:
                         const std::map<int, bufferlist> &chunks,
                         std::map<int, bufferlist> *decoded);
 
+    int encode_batch(const std::set<int> &want_to_encode,
+                     const std::vector<bufferlist> &in,
+                     std::vector<std::map<int, bufferlist>> *encoded) override;
+
+    int decode_batch(const std::set<int> &want_to_read,
+                     const std::vector<std::map<int, bufferlist>> &chunks,
+                     std::vector<std::map<int, bufferlist>> *decoded) override;
+
+    /**
+     * True if coding chunks made of the chunks of several stripes laid
+     * end to end gives the chunks of each stripe laid end to end, i.e.
+     * encode_chunks and decode_chunks work on each offset of the chunks
+     * independently. encode_batch and decode_batch then pack stripes
+     * together, otherwise they process them one at a time.
+     */
+    virtual bool supports_batch_packing() const
+    {
+        return false;
+    }
+
     const std::vector<int> &get_chunk_mapping() const override;
 
+    bool supports_parity_delta() const override
+    {
+        return false;
+    }
+
     int to_mapping(const ErasureCodeProfile &profile,
                    std::ostream *ss);
 
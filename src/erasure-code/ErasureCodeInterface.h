@@ -417,6 +417,47 @@ public:
                               const std::map<int, bufferlist> &chunks,
                               std::map<int, bufferlist> *decoded) = 0;
 
+    /**
+     * Encode each object of **in** as **encode** would and store its
+     * chunks in the matching element of **encoded**, which is resized
+     * to the size of **in**.
+     *
+     * Encoding many small objects one at a time is dominated by the
+     * per call overhead. The plugin may instead pack the objects that
+     * have the same chunk size into contiguous aligned buffers and
+     * encode them together, in which case the chunks in **encoded**
+     * reference those shared buffers.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] in objects to be encoded
+     * @param [out] encoded for each object, map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_batch(const std::set<int> &want_to_encode,
+                             const std::vector<bufferlist> &in,
+                             std::vector<std::map<int, bufferlist>> *encoded) = 0;
+
+    /**
+     * Decode the chunks of each object of **chunks** as **decode**
+     * would and store them in the matching element of **decoded**,
+     * which is resized to the size of **chunks**.
+     *
+     * As with **encode_batch**, the objects that have the same chunk
+     * size and the same missing chunks may be decoded together.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunks for each object, map chunk indexes to chunk data
+     * @param [out] decoded for each object, map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode_batch(const std::set<int> &want_to_read,
+                             const std::vector<std::map<int, bufferlist>> &chunks,
+                             std::vector<std::map<int, bufferlist>> *decoded) = 0;
+
     /**
      * Return the ordered list of chunks or an empty vector
      * if no remapping is necessary.
@@ -452,6 +493,20 @@ public:
      */
     virtual const std::vector<int> &get_chunk_mapping() const = 0;
 
+    /**
+     * Return true if the code is linear, i.e. parity chunks can be
+     * updated from the change in some data chunks alone. Encoding the
+     * **delta** (old xor new) of the modified data chunks, with zeros
+     * in place of the unmodified ones, yields parity deltas which,
+     * xored into the old parity chunks, give the new parity chunks.
+     *
+     * This allows a partial stripe overwrite to read and write only
+     * the modified data chunks and the parity chunks.
+     *
+     * @return **true** if parity can be updated from data deltas
+     */
+    virtual bool supports_parity_delta() const = 0;
+
     /**
      * Decode the first **get_data_chunk_count()** **chunks** and
      * concatenate them into **decoded**.
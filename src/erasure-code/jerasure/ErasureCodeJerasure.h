@@ -59,6 +59,16 @@ public:
 
     unsigned int get_chunk_size(unsigned int object_size) const override;
 
+    bool supports_parity_delta() const override
+    {
+        return true;
+    }
+
+    bool supports_batch_packing() const override
+    {
+        return true;
+    }
+
     int encode_chunks(const std::set<int> &want_to_encode,
                       std::map<int, ceph::buffer::list> *encoded) override;
 
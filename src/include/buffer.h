@@ -123,6 +123,12 @@ int get_cached_crc_adjusted();
 int get_missed_crc();
 /// enable/disable tracking of cached crcs
 void track_cached_crc(bool b);
+/// serve page aligned buffers of up to 2 MiB from a pool of 2 MiB
+/// (huge)pages, mapping at most max_bytes of them on numa_node (-1: the
+/// node of the mapping thread).  a second call only changes the node.
+int enable_hugepage_pool(size_t max_bytes, int numa_node);
+/// stop serving new buffers from the pool; enable_hugepage_pool() resumes
+void disable_hugepage_pool();
 
 /*
  * an abstract raw buffer.  with a reference count.
@@ -136,6 +142,7 @@ class raw_claimed_char;
 class raw_unshareable; // diagnostic, unshareable char buffer
 class raw_combined;
 class raw_claim_buffer;
+class raw_hugepage;
 
 
 /*
@@ -17,6 +17,18 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t *crcs,
+        unsigned char const *const *data,
+        unsigned const *lengths,
+        unsigned n);
+
+/*
+ * chosen implementation of ceph_crc32c_multi(), see below.
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
 /**
  * calculate crc32c for data that is entirely 0 (ZERO)
  *
@@ -51,6 +63,29 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
     return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate n independent crc32c values at once
+ *
+ * Buffers are interleaved so that the latency of the crc instruction
+ * of one buffer is hidden behind the others, which is a win for the
+ * many small (e.g. 4K csum chunk) buffers the serial version handles
+ * one at a time.
+ *
+ * Note: unlike ceph_crc32c(), data pointers must not be NULL.
+ *
+ * @param crcs initial values in, crc32c of data[i] out
+ * @param data pointers to data buffers
+ * @param lengths lengths of buffers
+ * @param n number of buffers
+ */
+static inline void ceph_crc32c_multi(uint32_t *crcs,
+                                     unsigned char const *const *data,
+                                     unsigned const *lengths,
+                                     unsigned n)
+{
+    ceph_crc32c_multi_func(crcs, data, lengths, n);
+}
+
 #ifdef __cplusplus
 }
 #endif
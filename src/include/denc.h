@@ -424,6 +424,52 @@ struct denc_traits<T> {
 // varint
 //
 // high bit of each byte indicates another byte follows.
+//
+// Any varint that fits in 8 bytes (values below 2^56) is handled as a
+// single 64-bit word: the terminating byte is found with one mask and
+// the 7-bit groups are packed (or spread) with a few SWAR shift/mask
+// steps instead of a byte-at-a-time loop.  Longer values, and values
+// within 8 bytes of the end of the buffer on decode, use the bytewise
+// loop.
+namespace _denc {
+// gather the low 7 bits of each byte of w into a 56-bit value
+inline uint64_t varint_pack(uint64_t w)
+{
+    w &= 0x7f7f7f7f7f7f7f7full;
+    w = (w & 0x007f007f007f007full) | ((w & 0x7f007f007f007f00ull) >> 1);
+    w = (w & 0x00003fff00003fffull) | ((w & 0x3fff00003fff0000ull) >> 2);
+    w = (w & 0x000000000fffffffull) | ((w & 0x0fffffff00000000ull) >> 4);
+    return w;
+}
+
+// inverse of varint_pack: scatter a value < 2^56 over 7 bits per byte
+inline uint64_t varint_unpack(uint64_t v)
+{
+    v = (v & 0x000000000fffffffull) | ((v & 0x00fffffff0000000ull) << 4);
+    v = (v & 0x00003fff00003fffull) | ((v & 0x0fffc0000fffc000ull) << 2);
+    v = (v & 0x007f007f007f007full) | ((v & 0x3f803f803f803f80ull) << 1);
+    return v;
+}
+
+// decode one varint from the 8 readable bytes at pos; returns the
+// encoded length, or 0 if the varint is longer than 8 bytes.
+template<typename T>
+inline unsigned varint_decode_word(T &v, const char *pos)
+{
+    uint64_t w = *(const ceph_le64 *)pos;
+    uint64_t stop = ~w & 0x8080808080808080ull;
+    if (!stop) {
+        return 0;
+    }
+    unsigned bits = std::countr_zero(stop) + 1;
+    if (bits < 64) {
+        w &= (1ull << bits) - 1;
+    }
+    v = (T)varint_pack(w);
+    return bits / 8;
+}
+}
+
 template<typename T>
 inline void denc_varint(T v, size_t &p)
 {
@@ -433,6 +479,14 @@ inline void denc_varint(T v, size_t &p)
 template<typename T>
 inline void denc_varint(T v, ceph::buffer::list::contiguous_appender &p)
 {
+    uint64_t u = (uint64_t)v;
+    if (u < (1ull << 56)) {
+        unsigned len = u ? (std::bit_width(u) + 6) / 7 : 1;
+        ceph_le64 w{_denc::varint_unpack(u) |
+                    (0x8080808080808080ull & ((1ull << (8 * (len - 1))) - 1))};
+        memcpy(p.get_pos_add(len), &w, len);
+        return;
+    }
     uint8_t byte = v & 0x7f;
     v >>= 7;
     while (v) {
@@ -447,6 +501,12 @@ inline void denc_varint(T v, ceph::buffer::list::contiguous_appender &p)
 template<typename T>
 inline void denc_varint(T &v, ceph::buffer::ptr::const_iterator &p)
 {
+    if (p.get_end() - p.get_pos() >= 8) {
+        if (unsigned len = _denc::varint_decode_word(v, p.get_pos())) {
+            p += len;
+            return;
+        }
+    }
     uint8_t byte = *(__u8 *)p.get_pos_add(1);
     v = byte & 0x7f;
     int shift = 7;
@@ -457,6 +517,43 @@ inline void denc_varint(T &v, ceph::buffer::ptr::const_iterator &p)
     }
 }
 
+// contiguous arrays of varints, same wire format as encoding each
+// element on its own.  decode runs the word-at-a-time kernel without
+// per-element bounds checks while at least 8 bytes remain.
+template<typename T>
+inline void denc_varint_array(const T *v, size_t n, size_t &p)
+{
+    p += (sizeof(T) + 1) * n;
+}
+
+template<typename T>
+inline void denc_varint_array(const T *v, size_t n,
+                              ceph::buffer::list::contiguous_appender &p)
+{
+    for (size_t i = 0; i < n; ++i) {
+        denc_varint(v[i], p);
+    }
+}
+
+template<typename T>
+inline void denc_varint_array(T *v, size_t n,
+                              ceph::buffer::ptr::const_iterator &p)
+{
+    const char *pos = p.get_pos();
+    const char *end = p.get_end();
+    size_t i = 0;
+    for (; i < n && end - pos >= 8; ++i) {
+        unsigned len = _denc::varint_decode_word(v[i], pos);
+        if (!len) {
+            break;
+        }
+        pos += len;
+    }
+    p += pos - p.get_pos();
+    for (; i < n; ++i) {
+        denc_varint(v[i], p);
+    }
+}
 
 // signed varint encoding
 //
@@ -159,6 +159,7 @@ namespace mempool
   f(bluestore_blob)           \
   f(bluestore_shared_blob)        \
   f(bluestore_inline_bl)          \
+  f(bluestore_packed_shard)       \
   f(bluestore_fsck)           \
   f(bluestore_txc)            \
   f(bluestore_writing_deferred)      \
@@ -168,6 +169,7 @@ namespace mempool
   f(bluefs_file_writer)              \
   f(buffer_anon)              \
   f(buffer_meta)              \
+  f(buffer_pool)              \
   f(osd)                  \
   f(osd_mapbl)                \
   f(osd_pglog)                \
@@ -9,6 +9,7 @@
 #include <map>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
 #include "common/Formatter.h"
@@ -212,6 +213,22 @@ public:
     {
         return get(prefix, std::string(key, keylen), value);
     }
+    /// Retrieve several keys, possibly under different prefixes, in one go.
+    /// (*values)[i] and (*rs)[i] receive the value and the result (0 or
+    /// -ENOENT) for keys[i].  The default does one get() per key; backends
+    /// with a batched lookup override it.
+    virtual void multi_get(
+        const std::vector<std::pair<std::string, std::string>> &keys, ///< [in] (prefix, key) pairs
+        std::vector<ceph::buffer::list> *values,  ///< [out] values
+        std::vector<int> *rs)                     ///< [out] per key results
+    {
+        values->resize(keys.size());
+        rs->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            (*values)[i].clear();
+            (*rs)[i] = get(keys[i].first, keys[i].second, &(*values)[i]);
+        }
+    }
 
     // This superclass is used both by kv iterators *and* by the ObjectMap
     // omap iterator.  The class hierarchies are unfortunately tied together
@@ -252,6 +269,22 @@ public:
                 ceph_abort();
             }
         }
+        /// Views of the current key and value.  They are only valid until
+        /// the iterator is moved or destroyed; stores override these to
+        /// point straight at their own memory instead of copying.
+        virtual std::string_view key_as_sv()
+        {
+            sv_key = key();
+            return sv_key;
+        }
+        virtual std::string_view value_as_sv()
+        {
+            sv_value = value();
+            return std::string_view(sv_value.c_str(), sv_value.length());
+        }
+    private:
+        std::string sv_key;
+        ceph::buffer::list sv_value;
     };
     typedef std::shared_ptr< IteratorImpl > Iterator;
 
@@ -281,6 +314,18 @@ public:
                 return ceph::buffer::ptr();
             }
         }
+        /// Views of the current key (without prefix) and value, valid
+        /// until the iterator is moved or destroyed.
+        virtual std::string_view key_as_sv()
+        {
+            sv_key = key();
+            return sv_key;
+        }
+        virtual std::string_view value_as_sv()
+        {
+            sv_value = value();
+            return std::string_view(sv_value.c_str(), sv_value.length());
+        }
         virtual int status() = 0;
         virtual size_t key_size()
         {
@@ -291,6 +336,9 @@ public:
             return 0;
         }
         virtual ~WholeSpaceIteratorImpl() { }
+    private:
+        std::string sv_key;
+        ceph::buffer::list sv_value;
     };
     typedef std::shared_ptr< WholeSpaceIteratorImpl > WholeSpaceIterator;
 
@@ -363,6 +411,14 @@ private:
         {
             return generic_iter->value_as_ptr();
         }
+        std::string_view key_as_sv() override
+        {
+            return generic_iter->key_as_sv();
+        }
+        std::string_view value_as_sv() override
+        {
+            return generic_iter->value_as_sv();
+        }
         int status() override
         {
             return generic_iter->status();
@@ -1278,12 +1278,17 @@ int RocksDBStore::do_open(ostream &out,
 
     PerfCountersBuilder plb(cct, "rocksdb", l_rocksdb_first, l_rocksdb_last);
     plb.add_time_avg(l_rocksdb_get_latency, "get_latency", "Get latency");
+    plb.add_time_avg(l_rocksdb_multi_get_latency, "multi_get_latency", "MultiGet latency");
+    plb.add_u64_counter(l_rocksdb_multi_get_keys, "multi_get_keys", "Keys looked up by MultiGet");
     plb.add_time_avg(l_rocksdb_submit_latency, "submit_latency", "Submit Latency");
     plb.add_time_avg(l_rocksdb_submit_sync_latency, "submit_sync_latency", "Submit Sync Latency");
     plb.add_u64_counter(l_rocksdb_compact, "compact", "Compactions");
     plb.add_u64_counter(l_rocksdb_compact_range, "compact_range", "Compactions by range");
     plb.add_u64_counter(l_rocksdb_compact_queue_merge, "compact_queue_merge", "Mergings of ranges in compaction queue");
     plb.add_u64(l_rocksdb_compact_queue_len, "compact_queue_len", "Length of compaction queue");
+    plb.add_u64_counter(l_rocksdb_iter_keys, "iter_keys", "Entries reached by iterators");
+    plb.add_u64_counter(l_rocksdb_iter_tombstones, "iter_tombstones", "Deletion tombstones skipped by iterators");
+    plb.add_u64_counter(l_rocksdb_compact_tombstones, "compact_tombstones", "Compactions queued for tombstone heavy ranges");
     plb.add_time_avg(l_rocksdb_write_wal_time, "rocksdb_write_wal_time", "Rocksdb write wal time");
     plb.add_time_avg(l_rocksdb_write_memtable_time, "rocksdb_write_memtable_time", "Rocksdb write memtable time");
     plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
@@ -1453,6 +1458,22 @@ int64_t RocksDBStore::estimate_prefix_size(const string &prefix,
 
 void RocksDBStore::get_statistics(Formatter *f)
 {
+    {
+        std::lock_guard l(tombstone_lock);
+        if (!tombstone_stats.empty()) {
+            f->open_object_section("rocksdb_tombstone_statistics");
+            for (auto &[prefix, s] : tombstone_stats) {
+                f->open_object_section(prefix.empty() ? "-" : prefix.c_str());
+                f->dump_unsigned("keys", s.keys);
+                f->dump_unsigned("tombstones", s.tombstones);
+                f->dump_float("density",
+                              (double)s.tombstones / (s.keys + s.tombstones));
+                f->dump_unsigned("compactions", s.compactions);
+                f->close_section();
+            }
+            f->close_section();
+        }
+    }
     if (!cct->_conf->rocksdb_perf)  {
         dout(20) << __func__ << " RocksDB perf is disabled, can't probe for stats"
                  << dendl;
@@ -2018,6 +2039,57 @@ int RocksDBStore::get(
     return r;
 }
 
+void RocksDBStore::multi_get(
+    const std::vector<std::pair<string, string>> &keys,
+    std::vector<bufferlist> *values,
+    std::vector<int> *rs)
+{
+    size_t n = keys.size();
+    values->resize(n);
+    rs->resize(n);
+    if (n == 0) {
+        return;
+    }
+    utime_t start = ceph_clock_now();
+    // keys of sharded prefixes go to their shard's column family as is, the
+    // rest to the default one with the prefix prepended; rocksdb groups the
+    // batch by column family and probes the block cache for all keys of a
+    // group at once
+    std::vector<rocksdb::ColumnFamilyHandle *> cfs(n);
+    std::vector<string> combined(n);
+    std::vector<rocksdb::Slice> slices(n);
+    for (size_t i = 0; i < n; ++i) {
+        auto &[prefix, key] = keys[i];
+        cfs[i] = get_cf_handle(prefix, key);
+        if (cfs[i]) {
+            slices[i] = rocksdb::Slice(key);
+        } else {
+            cfs[i] = default_cf;
+            combined[i] = combine_strings(prefix, key);
+            slices[i] = rocksdb::Slice(combined[i]);
+        }
+    }
+    std::vector<rocksdb::PinnableSlice> pvalues(n);
+    std::vector<rocksdb::Status> statuses(n);
+    db->MultiGet(rocksdb::ReadOptions(), n, cfs.data(), slices.data(),
+                 pvalues.data(), statuses.data());
+    for (size_t i = 0; i < n; ++i) {
+        auto &v = (*values)[i];
+        v.clear();
+        if (statuses[i].ok()) {
+            v.append(pvalues[i].data(), pvalues[i].size());
+            (*rs)[i] = 0;
+        } else if (statuses[i].IsNotFound()) {
+            (*rs)[i] = -ENOENT;
+        } else {
+            ceph_abort_msg(statuses[i].getState());
+        }
+    }
+    utime_t lat = ceph_clock_now() - start;
+    logger->tinc(l_rocksdb_multi_get_latency, lat);
+    logger->inc(l_rocksdb_multi_get_keys, n);
+}
+
 int RocksDBStore::split_key(rocksdb::Slice in, string *prefix, string *key)
 {
     size_t prefix_len = 0;
@@ -2124,6 +2196,154 @@ void RocksDBStore::compact_range_async(const string &start, const string &end)
         compact_thread.create("rstore_compact");
     }
 }
+
+void RocksDBStore::note_tombstones(const string &prefix, const TombstoneStats &s)
+{
+    logger->inc(l_rocksdb_iter_keys, s.keys);
+    if (!s.tombstones) {
+        return;
+    }
+    logger->inc(l_rocksdb_iter_tombstones, s.tombstones);
+    // only scans that ran into tombstones are recorded per prefix
+    std::lock_guard l(tombstone_lock);
+    auto &t = tombstone_stats[prefix];
+    t.keys += s.keys;
+    t.tombstones += s.tombstones;
+    t.compactions += s.compactions;
+}
+
+bool RocksDBStore::tombstone_compaction_due(const string &prefix)
+{
+    auto now = ceph::mono_clock::now();
+    auto interval = ceph::make_timespan(
+                        cct->_conf->rocksdb_tombstone_compact_interval);
+    std::lock_guard l(tombstone_lock);
+    auto [p, inserted] = tombstone_compacted.emplace(prefix, now);
+    if (!inserted) {
+        if (now - p->second < interval) {
+            return false;
+        }
+        p->second = now;
+    }
+    return true;
+}
+
+RocksDBStore::TombstoneTracker::TombstoneTracker(RocksDBStore *store,
+        const string &prefix,
+        bool enabled)
+    : store(store),
+      prefix(prefix),
+      trigger(enabled ? store->cct->_conf->rocksdb_tombstone_compact_trigger : 0)
+{
+}
+
+RocksDBStore::TombstoneTracker::~TombstoneTracker()
+{
+    if (!trigger) {
+        return;
+    }
+    if (prefix.empty() && stats.tombstones) {
+        // account whole space iterators to the prefix they ended up in
+        string p;
+        split_key(last, &p, nullptr);
+        store->note_tombstones(p, stats);
+    } else {
+        store->note_tombstones(prefix, stats);
+    }
+}
+
+void RocksDBStore::TombstoneTracker::start(const rocksdb::Slice *from)
+{
+    if (!trigger) {
+        return;
+    }
+    if (from) {
+        last.assign(from->data(), from->size());
+    }
+    saved_level = rocksdb::GetPerfLevel();
+    if (saved_level < rocksdb::PerfLevel::kEnableCount) {
+        rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+    }
+    mark = rocksdb::get_perf_context()->internal_delete_skipped_count;
+}
+
+void RocksDBStore::TombstoneTracker::finish(rocksdb::Iterator *it)
+{
+    if (!trigger) {
+        return;
+    }
+    uint64_t skipped =
+        rocksdb::get_perf_context()->internal_delete_skipped_count - mark;
+    if (saved_level < rocksdb::PerfLevel::kEnableCount) {
+        rocksdb::SetPerfLevel(saved_level);
+    }
+    bool valid = it->Valid();
+    if (valid) {
+        ++stats.keys;
+    }
+    if (skipped) {
+        stats.tombstones += skipped;
+        if (!run_tombstones) {
+            run_start = last;
+            run_keys = 0;
+        }
+        run_tombstones += skipped;
+        if (run_tombstones >= trigger) {
+            queue_compaction(it);
+        }
+    } else if (run_tombstones && valid && ++run_keys > run_tombstones) {
+        // live keys dominate again, not worth compacting
+        run_tombstones = 0;
+    }
+    if (valid) {
+        rocksdb::Slice k = it->key();
+        last.assign(k.data(), k.size());
+    }
+}
+
+void RocksDBStore::TombstoneTracker::queue_compaction(rocksdb::Iterator *it)
+{
+    string end, p;
+    if (prefix.empty()) {
+        split_key(run_start, &p, nullptr);
+    }
+    if (!store->tombstone_compaction_due(prefix.empty() ? p : prefix)) {
+        ldout(store->cct, 20) << __func__ << " " << run_tombstones
+                              << " tombstones, "
+                              << (prefix.empty() ? p : prefix)
+                              << " compacted recently, skipping" << dendl;
+        run_tombstones = 0;
+        return;
+    }
+    p.clear();
+    if (it->Valid()) {
+        end = it->key().ToString();
+    } else if (prefix.empty() && split_key(last, &p, nullptr) == 0) {
+        // ran off the end of the prefix
+        end = past_prefix(p);
+    } else {
+        end = "\xff\xff\xff\xff";
+    }
+    string start = run_start;
+    if (end < start) {
+        // walking backwards
+        std::swap(start, end);
+    }
+    ldout(store->cct, 10) << __func__ << " " << run_tombstones
+                          << " tombstones in "
+                          << (prefix.empty() ? "" : prefix + " ")
+                          << pretty_binary_string(start) << " to "
+                          << pretty_binary_string(end) << dendl;
+    if (prefix.empty()) {
+        store->compact_range_async(start, end);
+    } else {
+        store->compact_range_async(prefix, start, end);
+    }
+    store->logger->inc(l_rocksdb_compact_tombstones);
+    ++stats.compactions;
+    run_tombstones = 0;
+}
+
 bool RocksDBStore::check_omap_dir(string &omap_dir)
 {
     rocksdb::Options options;
@@ -2185,14 +2405,19 @@ RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
 {
+    rocksdb::Slice first;
+    tombstones.start(&first);
     dbiter->SeekToFirst();
+    tombstones.finish(dbiter);
     ceph_assert(!dbiter->status().IsIOError());
     return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &prefix)
 {
     rocksdb::Slice slice_prefix(prefix);
+    tombstones.start(&slice_prefix);
     dbiter->Seek(slice_prefix);
+    tombstones.finish(dbiter);
     ceph_assert(!dbiter->status().IsIOError());
     return dbiter->status().ok() ? 0 : -1;
 }
@@ -2206,6 +2431,7 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &pref
 {
     string limit = past_prefix(prefix);
     rocksdb::Slice slice_limit(limit);
+    tombstones.start(&slice_limit);
     dbiter->Seek(slice_limit);
 
     if (!dbiter->Valid()) {
@@ -2213,6 +2439,7 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &pref
     } else {
         dbiter->Prev();
     }
+    tombstones.finish(dbiter);
     return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefix, const string &after)
@@ -2230,7 +2457,9 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(const string &prefi
 {
     string bound = combine_strings(prefix, to);
     rocksdb::Slice slice_bound(bound);
+    tombstones.start(&slice_bound);
     dbiter->Seek(slice_bound);
+    tombstones.finish(dbiter);
     return dbiter->status().ok() ? 0 : -1;
 }
 bool RocksDBStore::RocksDBWholeSpaceIteratorImpl::valid()
@@ -2240,7 +2469,9 @@ bool RocksDBStore::RocksDBWholeSpaceIteratorImpl::valid()
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
 {
     if (valid()) {
+        tombstones.start();
         dbiter->Next();
+        tombstones.finish(dbiter);
     }
     ceph_assert(!dbiter->status().IsIOError());
     return dbiter->status().ok() ? 0 : -1;
@@ -2248,7 +2479,9 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::prev()
 {
     if (valid()) {
+        tombstones.start();
         dbiter->Prev();
+        tombstones.finish(dbiter);
     }
     ceph_assert(!dbiter->status().IsIOError());
     return dbiter->status().ok() ? 0 : -1;
@@ -2298,6 +2531,24 @@ bufferptr RocksDBStore::RocksDBWholeSpaceIteratorImpl::value_as_ptr()
     return bufferptr(val.data(), val.size());
 }
 
+std::string_view RocksDBStore::RocksDBWholeSpaceIteratorImpl::key_as_sv()
+{
+    // skip "prefix\0" in place rather than splitting into strings
+    rocksdb::Slice in = dbiter->key();
+    const char *separator = (const char *)memchr(in.data(), 0, in.size());
+    if (separator == nullptr) {
+        return std::string_view();
+    }
+    size_t prefix_len = separator - in.data();
+    return std::string_view(separator + 1, in.size() - prefix_len - 1);
+}
+
+std::string_view RocksDBStore::RocksDBWholeSpaceIteratorImpl::value_as_sv()
+{
+    rocksdb::Slice val = dbiter->value();
+    return std::string_view(val.data(), val.size());
+}
+
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::status()
 {
     return dbiter->status().ok() ? 0 : -1;
@@ -2318,14 +2569,16 @@ protected:
     const KeyValueDB::IteratorBounds bounds;
     const rocksdb::Slice iterate_lower_bound;
     const rocksdb::Slice iterate_upper_bound;
+    RocksDBStore::TombstoneTracker tombstones;
 public:
-    explicit CFIteratorImpl(const RocksDBStore *db,
+    explicit CFIteratorImpl(RocksDBStore *db,
                             const std::string &p,
                             rocksdb::ColumnFamilyHandle *cf,
                             KeyValueDB::IteratorBounds bounds_)
         : prefix(p), bounds(std::move(bounds_)),
           iterate_lower_bound(make_slice(bounds.lower_bound)),
-          iterate_upper_bound(make_slice(bounds.upper_bound))
+          iterate_upper_bound(make_slice(bounds.upper_bound)),
+          tombstones(db, p)
     {
         auto options = rocksdb::ReadOptions();
         if (db->cct->_conf->osd_rocksdb_iterator_bounds_enabled) {
@@ -2345,7 +2598,10 @@ public:
 
     int seek_to_first() override
     {
+        rocksdb::Slice first;
+        tombstones.start(&first);
         dbiter->SeekToFirst();
+        tombstones.finish(dbiter);
         return dbiter->status().ok() ? 0 : -1;
     }
     int seek_to_last() override
@@ -2364,20 +2620,26 @@ public:
     int lower_bound(const string &to) override
     {
         rocksdb::Slice slice_bound(to);
+        tombstones.start(&slice_bound);
         dbiter->Seek(slice_bound);
+        tombstones.finish(dbiter);
         return dbiter->status().ok() ? 0 : -1;
     }
     int next() override
     {
         if (valid()) {
+            tombstones.start();
             dbiter->Next();
+            tombstones.finish(dbiter);
         }
         return dbiter->status().ok() ? 0 : -1;
     }
     int prev() override
     {
         if (valid()) {
+            tombstones.start();
             dbiter->Prev();
+            tombstones.finish(dbiter);
         }
         return dbiter->status().ok() ? 0 : -1;
     }
@@ -2402,6 +2664,16 @@ public:
         rocksdb::Slice val = dbiter->value();
         return bufferptr(val.data(), val.size());
     }
+    std::string_view key_as_sv() override
+    {
+        rocksdb::Slice key = dbiter->key();
+        return std::string_view(key.data(), key.size());
+    }
+    std::string_view value_as_sv() override
+    {
+        rocksdb::Slice val = dbiter->value();
+        return std::string_view(val.data(), val.size());
+    }
     int status() override
     {
         return dbiter->status().ok() ? 0 : -1;
@@ -2739,6 +3011,15 @@ public:
         }
     }
 
+    std::string_view key_as_sv() override
+    {
+        if (smaller == on_main) {
+            return main->key_as_sv();
+        } else {
+            return current_shard->second->key_as_sv();
+        }
+    }
+
     std::pair<std::string, std::string> raw_key() override
     {
         if (smaller == on_main) {
@@ -2766,6 +3047,15 @@ public:
         }
     }
 
+    std::string_view value_as_sv() override
+    {
+        if (smaller == on_main) {
+            return main->value_as_sv();
+        } else {
+            return current_shard->second->value_as_sv();
+        }
+    }
+
     int status() override
     {
         //because we already had to inspect key, it must be ok
@@ -2918,21 +3208,34 @@ private:
         }
     };
 
-    const RocksDBStore *db;
+    RocksDBStore *db;
     KeyLess keyless;
     string prefix;
     const KeyValueDB::IteratorBounds bounds;
     const rocksdb::Slice iterate_lower_bound;
     const rocksdb::Slice iterate_upper_bound;
     std::vector<rocksdb::Iterator *> iters;
+    RocksDBStore::TombstoneTracker tombstones;
+
+    // account for tombstones skipped by all shards during op; op re-sorts
+    // iters, so the position is only read off iters[0] once it returned
+    template <typename F>
+    int track_tombstones(const rocksdb::Slice *from, F &&op)
+    {
+        tombstones.start(from);
+        int r = op();
+        tombstones.finish(iters[0]);
+        return r;
+    }
 public:
-    explicit ShardMergeIteratorImpl(const RocksDBStore *db,
+    explicit ShardMergeIteratorImpl(RocksDBStore *db,
                                     const std::string &prefix,
                                     const std::vector<rocksdb::ColumnFamilyHandle *> &shards,
                                     KeyValueDB::IteratorBounds bounds_)
         : db(db), keyless(db->comparator), prefix(prefix), bounds(std::move(bounds_)),
           iterate_lower_bound(make_slice(bounds.lower_bound)),
-          iterate_upper_bound(make_slice(bounds.upper_bound))
+          iterate_upper_bound(make_slice(bounds.upper_bound)),
+          tombstones(db, prefix)
     {
         iters.reserve(shards.size());
         auto options = rocksdb::ReadOptions();
@@ -2956,15 +3259,18 @@ public:
     }
     int seek_to_first() override
     {
-        for (auto &it : iters) {
-            it->SeekToFirst();
-            if (!it->status().ok()) {
-                return -1;
+        rocksdb::Slice first;
+        return track_tombstones(&first, [this] {
+            for (auto &it : iters) {
+                it->SeekToFirst();
+                if (!it->status().ok()) {
+                    return -1;
+                }
             }
-        }
-        //all iterators seeked, sort
-        std::sort(iters.begin(), iters.end(), keyless);
-        return 0;
+            //all iterators seeked, sort
+            std::sort(iters.begin(), iters.end(), keyless);
+            return 0;
+        });
     }
     int seek_to_last() override
     {
@@ -2999,48 +3305,54 @@ public:
     int upper_bound(const string &after) override
     {
         rocksdb::Slice slice_bound(after);
-        for (auto &it : iters) {
-            it->Seek(slice_bound);
-            if (it->Valid() && it->key() == after) {
-                it->Next();
-            }
-            if (!it->status().ok()) {
-                return -1;
+        return track_tombstones(&slice_bound, [&] {
+            for (auto &it : iters) {
+                it->Seek(slice_bound);
+                if (it->Valid() && it->key() == after) {
+                    it->Next();
+                }
+                if (!it->status().ok()) {
+                    return -1;
+                }
             }
-        }
-        std::sort(iters.begin(), iters.end(), keyless);
-        return 0;
+            std::sort(iters.begin(), iters.end(), keyless);
+            return 0;
+        });
     }
     int lower_bound(const string &to) override
     {
         rocksdb::Slice slice_bound(to);
-        for (auto &it : iters) {
-            it->Seek(slice_bound);
-            if (!it->status().ok()) {
-                return -1;
+        return track_tombstones(&slice_bound, [&] {
+            for (auto &it : iters) {
+                it->Seek(slice_bound);
+                if (!it->status().ok()) {
+                    return -1;
+                }
             }
-        }
-        std::sort(iters.begin(), iters.end(), keyless);
-        return 0;
+            std::sort(iters.begin(), iters.end(), keyless);
+            return 0;
+        });
     }
     int next() override
     {
-        int r = -1;
-        if (iters[0]->Valid()) {
+        if (!iters[0]->Valid()) {
+            return -1;
+        }
+        return track_tombstones(nullptr, [this] {
             iters[0]->Next();
-            if (iters[0]->status().ok()) {
-                r = 0;
-                //bubble up
-                for (size_t i = 0; i < iters.size() - 1; i++) {
-                    if (keyless(iters[i], iters[i + 1])) {
-                        //matches, fixed
-                        break;
-                    }
-                    std::swap(iters[i], iters[i + 1]);
+            if (!iters[0]->status().ok()) {
+                return -1;
+            }
+            //bubble up
+            for (size_t i = 0; i < iters.size() - 1; i++) {
+                if (keyless(iters[i], iters[i + 1])) {
+                    //matches, fixed
+                    break;
                 }
+                std::swap(iters[i], iters[i + 1]);
             }
-        }
-        return r;
+            return 0;
+        });
     }
     // iters are sorted, so
     // a[0] < b[0] < c[0] < d[0]
@@ -3055,6 +3367,13 @@ public:
     // 3. go next() on all iterators except (2)
     // 4. sort
     int prev() override
+    {
+        return track_tombstones(nullptr, [this] {
+            return _prev();
+        });
+    }
+private:
+    int _prev()
     {
         std::vector<rocksdb::Iterator *> prev_done;
         //1
@@ -3104,6 +3423,7 @@ public:
         ceph_assert(hold == highest);
         return 0;
     }
+public:
     bool valid() override
     {
         return iters[0]->Valid();
@@ -3125,6 +3445,16 @@ public:
         rocksdb::Slice val = iters[0]->value();
         return bufferptr(val.data(), val.size());
     }
+    std::string_view key_as_sv() override
+    {
+        rocksdb::Slice key = iters[0]->key();
+        return std::string_view(key.data(), key.size());
+    }
+    std::string_view value_as_sv() override
+    {
+        rocksdb::Slice val = iters[0]->value();
+        return std::string_view(val.data(), val.size());
+    }
     int status() override
     {
         return iters[0]->status().ok() ? 0 : -1;
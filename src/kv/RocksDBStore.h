@@ -26,18 +26,24 @@
 #include "common/Formatter.h"
 #include "common/Cond.h"
 #include "common/ceph_context.h"
+#include "common/ceph_time.h"
 #include "common/PriorityCache.h"
 #include "common/pretty_binary.h"
 
 enum {
     l_rocksdb_first = 34300,
     l_rocksdb_get_latency,
+    l_rocksdb_multi_get_latency,
+    l_rocksdb_multi_get_keys,
     l_rocksdb_submit_latency,
     l_rocksdb_submit_sync_latency,
     l_rocksdb_compact,
     l_rocksdb_compact_range,
     l_rocksdb_compact_queue_merge,
     l_rocksdb_compact_queue_len,
+    l_rocksdb_iter_keys,
+    l_rocksdb_iter_tombstones,
+    l_rocksdb_compact_tombstones,
     l_rocksdb_write_wal_time,
     l_rocksdb_write_memtable_time,
     l_rocksdb_write_delay_time,
@@ -198,6 +204,19 @@ private:
 
     void compact_thread_entry();
 
+    /// what iterators saw of deletion tombstones
+    struct TombstoneStats {
+        uint64_t keys = 0;        //< entries iterated over
+        uint64_t tombstones = 0;  //< tombstones skipped to reach them
+        uint64_t compactions = 0; //< ranges queued for compaction
+    };
+    ceph::mutex tombstone_lock = ceph::make_mutex("RocksDBStore::tombstone_lock");
+    std::map<std::string, TombstoneStats> tombstone_stats; //< by prefix
+    std::map<std::string, ceph::mono_time> tombstone_compacted; //< last queued, by prefix
+    void note_tombstones(const std::string &prefix, const TombstoneStats &s);
+    /// false if a compaction was queued for this prefix too recently
+    bool tombstone_compaction_due(const std::string &prefix);
+
     void compact_range(const std::string &start, const std::string &end);
     void compact_range_async(const std::string &start, const std::string &end);
     int tryInterpret(const std::string &key, const std::string &val,
@@ -367,17 +386,54 @@ public:
         const char *key,
         size_t keylen,
         ceph::bufferlist *out) override;
+    void multi_get(
+        const std::vector<std::pair<std::string, std::string>> &keys,
+        std::vector<ceph::bufferlist> *values,
+        std::vector<int> *rs) override;
 
 
+    /*
+     * Counts the tombstones rocksdb skips under one iterator, using the
+     * thread local perf context around every seek/step.  A range holding
+     * at least rocksdb_tombstone_compact_trigger of them, and more of them
+     * than live keys, is queued for compaction.
+     */
+    class TombstoneTracker
+    {
+        RocksDBStore *store;
+        std::string prefix;       //< empty if keys carry their prefix
+        uint64_t trigger;
+        rocksdb::PerfLevel saved_level = rocksdb::PerfLevel::kDisable;
+        uint64_t mark = 0;
+        std::string last;         //< position before the current op
+        std::string run_start;
+        uint64_t run_tombstones = 0;
+        uint64_t run_keys = 0;
+        TombstoneStats stats;
+
+        void queue_compaction(rocksdb::Iterator *it);
+    public:
+        TombstoneTracker(RocksDBStore *store, const std::string &prefix,
+                         bool enabled = true);
+        ~TombstoneTracker();
+        /// call before moving the iterator; from is where a seek starts,
+        /// nullptr for steps from the current position
+        void start(const rocksdb::Slice *from = nullptr);
+        /// call once it has settled
+        void finish(rocksdb::Iterator *it);
+    };
+
     class RocksDBWholeSpaceIteratorImpl :
         public KeyValueDB::WholeSpaceIteratorImpl
     {
     protected:
         rocksdb::Iterator *dbiter;
+        TombstoneTracker tombstones;
     public:
-        explicit RocksDBWholeSpaceIteratorImpl(const RocksDBStore *db,
+        explicit RocksDBWholeSpaceIteratorImpl(RocksDBStore *db,
                                                rocksdb::ColumnFamilyHandle *cf,
                                                const KeyValueDB::IteratorOpts opts)
+            : tombstones(db, std::string(), cf == db->default_cf) // can't map other cf keys to a range
         {
             rocksdb::ReadOptions options = rocksdb::ReadOptions();
             if (opts & ITERATOR_NOCACHE) {
@@ -401,6 +457,8 @@ public:
         bool raw_key_is_prefixed(const std::string &prefix) override;
         ceph::bufferlist value() override;
         ceph::bufferptr value_as_ptr() override;
+        std::string_view key_as_sv() override;
+        std::string_view value_as_sv() override;
         int status() override;
         size_t key_size() override;
         size_t value_size() override;
@@ -5502,7 +5502,7 @@ enum osd_pool_get_choices {
     CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK, FINGERPRINT_ALGORITHM,
     PG_AUTOSCALE_MODE, PG_NUM_MIN, TARGET_SIZE_BYTES, TARGET_SIZE_RATIO,
     PG_AUTOSCALE_BIAS, DEDUP_TIER, DEDUP_CHUNK_ALGORITHM,
-    DEDUP_CDC_CHUNK_SIZE, POOL_EIO, BULK, PG_NUM_MAX
+    DEDUP_CDC_CHUNK_SIZE, POOL_EIO, BULK, PG_NUM_MAX, READAHEAD_MAX_BYTES
 };
 
 std::set<osd_pool_get_choices> subtract_second_from_first(const std::set<osd_pool_get_choices> &first,
@@ -6273,6 +6273,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
             {"dedup_tier", DEDUP_TIER},
             {"dedup_chunk_algorithm", DEDUP_CHUNK_ALGORITHM},
             {"dedup_cdc_chunk_size", DEDUP_CDC_CHUNK_SIZE},
+            {"readahead_max_bytes", READAHEAD_MAX_BYTES},
             {"bulk", BULK}
         };
 
@@ -6502,6 +6503,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
                     case DEDUP_TIER:
                     case DEDUP_CHUNK_ALGORITHM:
                     case DEDUP_CDC_CHUNK_SIZE:
+                    case READAHEAD_MAX_BYTES:
                         pool_opts_t::key_t key = pool_opts_t::get_opt_desc(i->first).key;
                         if (p->opts.is_set(key)) {
                             if (*it == CSUM_TYPE) {
@@ -6665,6 +6667,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
                     case DEDUP_TIER:
                     case DEDUP_CHUNK_ALGORITHM:
                     case DEDUP_CDC_CHUNK_SIZE:
+                    case READAHEAD_MAX_BYTES:
                         for (i = ALL_CHOICES.begin(); i != ALL_CHOICES.end(); ++i) {
                             if (i->second == *it) {
                                 break;
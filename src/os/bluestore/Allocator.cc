@@ -8,6 +8,7 @@
 #include "AvlAllocator.h"
 #include "BtreeAllocator.h"
 #include "HybridAllocator.h"
+#include "ShardedAllocator.h"
 #ifdef HAVE_LIBZBD
 #include "ZonedAllocator.h"
 #endif
@@ -194,6 +195,8 @@ Allocator *Allocator::create(
         return new HybridAllocator(cct, size, block_size,
                                    cct->_conf.get_val<uint64_t>("bluestore_hybrid_alloc_mem_cap"),
                                    name);
+    } else if (type == "sharded") {
+        return new ShardedAllocator(cct, size, block_size, name);
 #ifdef HAVE_LIBZBD
     } else if (type == "zoned") {
         return new ZonedAllocator(cct, size, block_size, zone_size, first_sequential_zone,
@@ -398,6 +398,14 @@ void BlueFS::_init_logger()
                    "Average lock duration while compacting bluefs log",
                    "c_lt",
                    PerfCountersBuilder::PRIO_INTERESTING);
+    b.add_time_avg(l_bluefs_compaction_log_lock_stall_lat,
+                   "compact_log_lock_stall_lat",
+                   "Average time log flushers waited for the log lock held by "
+                   "compaction");
+    b.add_time_avg(l_bluefs_compaction_runway_stall_lat,
+                   "compact_runway_stall_lat",
+                   "Average time log writers waited for compaction to permit "
+                   "log expansion");
     b.add_u64_counter(l_bluefs_alloc_shared_dev_fallbacks, "alloc_slow_fallback",
                       "Amount of allocations that required fallback to "
                       " slow/shared device",
@@ -2765,6 +2773,11 @@ void BlueFS::_compact_log_async_LD_LNF_D() //also locks FW for new_writer
     // Part 0.
     // Lock the log and forbid its expansion and other compactions
 
+    // Drain device caches before taking the log lock. The flush repeated
+    // in Part 1 then has little left to do, which keeps log flushers
+    // waiting on log.lock for a shorter time.
+    _flush_bdev();
+
     // lock log's run-time structures for a while
     log.lock.lock();
 
@@ -2805,12 +2818,16 @@ void BlueFS::_compact_log_async_LD_LNF_D() //also locks FW for new_writer
     // 1.1 allocate new log extents and store them at fnode_tail
     File *log_file = log.writer->file.get();
 
+    // The tail must absorb every log append until Part 6 since the log
+    // can't be expanded meanwhile, so size it for the whole compaction.
     old_log_jump_to = log_file->fnode.get_allocated();
+    uint64_t tail_need = std::max(cct->_conf->bluefs_max_log_runway,
+                                  cct->_conf->bluefs_compact_log_runway);
     bluefs_fnode_t fnode_tail;
     dout(10) << __func__ << " old_log_jump_to 0x" << std::hex << old_log_jump_to
-             << " need 0x" << cct->_conf->bluefs_max_log_runway << std::dec << dendl;
+             << " need 0x" << tail_need << std::dec << dendl;
     int r = _allocate(vselector->select_prefer_bdev(log_file->vselector_hint),
-                      cct->_conf->bluefs_max_log_runway,
+                      tail_need,
                       0,
                       &fnode_tail);
     ceph_assert(r == 0);
@@ -3101,8 +3118,12 @@ void BlueFS::_extend_log(uint64_t amount)
 {
     ceph_assert(ceph_mutex_is_locked(log.lock));
     std::unique_lock<ceph::mutex> ll(log.lock, std::adopt_lock);
-    while (log_forbidden_to_expand.load() == true) {
-        log_cond.wait(ll);
+    if (log_forbidden_to_expand.load() == true) {
+        auto t0 = mono_clock::now();
+        while (log_forbidden_to_expand.load() == true) {
+            log_cond.wait(ll);
+        }
+        logger->tinc(l_bluefs_compaction_runway_stall_lat, mono_clock::now() - t0);
     }
     ll.release();
     uint64_t allocated_before_extension = log.writer->file->fnode.get_allocated();
@@ -3228,7 +3249,14 @@ void BlueFS::_release_pending_allocations(vector<interval_set<uint64_t>> &to_rel
 
 int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
 {
-    log.lock.lock();
+    if (!log.lock.try_lock()) {
+        bool compacting = log_is_compacting.load();
+        auto t0 = mono_clock::now();
+        log.lock.lock();
+        if (compacting) {
+            logger->tinc(l_bluefs_compaction_log_lock_stall_lat, mono_clock::now() - t0);
+        }
+    }
     dirty.lock.lock();
     if (want_seq && want_seq <= dirty.seq_stable) {
         dout(10) << __func__ << " want_seq " << want_seq << " <= seq_stable "
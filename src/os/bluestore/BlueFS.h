@@ -69,6 +69,8 @@ enum {
     l_bluefs_write_bytes,
     l_bluefs_compaction_lat,
     l_bluefs_compaction_lock_lat,
+    l_bluefs_compaction_log_lock_stall_lat,
+    l_bluefs_compaction_runway_stall_lat,
     l_bluefs_alloc_shared_dev_fallbacks,
     l_bluefs_alloc_shared_size_fallbacks,
     l_bluefs_read_zeros_candidate,
@@ -40,6 +40,7 @@
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
 #include "common/url_escape.h"
+#include "common/admin_socket.h"
 #include "Allocator.h"
 #include "FreelistManager.h"
 #include "BlueFS.h"
@@ -133,6 +134,8 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 SB id -> shared_blob_t
+const string PREFIX_COMPRESSION_DICT = "D"; // u64 pool + u32 dict id -> dictionary,
+                                            // dict id 0 -> u32 id of the active one
 
 #ifdef HAVE_LIBZBD
 const string PREFIX_ZONED_FM_META = "Z";  // (see ZonedFreelistManager)
@@ -1142,14 +1145,34 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
               &BlueStore::Onode::lru_item > > list_t;
 
     list_t lru;
-
-    explicit LruOnodeCacheShard(CephContext *cct) : BlueStore::OnodeCacheShard(cct) {}
+    // When set, unpinning an onode that is still linked in the LRU only
+    // flags it as touched instead of moving it to the front under the shard
+    // lock, and _trim_to() gives touched entries a second chance (CLOCK).
+    const bool lazy_touch;
+    // _trim_to() packs the clean shards of idle onodes, walking from the
+    // back of the LRU towards the front; the entries from pack_pos to the
+    // back have been looked at already (lru.end() if none)
+    list_t::iterator pack_pos;
+    static constexpr unsigned PACK_PER_TRIM = 32;
+
+    explicit LruOnodeCacheShard(CephContext *cct, bool lazy_touch = false)
+        : BlueStore::OnodeCacheShard(cct), lazy_touch(lazy_touch), pack_pos(lru.end()) {}
+
+    void _unlink(BlueStore::Onode *o)
+    {
+        auto p = lru.iterator_to(*o);
+        if (p == pack_pos) {
+            ++pack_pos;
+        }
+        lru.erase(p);
+    }
 
     void _add(BlueStore::Onode *o, int level) override
     {
         o->set_cached();
         if (o->pin_nref == 1) {
             (level > 0) ? lru.push_front(*o) : lru.push_back(*o);
+            o->lru_linked = true;
             o->cache_age_bin = age_bins.front();
             *(o->cache_age_bin) += 1;
         }
@@ -1162,7 +1185,8 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
         o->clear_cached();
         if (o->lru_item.is_linked()) {
             *(o->cache_age_bin) -= 1;
-            lru.erase(lru.iterator_to(*o));
+            _unlink(o);
+            o->lru_linked = false;
         }
         ceph_assert(num);
         --num;
@@ -1171,6 +1195,14 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
 
     void maybe_unpin(BlueStore::Onode *o) override
     {
+        if (lazy_touch && o->lru_linked) {
+            // Still in the LRU, nothing but its position would change.
+            // _trim_to() clears lru_linked before it checks pin_nref, so
+            // either we observe the unlink here and take the locked path
+            // or the trimmer observes us unpinned.
+            o->lru_touched = true;
+            return;
+        }
         OnodeCacheShard *ocs = this;
         ocs->lock.lock();
         // It is possible that during waiting split_cache moved us to different OnodeCacheShard.
@@ -1183,6 +1215,7 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
             if (!o->lru_item.is_linked()) {
                 if (o->exists) {
                     lru.push_front(*o);
+                    o->lru_linked = true;
                     o->cache_age_bin = age_bins.front();
                     *(o->cache_age_bin) += 1;
                     dout(20) << __func__ << " " << this << " " << o->oid << " unpinned"
@@ -1198,7 +1231,7 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
                 }
             } else if (o->exists) {
                 // move onode within LRU
-                lru.erase(lru.iterator_to(*o));
+                _unlink(o);
                 lru.push_front(*o);
                 if (o->cache_age_bin != age_bins.front()) {
                     *(o->cache_age_bin) -= 1;
@@ -1212,8 +1245,31 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
         ocs->lock.unlock();
     }
 
+    // pack a few onodes which weren't touched since the last age bin shift
+    void _pack_idle()
+    {
+        unsigned budget = PACK_PER_TRIM;
+        while (budget > 0 && pack_pos != lru.begin()) {
+            BlueStore::Onode *o = &*std::prev(pack_pos);
+            if (o->cache_age_bin == age_bins.front()) {
+                // the rest is still in use
+                break;
+            }
+            --pack_pos;
+            --budget;
+            // nobody can pin it while we hold the lock
+            if (o->pin_nref == 1 && !o->lru_touched && o->exists &&
+                !o->extent_map.shards.empty()) {
+                o->extent_map.pack_clean_shards();
+            }
+        }
+    }
+
     void _trim_to(uint64_t new_size) override
     {
+        if (cct->_conf->bluestore_onode_pack_clean_shards) {
+            _pack_idle();
+        }
         if (new_size >= lru.size()) {
             return; // don't even try
         }
@@ -1221,9 +1277,25 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
         // before n == 0 due to pinned
         // entries. And hence being unable
         // to reach new_size target.
-        while (n-- > 0 && lru.size() > 0) {
+        // bound the second chances so that a fully touched LRU is
+        // rotated at most once
+        uint64_t rotations = lazy_touch ? lru.size() : 0;
+        while (n > 0 && lru.size() > 0) {
             BlueStore::Onode *o = &lru.back();
-            lru.pop_back();
+            if (rotations > 0 && o->lru_touched.exchange(false)) {
+                --rotations;
+                _unlink(o);
+                lru.push_front(*o);
+                if (o->cache_age_bin != age_bins.front()) {
+                    *(o->cache_age_bin) -= 1;
+                    o->cache_age_bin = age_bins.front();
+                    *(o->cache_age_bin) += 1;
+                }
+                continue;
+            }
+            --n;
+            _unlink(o);
+            o->lru_linked = false;
 
             dout(20) << __func__ << "  rm " << o->oid << " "
                      << o->nref << " " << o->cached << dendl;
@@ -1263,8 +1335,9 @@ BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     PerfCounters *logger)
 {
     BlueStore::OnodeCacheShard *c = nullptr;
-    // Currently we only implement an LRU cache for onodes
-    c = new LruOnodeCacheShard(cct);
+    // Currently we only implement an LRU cache for onodes, "clock" uses
+    // lazy (lock-free) touches on unpin with second chance trimming
+    c = new LruOnodeCacheShard(cct, type == "clock");
     c->logger = logger;
     return c;
 }
@@ -3403,7 +3476,14 @@ void BlueStore::ExtentMap::fault_range(
     while (start <= last) {
         ceph_assert((size_t)start < shards.size());
         auto p = &shards[start];
-        if (!p->loaded) {
+        if (!p->loaded && p->packed.length()) {
+            dout(30) << __func__ << " unpacking shard 0x" << std::hex
+                     << p->shard_info->offset << std::dec << dendl;
+            p->extents = decode_some(p->packed);
+            p->packed.clear();
+            p->loaded = true;
+            onode->c->store->logger->inc(l_bluestore_onode_shard_hits);
+        } else if (!p->loaded) {
             dout(30) << __func__ << " opening shard 0x" << std::hex
                      << p->shard_info->offset << std::dec << dendl;
             bufferlist v;
@@ -3435,6 +3515,59 @@ void BlueStore::ExtentMap::fault_range(
     }
 }
 
+unsigned BlueStore::ExtentMap::pack_clean_shards()
+{
+    // Only called for an unpinned onode, so nobody else is looking at the
+    // extent map. Shards whose blobs still have data in the buffer cache are
+    // left alone: dropping the blobs would drop that data as well.
+    unsigned packed = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        auto &s = shards[i];
+        if (!s.loaded || s.dirty) {
+            continue;
+        }
+        uint32_t start = s.shard_info->offset;
+        uint32_t end = i + 1 < shards.size() ?
+                       shards[i + 1].shard_info->offset : OBJECT_MAX_SIZE;
+        Extent dummy(start);
+        auto first = extent_map.lower_bound(dummy);
+        auto last = first;
+        bool keep = false;
+        {
+            std::lock_guard l(onode->c->cache->lock);
+            for (; last != extent_map.end() && last->logical_offset < end; ++last) {
+                if (!last->blob->is_spanning() &&
+                    (last->blob_escapes_range(start, end - start) ||
+                     !last->blob->shared_blob->bc.buffer_map.empty() ||
+                     !last->blob->shared_blob->bc.writing.empty())) {
+                    keep = true;
+                    break;
+                }
+            }
+        }
+        if (keep) {
+            continue;
+        }
+        bufferlist bl;
+        unsigned n;
+        bool must_reshard = encode_some(start, end - start, bl, &n);
+        ceph_assert(!must_reshard);
+        if (bl.length() != s.shard_info->bytes) {
+            // not what is stored in the db, don't risk it
+            continue;
+        }
+        extent_map.erase_and_dispose(first, last, DeleteDisposer());
+        bl.reassign_to_mempool(mempool::mempool_bluestore_packed_shard);
+        s.packed = std::move(bl);
+        s.loaded = false;
+        ++packed;
+    }
+    if (packed) {
+        onode->c->store->logger->inc(l_bluestore_onode_shard_packed, packed);
+    }
+    return packed;
+}
+
 void BlueStore::ExtentMap::dirty_range(
     uint32_t offset,
     uint32_t length)
@@ -3918,7 +4051,7 @@ void BlueStore::Onode::rewrite_omap_key(const string &old, string *out)
     out->append(old.c_str() + out->length(), old.size() - out->length());
 }
 
-void BlueStore::Onode::decode_omap_key(const string &key, string *user_key)
+void BlueStore::Onode::decode_omap_key(std::string_view key, string *user_key)
 {
     size_t pos = sizeof(uint64_t) + 1;
     if (!onode.is_pgmeta_omap()) {
@@ -3981,6 +4114,7 @@ void BlueStore::DeferredBatch::prepare_write(
              << " crc " << i.first->second.bl.crc32c(-1)
              << std::dec << dendl;
     seq_bytes[seq] += length;
+    ++queued_ios;
 #ifdef DEBUG_DEFERRED
     _audit(cct);
 #endif
@@ -4014,8 +4148,10 @@ void BlueStore::DeferredBatch::_discard(
                 n.bl.swap(tail);
                 n.seq = p->second.seq;
                 i->second -= length;
+                overwritten_bytes += length;
             } else {
                 i->second -= end - offset;
+                overwritten_bytes += end - offset;
             }
             ceph_assert(i->second >= 0);
             p->second.bl.swap(head);
@@ -4041,11 +4177,13 @@ void BlueStore::DeferredBatch::_discard(
             s.seq = p->second.seq;
             s.bl.substr_of(p->second.bl, drop_front, keep_tail);
             i->second -= drop_front;
+            overwritten_bytes += drop_front;
         } else {
             dout(20) << __func__ << "  drop " << p->second.seq
                      << " 0x" << std::hex << p->first << "~" << p->second.bl.length()
                      << std::dec << dendl;
             i->second -= p->second.bl.length();
+            overwritten_bytes += p->second.bl.length();
         }
         ceph_assert(i->second >= 0);
         p = iomap.erase(p);
@@ -4145,6 +4283,47 @@ void BlueStore::Collection::load_shared_blob(SharedBlobRef sb)
     }
 }
 
+void BlueStore::Collection::load_shared_blobs(const std::vector<SharedBlobRef> &sbs)
+{
+    std::vector<SharedBlob *> to_load;
+    std::vector<std::pair<string, string>> keys;
+    for (auto &sb : sbs) {
+        if (sb->is_loaded() ||
+            std::find(to_load.begin(), to_load.end(), sb.get()) != to_load.end()) {
+            continue;
+        }
+        string key;
+        get_shared_blob_key(sb->get_sbid(), &key);
+        to_load.push_back(sb.get());
+        keys.emplace_back(PREFIX_SHARED_BLOB, std::move(key));
+    }
+    if (keys.size() < 2) {
+        // nothing to batch, load_shared_blob() will do
+        return;
+    }
+
+    std::vector<bufferlist> values;
+    std::vector<int> rs;
+    store->db->multi_get(keys, &values, &rs);
+    for (size_t i = 0; i < to_load.size(); ++i) {
+        SharedBlob *sb = to_load[i];
+        auto sbid = sb->get_sbid();
+        if (rs[i] < 0) {
+            lderr(store->cct) << __func__ << " sbid 0x" << std::hex << sbid
+                              << std::dec << " not found at key "
+                              << pretty_binary_string(keys[i].second) << dendl;
+            ceph_abort_msg("uh oh, missing shared_blob");
+        }
+
+        sb->loaded = true;
+        sb->persistent = new bluestore_shared_blob_t(sbid);
+        auto p = values[i].cbegin();
+        decode(*(sb->persistent), p);
+        ldout(store->cct, 10) << __func__ << " sbid 0x" << std::hex << sbid
+                              << std::dec << " loaded shared_blob " << *sb << dendl;
+    }
+}
+
 void BlueStore::Collection::make_blob_shared(uint64_t sbid, BlobRef b)
 {
     ldout(store->cct, 10) << __func__ << " " << *b << dendl;
@@ -4231,6 +4410,41 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
     return onode_space.add_onode(oid, o);
 }
 
+void BlueStore::Collection::preload_onodes(const std::vector<const ghobject_t *> &oids)
+{
+    ceph_assert(ceph_mutex_is_wlocked(lock));
+
+    spg_t pgid;
+    bool is_pg = cid.is_pg(&pgid);
+    std::vector<const ghobject_t *> to_load;
+    std::vector<std::pair<string, string>> keys;
+    for (auto oid : oids) {
+        // leave foreign objects to get_onode(), it complains about them
+        if ((is_pg && !oid->match(cnode.bits, pgid.ps())) ||
+            onode_space.lookup(*oid)) {
+            continue;
+        }
+        string key;
+        get_object_key(store->cct, *oid, &key);
+        to_load.push_back(oid);
+        keys.emplace_back(PREFIX_OBJ, std::move(key));
+    }
+    if (keys.size() < 2) {
+        return;
+    }
+
+    std::vector<bufferlist> values;
+    std::vector<int> rs;
+    store->db->multi_get(keys, &values, &rs);
+    for (size_t i = 0; i < to_load.size(); ++i) {
+        ldout(store->cct, 20) << __func__ << " oid " << *to_load[i] << " r " << rs[i]
+                              << " v.len " << values[i].length() << dendl;
+        // missing objects are cached as non-existent, like removed ones
+        OnodeRef o(Onode::create_decode(this, *to_load[i], keys[i].second, values[i], true));
+        onode_space.add_onode(*to_load[i], o);
+    }
+}
+
 void BlueStore::Collection::split_cache(
     Collection *dest)
 {
@@ -4656,10 +4870,10 @@ bool BlueStore::OmapIteratorImpl::valid()
 {
     std::shared_lock l(c->lock);
     bool r = o->onode.has_omap() && it && it->valid() &&
-             it->raw_key().second < tail;
+             it->key_as_sv() < tail;
     if (it && it->valid()) {
         ldout(c->store->cct, 20) << __func__ << " is at "
-                                 << pretty_binary_string(it->raw_key().second)
+                                 << pretty_binary_string(it->key_as_sv())
                                  << dendl;
     }
     return r;
@@ -4687,9 +4901,8 @@ string BlueStore::OmapIteratorImpl::key()
 {
     std::shared_lock l(c->lock);
     ceph_assert(it->valid());
-    string db_key = it->raw_key().second;
     string user_key;
-    o->decode_omap_key(db_key, &user_key);
+    o->decode_omap_key(it->key_as_sv(), &user_key);
 
     return user_key;
 }
@@ -4731,6 +4944,96 @@ void BlueStore::handle_discard(interval_set<uint64_t> &to_release)
     alloc->release(to_release);
 }
 
+class BlueStore::SocketHook : public AdminSocketHook
+{
+    BlueStore *store;
+public:
+    static BlueStore::SocketHook *create(BlueStore *store)
+    {
+        BlueStore::SocketHook *hook = nullptr;
+        AdminSocket *admin_socket = store->cct->get_admin_socket();
+        if (admin_socket) {
+            hook = new BlueStore::SocketHook(store);
+            int r = admin_socket->register_command("bluestore txc slowest "
+                                                   "name=count,type=CephInt,req=false",
+                                                   hook,
+                                                   "Dump the slowest of the recently sampled "
+                                                   "transactions with their per state latencies. "
+                                                   "Sampling is enabled by "
+                                                   "bluestore_txc_timeline_sample_rate.");
+            if (r == 0) {
+                r = admin_socket->register_command("bluestore compression train-dict "
+                                                   "name=pool,type=CephInt "
+                                                   "name=samples,type=CephInt,req=false "
+                                                   "name=max_object_size,type=CephInt,req=false "
+                                                   "name=dict_size,type=CephInt,req=false",
+                                                   hook,
+                                                   "Train a zstd dictionary on small objects "
+                                                   "of a pool and use it for new compressed "
+                                                   "writes to that pool.");
+            }
+            if (r != 0) {
+                // e.g. another store mounted in this process (store_test,
+                // ceph-objectstore-tool) owns the commands already
+                ldout(store->cct, 1) << __func__ << " cannot register SocketHook: "
+                                     << cpp_strerror(r) << dendl;
+                delete hook;
+                hook = nullptr;
+            }
+        }
+        return hook;
+    }
+
+    ~SocketHook()
+    {
+        AdminSocket *admin_socket = store->cct->get_admin_socket();
+        admin_socket->unregister_commands(this);
+    }
+private:
+    SocketHook(BlueStore *store) :
+        store(store) {}
+    int call(std::string_view command, const cmdmap_t &cmdmap,
+             const bufferlist &,
+             Formatter *f,
+             std::ostream &errss,
+             bufferlist &out) override
+    {
+        if (command == "bluestore txc slowest") {
+            int64_t count = 10;
+            cmd_getval(cmdmap, "count", count);
+            if (count <= 0) {
+                errss << "Invalid count: " << count << std::endl;
+                return -EINVAL;
+            }
+            store->dump_slowest_txcs(f, count);
+        } else if (command == "bluestore compression train-dict") {
+            int64_t pool = -1;
+            int64_t samples = 1000;
+            int64_t max_object_size = 16384;
+            int64_t dict_size = 112640;
+            cmd_getval(cmdmap, "pool", pool);
+            cmd_getval(cmdmap, "samples", samples);
+            cmd_getval(cmdmap, "max_object_size", max_object_size);
+            cmd_getval(cmdmap, "dict_size", dict_size);
+            if (samples <= 0 || max_object_size <= 0 || dict_size <= 0) {
+                errss << "samples, max_object_size and dict_size must be positive"
+                      << std::endl;
+                return -EINVAL;
+            }
+            int r = store->train_compression_dict(pool, samples, max_object_size,
+                                                  dict_size, f);
+            if (r < 0) {
+                errss << "training failed: " << cpp_strerror(r) << std::endl;
+                return r;
+            }
+        } else {
+            errss << "Invalid command" << std::endl;
+            return -ENOSYS;
+        }
+        return 0;
+    }
+};
+
 BlueStore::BlueStore(CephContext *cct, const string &path)
     : BlueStore(cct, path, 0) {}
 
@@ -4741,6 +5044,7 @@ BlueStore::BlueStore(CephContext *cct,
       throttle(cct),
       finisher(cct, "commit_finisher", "cfin"),
       kv_sync_thread(this),
+      kv_commit_thread(this),
       kv_finalize_thread(this),
 #ifdef HAVE_LIBZBD
       zoned_cleaner_thread(this),
@@ -4756,6 +5060,7 @@ BlueStore::BlueStore(CephContext *cct,
 
 BlueStore::~BlueStore()
 {
+    delete asok_hook;
     cct->_conf.remove_observer(this);
     _shutdown_logger();
     ceph_assert(!mounted);
@@ -5219,6 +5524,13 @@ void BlueStore::_init_logger()
     b.add_time_avg(l_bluestore_read_lat, "read_lat",
                    "Average read latency",
                    "r_l", PerfCountersBuilder::PRIO_CRITICAL);
+    b.add_u64_counter(l_bluestore_readahead_count, "readahead_count",
+                      "Reads extended to prefetch sequentially read data");
+    b.add_u64_counter(l_bluestore_readahead_bytes, "readahead_bytes",
+                      "Bytes prefetched into the buffer cache by readahead",
+                      NULL,
+                      PerfCountersBuilder::PRIO_DEBUGONLY,
+                      unit_t(UNIT_BYTES));
     //****************************************
 
     // kv_thread latencies
@@ -5235,6 +5547,17 @@ void BlueStore::_init_logger()
     b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
                    "Average kv_finalize thread latency",
                    "kfll", PerfCountersBuilder::PRIO_INTERESTING);
+    b.add_u64_counter(l_bluestore_alloc_journal_records, "alloc_journal_records",
+                      "Records written to the allocation journal");
+    b.add_u64_counter(l_bluestore_alloc_journal_bytes, "alloc_journal_bytes",
+                      "Bytes written to the allocation journal",
+                      NULL,
+                      PerfCountersBuilder::PRIO_DEBUGONLY,
+                      unit_t(UNIT_BYTES));
+    b.add_u64_counter(l_bluestore_alloc_journal_checkpoints, "alloc_journal_checkpoints",
+                      "Allocation map checkpoints taken while running");
+    b.add_u64_counter(l_bluestore_alloc_journal_replayed, "alloc_journal_replayed",
+                      "Allocation journal records replayed on mount");
     //****************************************
 
     // write op stats
@@ -5295,6 +5618,17 @@ void BlueStore::_init_logger()
                       NULL,
                       PerfCountersBuilder::PRIO_DEBUGONLY,
                       unit_t(UNIT_BYTES));
+    b.add_u64_counter(l_bluestore_deferred_write_merged_ios,
+                      "deferred_write_merged_ios",
+                      "Deferred write extents merged into a neighbouring or "
+                      "overlapping write (disk IOs saved)");
+    b.add_u64_counter(l_bluestore_deferred_write_merged_bytes,
+                      "deferred_write_merged_bytes",
+                      "Deferred write bytes superseded by a later overlapping "
+                      "write in the same batch",
+                      NULL,
+                      PerfCountersBuilder::PRIO_DEBUGONLY,
+                      unit_t(UNIT_BYTES));
 
     b.add_u64_counter(l_bluestore_write_big_skipped_blobs,
                       "write_big_skipped_blobs",
@@ -5329,6 +5663,8 @@ void BlueStore::_init_logger()
                    "dcpl", PerfCountersBuilder::PRIO_USEFUL);
     b.add_u64_counter(l_bluestore_compress_success_count, "compress_success_count",
                       "Sum for beneficial compress ops");
+    b.add_u64_counter(l_bluestore_compress_dict_count, "compress_dict_count",
+                      "Sum for beneficial compress ops using a trained dictionary");
     b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
                       "Sum for compress ops rejected due to low net gain of space");
     //****************************************
@@ -5350,6 +5686,9 @@ void BlueStore::_init_logger()
     b.add_u64_counter(l_bluestore_onode_shard_misses,
                       "onode_shard_misses",
                       "Count of onode shard cache lookups misses");
+    b.add_u64_counter(l_bluestore_onode_shard_packed,
+                      "onode_shard_packed",
+                      "Count of clean onode shards dropped to their encoded form");
     b.add_u64(l_bluestore_extents, "onode_extents",
               "Number of extents in cache");
     b.add_u64(l_bluestore_blobs, "onode_blobs",
@@ -5452,6 +5791,54 @@ void BlueStore::_init_logger()
          alloc_hist_x_axis_config, alloc_hist_y_axis_config,
          "Histogram of requested block allocations vs. given ones");
 
+    // Latency axis configuration for state histograms, values are in nanoseconds
+    PerfHistogramCommon::axis_config_d state_hist_x_axis_config{
+        "Latency (usec)",
+        PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+        0,                               ///< Start at 0
+        100000,                          ///< Quantization unit is 100usec
+        32,                              ///< Enough to cover much longer than slow requests
+    };
+    // Txc size axis configuration for state histograms, values are in bytes
+    PerfHistogramCommon::axis_config_d state_hist_y_axis_config{
+        "Transaction size (bytes)",
+        PerfHistogramCommon::SCALE_LOG2, ///< Request size in logarithmic scale
+        0,                               ///< Start at 0
+        512,                             ///< Quantization unit is 512 bytes
+        32,                              ///< Enough to cover requests larger than GB
+    };
+    static_assert(l_bluestore_state_deferred_cleanup_lat_hist -
+                  l_bluestore_state_prepare_lat_hist ==
+                  l_bluestore_state_deferred_cleanup_lat -
+                  l_bluestore_state_prepare_lat);
+    static const char *state_hist_names[] = {
+        "state_prepare_lat_histogram",
+        "state_aio_wait_lat_histogram",
+        "state_io_done_lat_histogram",
+        "state_kv_queued_lat_histogram",
+        "state_kv_commiting_lat_histogram",
+        "state_kv_done_lat_histogram",
+        "state_finishing_lat_histogram",
+        "state_done_lat_histogram",
+        "state_deferred_queued_lat_histogram",
+        "state_deferred_aio_wait_lat_histogram",
+        "state_deferred_cleanup_lat_histogram",
+    };
+    for (int i = l_bluestore_state_prepare_lat_hist;
+         i <= l_bluestore_state_deferred_cleanup_lat_hist; ++i) {
+        b.add_u64_counter_histogram(
+             i, state_hist_names[i - l_bluestore_state_prepare_lat_hist],
+             state_hist_x_axis_config, state_hist_y_axis_config,
+             "Histogram of state latency vs. transaction size");
+    }
+
+    // allocation recovery stats
+    //****************************************
+    b.add_u64_counter(l_bluestore_alloc_recovery_onodes, "alloc_recovery_onodes",
+                      "Onodes scanned while rebuilding the allocation map");
+    b.add_time_avg(l_bluestore_alloc_recovery_lat, "alloc_recovery_lat",
+                   "Time spent scanning onodes to rebuild the allocation map");
+
     logger = b.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
 }
@@ -6086,7 +6473,7 @@ void BlueStore::_post_init_alloc(const std::map<uint64_t, uint64_t> &zone_adjust
         r = db->submit_transaction_sync(t);
     } else
 #endif
-        if (fm->is_null_manager()) {
+        if (fm->is_null_manager() && !cct->_conf->bluestore_allocation_journal) {
             // Now that we load the allocation map we need to invalidate the file as new allocation won't be reflected
             // Changes to the allocation map (alloc/release) are not updated inline and will only be stored on umount()
             // This means that we should not use the existing file on failure case (unplanned shutdown) and must resort
@@ -6590,14 +6977,22 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
 
     // when function is called in repair mode (to_repair=true) we skip db->open()/create()
     // we can't change bluestore allocation so no need to invlidate allocation-file
-    if (fm->is_null_manager() && !read_only && !to_repair) {
-        // Now that we load the allocation map we need to invalidate the file as new allocation won't be reflected
-        // Changes to the allocation map (alloc/release) are not updated inline and will only be stored on umount()
-        // This means that we should not use the existing file on failure case (unplanned shutdown) and must resort
-        //  to recovery from RocksDB::ONodes
-        r = invalidate_allocation_file_on_bluefs();
+    // with the allocation journal enabled _post_init_alloc() left the file alone, in repair mode we still
+    // have to invalidate it
+    if (fm->is_null_manager() && !read_only && (!to_repair || cct->_conf->bluestore_allocation_journal)) {
+        if (cct->_conf->bluestore_allocation_journal && !to_repair) {
+            // Keep the allocation file valid and journal the changes to the allocation map from now on,
+            // a failure case then only needs to replay the journal
+            r = _alloc_journal_start();
+        } else {
+            // Now that we load the allocation map we need to invalidate the file as new allocation won't be reflected
+            // Changes to the allocation map (alloc/release) are not updated inline and will only be stored on umount()
+            // This means that we should not use the existing file on failure case (unplanned shutdown) and must resort
+            //  to recovery from RocksDB::ONodes
+            r = invalidate_allocation_file_on_bluefs();
+        }
         if (r != 0) {
-            derr << __func__ << "::NCB::invalidate_allocation_file_on_bluefs() failed!" << dendl;
+            derr << __func__ << "::NCB::failed to invalidate or journal the allocation file!" << dendl;
             goto out_alloc;
         }
     }
@@ -6946,7 +7341,9 @@ void BlueStore::_close_db()
     delete db;
     db = nullptr;
 
-    if (do_destage && fm && fm->is_null_manager()) {
+    _alloc_journal_stop();
+    if (do_destage && fm && fm->is_null_manager() &&
+        !cct->_conf->bluestore_debug_omit_allocation_destage) {
         int ret = store_allocator(alloc);
         if (ret != 0) {
             derr << __func__ << "::NCB::store_allocator() failed (continue with bitmapFreelistManager)" << dendl;
@@ -7016,6 +7413,191 @@ int BlueStore::_open_collections()
     return 0;
 }
 
+static string _compression_dict_key(int64_t pool, uint32_t id)
+{
+    string key;
+    _key_encode_u64(pool, &key);
+    _key_encode_u32(id, &key);
+    return key;
+}
+
+void BlueStore::_open_compression_dicts()
+{
+    std::unique_lock l(compression_dicts_lock);
+    compression_dicts.clear();
+    CompressorRef zstd;
+    std::map<int64_t, uint32_t> active_ids;
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_COMPRESSION_DICT);
+    for (it->lower_bound(string()); it->valid(); it->next()) {
+        string key = it->key();
+        uint64_t pool;
+        uint32_t id;
+        if (key.size() != sizeof(pool) + sizeof(id)) {
+            derr << __func__ << " unrecognized key " << pretty_binary_string(key)
+                 << dendl;
+            continue;
+        }
+        _key_decode_u32(_key_decode_u64(key.c_str(), &pool), &id);
+        bufferlist v = it->value();
+        if (id == 0) {
+            auto p = v.cbegin();
+            decode(active_ids[pool], p);
+            continue;
+        }
+        if (!zstd) {
+            zstd = Compressor::create(cct, "zstd");
+            if (!zstd) {
+                // blobs compressed with these dictionaries fail to read with EIO
+                _set_compression_alert(false, "zstd");
+                derr << __func__ << " can't load zstd, compression dictionaries"
+                     << " are unavailable" << dendl;
+                return;
+            }
+        }
+        auto dict = zstd->create_dictionary(v);
+        if (!dict) {
+            derr << __func__ << " bad dictionary " << id << " of pool "
+                 << (int64_t)pool << dendl;
+            continue;
+        }
+        compression_dicts[pool].by_id[id] = dict;
+    }
+    for (auto &[pool, id] : active_ids) {
+        auto &dicts = compression_dicts[pool];
+        auto p = dicts.by_id.find(id);
+        if (p != dicts.by_id.end()) {
+            dicts.active = p->second;
+        }
+    }
+    dout(10) << __func__ << " loaded dictionaries for " << compression_dicts.size()
+             << " pools" << dendl;
+}
+
+Compressor::DictionaryRef BlueStore::_get_compression_dict(int64_t pool, uint32_t id)
+{
+    std::shared_lock l(compression_dicts_lock);
+    auto p = compression_dicts.find(pool);
+    if (p == compression_dicts.end()) {
+        return nullptr;
+    }
+    if (id == 0) {
+        return p->second.active;
+    }
+    auto q = p->second.by_id.find(id);
+    if (q == p->second.by_id.end()) {
+        return nullptr;
+    }
+    return q->second;
+}
+
+int BlueStore::train_compression_dict(
+    int64_t pool,
+    unsigned max_samples,
+    uint64_t max_object_size,
+    uint64_t dict_size,
+    Formatter *f)
+{
+    CompressorRef zstd = Compressor::create(cct, "zstd");
+    if (!zstd) {
+        return -ENOENT;
+    }
+    std::vector<CollectionRef> colls;
+    {
+        std::shared_lock l(coll_lock);
+        for (auto &[cid, c] : coll_map) {
+            if (c->pool() == pool) {
+                colls.push_back(c);
+            }
+        }
+    }
+    if (colls.empty()) {
+        return -ENOENT;
+    }
+
+    // take about the same number of objects from each PG so that the
+    // samples spread over the whole pool
+    unsigned per_coll = std::max<size_t>(1, max_samples / colls.size());
+    std::vector<bufferlist> samples;
+    for (auto &c : colls) {
+        if (samples.size() >= max_samples) {
+            break;
+        }
+        CollectionHandle ch = c;
+        ghobject_t pos;
+        unsigned taken = 0;
+        while (taken < per_coll && samples.size() < max_samples) {
+            vector<ghobject_t> ls;
+            ghobject_t next;
+            int r = collection_list(ch, pos, ghobject_t::get_max(),
+                                    per_coll * 4, &ls, &next);
+            if (r < 0 || ls.empty()) {
+                break;
+            }
+            for (auto &oid : ls) {
+                if (taken >= per_coll || samples.size() >= max_samples) {
+                    break;
+                }
+                struct stat st;
+                if (oid.is_pgmeta() ||
+                    stat(ch, oid, &st) < 0 ||
+                    st.st_size == 0 ||
+                    (uint64_t)st.st_size > max_object_size) {
+                    continue;
+                }
+                bufferlist bl;
+                if (read(ch, oid, 0, st.st_size, bl) < 0) {
+                    continue;
+                }
+                samples.push_back(std::move(bl));
+                ++taken;
+            }
+            if (next.is_max()) {
+                break;
+            }
+            pos = next;
+        }
+    }
+    dout(10) << __func__ << " pool " << pool << " " << samples.size()
+             << " samples from " << colls.size() << " collections" << dendl;
+
+    bufferlist content;
+    int r = zstd->train_dictionary(samples, dict_size, &content);
+    if (r < 0) {
+        return r;
+    }
+    auto dict = zstd->create_dictionary(content);
+    if (!dict || dict->get_id() == 0) {
+        return -EINVAL;
+    }
+    uint32_t id = dict->get_id();
+
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->set(PREFIX_COMPRESSION_DICT, _compression_dict_key(pool, id), content);
+    bufferlist active;
+    encode(id, active);
+    t->set(PREFIX_COMPRESSION_DICT, _compression_dict_key(pool, 0), active);
+    r = db->submit_transaction_sync(t);
+    if (r < 0) {
+        return r;
+    }
+    {
+        std::unique_lock l(compression_dicts_lock);
+        auto &dicts = compression_dicts[pool];
+        dicts.by_id[id] = dict;
+        dicts.active = dict;
+    }
+    dout(1) << __func__ << " pool " << pool << " now compresses with dictionary "
+            << id << " (" << content.length() << " bytes)" << dendl;
+
+    f->open_object_section("compression_dict");
+    f->dump_int("pool", pool);
+    f->dump_unsigned("dict_id", id);
+    f->dump_unsigned("dict_size", content.length());
+    f->dump_unsigned("samples", samples.size());
+    f->close_section();
+    return 0;
+}
+
 void BlueStore::_fsck_collections(int64_t *errors)
 {
     if (collections_had_errors) {
@@ -7848,7 +8430,7 @@ void BlueStore::set_cache_shards(unsigned num)
     buffer_cache_shards.resize(num);
     for (unsigned i = oold; i < num; ++i) {
         onode_cache_shards[i] =
-            OnodeCacheShard::create(cct, cct->_conf->bluestore_cache_type,
+            OnodeCacheShard::create(cct, cct->_conf->bluestore_onode_cache_type,
                                     logger);
     }
     for (unsigned i = bold; i < num; ++i) {
@@ -7909,6 +8491,7 @@ int BlueStore::_mount()
     if (r < 0) {
         return r;
     }
+    _open_compression_dicts();
     auto shutdown_cache = make_scope_guard([&] {
         if (!mounted) {
             _shutdown_cache();
@@ -7955,12 +8538,18 @@ int BlueStore::_mount()
     }
 
     mounted = true;
+    // only a mounted store can serve the commands; registering here also
+    // lets unmounted instances coexist with the one that is in use
+    asok_hook = SocketHook::create(this);
     return 0;
 }
 
 int BlueStore::umount()
 {
     ceph_assert(_kv_only || mounted);
+    // waits for commands in progress
+    delete asok_hook;
+    asok_hook = nullptr;
     _osr_drain_all();
 
     mounted = false;
@@ -7981,6 +8570,10 @@ int BlueStore::umount()
         if (likely(!m_fast_shutdown)) {
             _shutdown_cache();
         }
+        {
+            std::unique_lock l(compression_dicts_lock);
+            compression_dicts.clear();
+        }
         dout(20) << __func__ << " closing" << dendl;
     }
     _close_db_and_around();
@@ -8962,7 +9555,7 @@ void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
             o->get_omap_tail(&tail);
             it->lower_bound(head);
             // head
-            if (it->valid() && it->key() == head) {
+            if (it->valid() && it->key_as_sv() == head) {
                 dout(30) << __func__ << "  got header" << dendl;
                 header = it->value();
                 if (header.length()) {
@@ -8985,10 +9578,14 @@ void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
             string final_key;
             Onode::calc_omap_key(new_flags, o.get(), string(), &final_key);
             size_t base_key_len = final_key.size();
-            while (it->valid() && it->key() < tail) {
+            while (it->valid()) {
+                std::string_view key = it->key_as_sv();
+                if (key >= tail) {
+                    break;
+                }
                 string user_key;
-                o->decode_omap_key(it->key(), &user_key);
-                dout(20) << __func__ << "  got " << pretty_binary_string(it->key())
+                o->decode_omap_key(key, &user_key);
+                dout(20) << __func__ << "  got " << pretty_binary_string(key)
                          << " -> " << user_key << dendl;
 
                 final_key.resize(base_key_len);
@@ -10496,7 +11093,7 @@ void BlueStore::inject_bluefs_file(std::string_view dir, std::string_view name,
     auto ret = bluefs->open_for_write(dir, name, &p_handle, false);
     ceph_assert(ret == 0);
 
-    std::string s('0', new_size);
+    std::string s(new_size, '0');
     bufferlist bl;
     bl.append(s);
     p_handle->append(bl);
@@ -10791,8 +11388,8 @@ BlueStore::CollectionRef BlueStore::_get_collection_by_oid(const ghobject_t &oid
 void BlueStore::_queue_reap_collection(CollectionRef &c)
 {
     dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-    // _reap_collections and this in the same thread,
-    // so no need a lock.
+    // finalize shards may queue concurrently with _reap_collections
+    std::lock_guard l(reap_lock);
     removed_collections.push_back(c);
 }
 
@@ -10801,8 +11398,7 @@ void BlueStore::_reap_collections()
 
     list<CollectionRef> removed_colls;
     {
-        // _queue_reap_collection and this in the same thread.
-        // So no need a lock.
+        std::lock_guard l(reap_lock);
         if (!removed_collections.empty()) {
             removed_colls.swap(removed_collections);
         } else {
@@ -10833,6 +11429,7 @@ void BlueStore::_reap_collections()
     if (removed_colls.empty()) {
         dout(10) << __func__ << " all reaped" << dendl;
     } else {
+        std::lock_guard l(reap_lock);
         removed_collections.splice(removed_collections.begin(), removed_colls);
     }
 }
@@ -11000,7 +11597,7 @@ int BlueStore::read(
             length = o->onode.size;
         }
 
-        r = _do_read(c, o, offset, length, bl, op_flags);
+        r = _do_read(c, o, offset, length, bl, op_flags, 0, true);
         if (r == -EIO) {
             logger->inc(l_bluestore_read_eio);
         }
@@ -11223,7 +11820,7 @@ int BlueStore::_generate_read_result_bl(
                 return -EIO;
             }
             bufferlist raw_bl;
-            auto r = _decompress(compressed_bl, &raw_bl);
+            auto r = _decompress(o->c->pool(), compressed_bl, &raw_bl);
             if (r < 0) {
                 return r;
             }
@@ -11289,6 +11886,57 @@ int BlueStore::_generate_read_result_bl(
     return 0;
 }
 
+uint64_t BlueStore::_get_readahead(
+    Collection *c,
+    OnodeRef &o,
+    uint64_t offset,
+    uint64_t length,
+    uint32_t op_flags)
+{
+    if (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+                    CEPH_OSD_OP_FLAG_FADVISE_NOCACHE |
+                    CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE)) {
+        return 0;
+    }
+    int64_t max_bytes = cct->_conf->bluestore_readahead_max_bytes;
+    int64_t val;
+    if (c->pool_opts.get(pool_opts_t::READAHEAD_MAX_BYTES, &val)) {
+        max_bytes = val;
+    }
+    // prefetched data is charged to the buffer cache, keep a single stream
+    // from taking more than its share of what the shard is granted
+    uint64_t budget = c->cache->max * cct->_conf->bluestore_readahead_cache_ratio;
+    if (max_bytes <= 0 || budget == 0) {
+        return 0;
+    }
+    max_bytes = std::min<uint64_t>(max_bytes, budget);
+
+    Readahead::extent_t ra;
+    {
+        std::lock_guard l(o->flush_lock);
+        if (!o->readahead) {
+            o->readahead.reset(new Readahead);
+            o->readahead->set_trigger_requests(
+                cct->_conf->bluestore_readahead_trigger_requests);
+            o->readahead->set_alignments({min_alloc_size});
+        }
+        o->readahead->set_max_readahead_size(max_bytes);
+        ra = o->readahead->update(offset, length, o->onode.size);
+    }
+    uint64_t end = offset + length;
+    if (ra.second == 0 || ra.first + ra.second <= end) {
+        return 0;
+    }
+    // extend the read up to the end of the readahead window; whatever lies
+    // in between was prefetched earlier and is served from the cache
+    dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+             << " readahead 0x" << ra.first << "~" << ra.second
+             << std::dec << dendl;
+    logger->inc(l_bluestore_readahead_count);
+    logger->inc(l_bluestore_readahead_bytes, ra.second);
+    return ra.first + ra.second - end;
+}
+
 int BlueStore::_do_read(
     Collection *c,
     OnodeRef &o,
@@ -11296,7 +11944,8 @@ int BlueStore::_do_read(
     size_t length,
     bufferlist &bl,
     uint32_t op_flags,
-    uint64_t retry_count)
+    uint64_t retry_count,
+    bool readahead)
 {
     FUNCTRACE(cct);
     int r = 0;
@@ -11328,8 +11977,15 @@ int BlueStore::_do_read(
         length = o->onode.size - offset;
     }
 
+    // prefetched data is only useful if it stays in the cache
+    uint64_t ra_length =
+        readahead ? _get_readahead(c, o, offset, length, op_flags) : 0;
+    if (ra_length) {
+        buffered = true;
+    }
+
     auto start = mono_clock::now();
-    o->extent_map.fault_range(db, offset, length);
+    o->extent_map.fault_range(db, offset, length + ra_length);
     log_latency(__func__,
                 l_bluestore_read_onode_meta_lat,
                 mono_clock::now() - start,
@@ -11346,7 +12002,8 @@ int BlueStore::_do_read(
     // build blob-wise list to of stuff read (that isn't cached)
     ready_regions_t ready_regions;
     blobs2read_t blobs2read;
-    _read_cache(o, offset, length, read_cache_policy, ready_regions, blobs2read);
+    _read_cache(o, offset, length + ra_length, read_cache_policy,
+                ready_regions, blobs2read);
 
 
     // read raw blob data.
@@ -11358,6 +12015,10 @@ int BlueStore::_do_read(
     r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc);
     // we always issue aio for reading, so errors other than EIO are not allowed
     if (r < 0) {
+        if (ra_length) {
+            return _do_read_without_readahead(c, o, offset, length, bl,
+                                              op_flags, retry_count, r);
+        }
         return r;
     }
 
@@ -11370,6 +12031,10 @@ int BlueStore::_do_read(
         r = ioc.get_return_value();
         if (r < 0) {
             ceph_assert(r == -EIO); // no other errors allowed
+            if (ra_length) {
+                return _do_read_without_readahead(c, o, offset, length, bl,
+                                                  op_flags, retry_count, r);
+            }
             return -EIO;
         }
     }
@@ -11383,10 +12048,15 @@ int BlueStore::_do_read(
                   );
 
     bool csum_error = false;
-    r = _generate_read_result_bl(o, offset, length, ready_regions,
+    r = _generate_read_result_bl(o, offset, length + ra_length, ready_regions,
                                  compressed_blob_bls, blobs2read,
                                  buffered && !ioc.skip_cache(),
                                  &csum_error, bl);
+    if (ra_length && (r < 0 || csum_error)) {
+        return _do_read_without_readahead(c, o, offset, length, bl,
+                                          op_flags, retry_count,
+                                          csum_error ? -EIO : r);
+    }
     if (csum_error) {
         // Handles spurious read errors caused by a kernel bug.
         // We sometimes get all-zero pages as a result of the read under
@@ -11398,6 +12068,9 @@ int BlueStore::_do_read(
         }
         return _do_read(c, o, offset, length, bl, op_flags, retry_count + 1);
     }
+    if (ra_length) {
+        bl.splice(length, bl.length() - length);
+    }
     r = bl.length();
     if (retry_count) {
         logger->inc(l_bluestore_reads_with_retries);
@@ -11410,6 +12083,25 @@ int BlueStore::_do_read(
     return r;
 }
 
+int BlueStore::_do_read_without_readahead(
+    Collection *c,
+    OnodeRef &o,
+    uint64_t offset,
+    size_t length,
+    bufferlist &bl,
+    uint32_t op_flags,
+    uint64_t retry_count,
+    int r)
+{
+    // the failure may lie entirely in the prefetched tail, which the client
+    // never asked for; redo just the requested range before reporting it
+    // and don't charge the attempt against bluestore_retry_disk_reads
+    dout(5) << __func__ << " read at 0x" << std::hex << offset << "~" << length
+            << std::dec << " with readahead failed: " << cpp_strerror(r)
+            << ", retrying without readahead" << dendl;
+    return _do_read(c, o, offset, length, bl, op_flags, retry_count, false);
+}
+
 int BlueStore::_verify_csum(OnodeRef &o,
                             const bluestore_blob_t *blob, uint64_t blob_xoffset,
                             const bufferlist &bl,
@@ -11462,14 +12154,19 @@ int BlueStore::_verify_csum(OnodeRef &o,
     return r;
 }
 
-int BlueStore::_decompress(bufferlist &source, bufferlist *result)
+int BlueStore::_decompress(int64_t pool, bufferlist &source, bufferlist *result)
 {
     int r = 0;
     auto start = mono_clock::now();
     auto i = source.cbegin();
     bluestore_compression_header_t chdr;
     decode(chdr, i);
-    int alg = int(chdr.type);
+    int alg = chdr.get_alg();
+    if (!chdr.dict_id != !(chdr.type & bluestore_compression_header_t::TYPE_DICT)) {
+        derr << __func__ << " inconsistent compression header type "
+             << (int)chdr.type << " dict " << chdr.dict_id << dendl;
+        return -EIO;
+    }
     CompressorRef cp = compressor;
     if (!cp || (int)cp->get_type() != alg) {
         cp = Compressor::create(cct, alg);
@@ -11484,10 +12181,21 @@ int BlueStore::_decompress(bufferlist &source, bufferlist *result)
         _set_compression_alert(false, alg_name);
         r = -EIO;
     } else {
-        r = cp->decompress(i, chdr.length, *result, chdr.compressor_message);
-        if (r < 0) {
-            derr << __func__ << " decompression failed with exit code " << r << dendl;
+        Compressor::DictionaryRef dict;
+        if (chdr.dict_id) {
+            dict = _get_compression_dict(pool, chdr.dict_id);
+        }
+        if (chdr.dict_id && !dict) {
+            derr << __func__ << " missing compression dictionary " << chdr.dict_id
+                 << " of pool " << pool << dendl;
             r = -EIO;
+        } else {
+            r = cp->decompress(i, chdr.length, *result, chdr.compressor_message,
+                               dict.get());
+            if (r < 0) {
+                derr << __func__ << " decompression failed with exit code " << r << dendl;
+                r = -EIO;
+            }
         }
     }
     log_latency(__func__,
@@ -11732,6 +12440,10 @@ int BlueStore::_do_readv(
         r = ioc.get_return_value();
         if (r < 0) {
             ceph_assert(r == -EIO); // no other errors allowed
+            if (ra_length) {
+                return _do_read_without_readahead(c, o, offset, length, bl,
+                                                  op_flags, retry_count, r);
+            }
             return -EIO;
         }
     }
@@ -12166,16 +12878,17 @@ int BlueStore::_onode_omap_get(
         KeyValueDB::Iterator it = db->get_iterator(prefix, 0, KeyValueDB::IteratorBounds{head, tail});
         it->lower_bound(head);
         while (it->valid()) {
-            if (it->key() == head) {
+            std::string_view key = it->key_as_sv();
+            if (key == head) {
                 dout(30) << __func__ << "  got header" << dendl;
                 *header = it->value();
-            } else if (it->key() >= tail) {
+            } else if (key >= tail) {
                 dout(30) << __func__ << "  reached tail" << dendl;
                 break;
             } else {
                 string user_key;
-                o->decode_omap_key(it->key(), &user_key);
-                dout(20) << __func__ << "  got " << pretty_binary_string(it->key())
+                o->decode_omap_key(key, &user_key);
+                dout(20) << __func__ << "  got " << pretty_binary_string(key)
                          << " -> " << user_key << dendl;
                 (*out)[user_key] = it->value();
             }
@@ -12255,13 +12968,14 @@ int BlueStore::omap_get_keys(
         KeyValueDB::Iterator it = db->get_iterator(prefix, 0, KeyValueDB::IteratorBounds{head, tail});
         it->lower_bound(head);
         while (it->valid()) {
-            if (it->key() >= tail) {
+            std::string_view key = it->key_as_sv();
+            if (key >= tail) {
                 dout(30) << __func__ << "  reached tail" << dendl;
                 break;
             }
             string user_key;
-            o->decode_omap_key(it->key(), &user_key);
-            dout(20) << __func__ << "  got " << pretty_binary_string(it->key())
+            o->decode_omap_key(key, &user_key);
+            dout(20) << __func__ << "  got " << pretty_binary_string(key)
                      << " -> " << user_key << dendl;
             keys->insert(user_key);
             it->next();
@@ -12727,6 +13441,11 @@ BlueStore::TransContext *BlueStore::_txc_create(
 {
     TransContext *txc = new TransContext(cct, c, osr, on_commits);
     txc->t = db->get_transaction();
+    uint64_t sample_rate = cct->_conf->bluestore_txc_timeline_sample_rate;
+    if (sample_rate && ++txc_timeline_seq % sample_rate == 0) {
+        txc->state_lat.resize(l_bluestore_state_deferred_cleanup_lat -
+                              l_bluestore_state_prepare_lat + 1);
+    }
 
 #ifdef WITH_BLKIN
     if (osd_op && osd_op->pg_trace) {
@@ -12852,6 +13571,9 @@ void BlueStore::_txc_state_proc(TransContext *txc)
                     } else if (txc->osr->txc_with_unstable_io) {
                         dout(20) << __func__ << " prior txc(s) with unstable ios "
                                  << txc->osr->txc_with_unstable_io.load() << dendl;
+                    } else if (alloc_journal_active && !txc->allocated.empty()) {
+                        dout(20) << __func__ << " allocations not journaled yet, submit via kv thread"
+                                 << dendl;
                     } else if (cct->_conf->bluestore_debug_randomize_serial_transaction &&
                                rand() % cct->_conf->bluestore_debug_randomize_serial_transaction
                                == 0) {
@@ -13049,6 +13771,8 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
                      << "~" << p.get_len() << std::dec << dendl;
             fm->release(p.get_start(), p.get_len(), t);
         }
+    } else if (alloc_journal_active && !txc->allocated.empty()) {
+        _alloc_journal_log(txc->allocated, false);
     }
 
 #ifdef HAVE_LIBZBD
@@ -13216,6 +13940,9 @@ void BlueStore::_txc_finish(TransContext *txc)
         releasing_txc.pop_front();
         throttle.log_state_latency(*txc, logger, l_bluestore_state_done_lat);
         throttle.complete(*txc);
+        if (!txc->state_lat.empty()) {
+            _txc_record_timeline(txc);
+        }
         delete txc;
     }
 
@@ -13236,6 +13963,64 @@ void BlueStore::_txc_finish(TransContext *txc)
     }
 }
 
+void BlueStore::_txc_record_timeline(TransContext *txc)
+{
+    txc_timeline_t tl;
+    tl.seq = txc->seq;
+    tl.cid = txc->osr->cid;
+    tl.bytes = txc->bytes;
+    tl.ios = txc->ios;
+    tl.total = txc->last_stamp - txc->start;
+    tl.state_lat.swap(txc->state_lat);
+
+    std::lock_guard l(txc_timeline_lock);
+    size_t size = cct->_conf->bluestore_txc_timeline_size;
+    if (txc_timelines.capacity() != size) {
+        txc_timelines.set_capacity(size);
+    }
+    txc_timelines.push_back(std::move(tl));
+}
+
+void BlueStore::dump_slowest_txcs(Formatter *f, size_t count)
+{
+    static const char *state_names[] = {
+        "prepare", "aio_wait", "io_done", "kv_queued", "kv_committing",
+        "kv_done", "finishing", "done", "deferred_queued",
+        "deferred_aio_wait", "deferred_cleanup",
+    };
+    std::vector<txc_timeline_t> slowest;
+    {
+        std::lock_guard l(txc_timeline_lock);
+        slowest.assign(txc_timelines.begin(), txc_timelines.end());
+    }
+    count = std::min(count, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+    [](const txc_timeline_t &a, const txc_timeline_t &b) {
+        return a.total > b.total;
+    });
+
+    f->open_array_section("txcs");
+    for (size_t i = 0; i < count; ++i) {
+        auto &tl = slowest[i];
+        f->open_object_section("txc");
+        f->dump_unsigned("seq", tl.seq);
+        f->dump_stream("cid") << tl.cid;
+        f->dump_unsigned("bytes", tl.bytes);
+        f->dump_unsigned("ios", tl.ios);
+        f->dump_float("lat", ceph::to_seconds<double>(tl.total));
+        f->open_object_section("state_lat");
+        for (size_t s = 0; s < tl.state_lat.size(); ++s) {
+            if (tl.state_lat[s] != ceph::timespan::zero()) {
+                f->dump_float(state_names[s],
+                              ceph::to_seconds<double>(tl.state_lat[s]));
+            }
+        }
+        f->close_section();
+        f->close_section();
+    }
+    f->close_section();
+}
+
 void BlueStore::_txc_release_alloc(TransContext *txc)
 {
     bool discard_queued = false;
@@ -13413,7 +14198,16 @@ void BlueStore::_kv_start()
     dout(10) << __func__ << dendl;
 
     finisher.start();
+    kv_sync_pipeline = cct->_conf->bluestore_kv_sync_pipeline;
     kv_sync_thread.create("bstore_kv_sync");
+    if (kv_sync_pipeline) {
+        kv_commit_thread.create("bstore_kv_commit");
+    }
+    ceph_assert(kv_finalize_shards.empty());
+    for (uint64_t i = 1; i < cct->_conf->bluestore_kv_finalize_threads; ++i) {
+        kv_finalize_shards.emplace_back(new KVFinalizeShard(this));
+        kv_finalize_shards.back()->create("bstore_kv_final");
+    }
     kv_finalize_thread.create("bstore_kv_final");
 }
 
@@ -13436,12 +14230,40 @@ void BlueStore::_kv_stop()
         kv_finalize_stop = true;
         kv_finalize_cond.notify_all();
     }
+    if (kv_sync_pipeline) {
+        std::unique_lock l{kv_lock};
+        while (!kv_commit_started) {
+            kv_commit_cond.wait(l);
+        }
+        kv_commit_stop = true;
+        kv_commit_cond.notify_all();
+    }
     kv_sync_thread.join();
+    if (kv_sync_pipeline) {
+        kv_commit_thread.join();
+    }
     kv_finalize_thread.join();
+    if (!kv_finalize_shards.empty()) {
+        for (auto &shard : kv_finalize_shards) {
+            {
+                std::unique_lock l{shard->lock};
+                while (!shard->started) {
+                    shard->cond.wait(l);
+                }
+                shard->stop = true;
+                shard->cond.notify_all();
+            }
+            shard->join();
+        }
+        kv_finalize_shards.clear();
+        // shards may have retired txcs after the last reap
+        _reap_collections();
+    }
     ceph_assert(removed_collections.empty());
     {
         std::lock_guard l(kv_lock);
         kv_stop = false;
+        kv_commit_stop = false;
     }
     {
         std::lock_guard l(kv_finalize_lock);
@@ -13456,7 +14278,6 @@ void BlueStore::_kv_stop()
 void BlueStore::_kv_sync_thread()
 {
     dout(10) << __func__ << " start" << dendl;
-    deque<DeferredBatch *> deferred_stable_queue; ///< deferred ios done + stable
     std::unique_lock l{kv_lock};
     ceph_assert(!kv_sync_started);
     kv_sync_started = true;
@@ -13587,6 +14408,12 @@ void BlueStore::_kv_sync_thread()
                 dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
             }
 
+            if (alloc_journal_active) {
+                // allocations must be on disk before any kv transaction
+                // referring to them is submitted
+                _alloc_journal_flush();
+            }
+
             for (auto txc : kv_committing) {
                 throttle.log_state_latency(*txc, logger, l_bluestore_state_kv_queued_lat);
                 if (txc->get_state() == TransContext::STATE_KV_QUEUED) {
@@ -13620,109 +14447,209 @@ void BlueStore::_kv_sync_thread()
                 }
             }
 
+            KVSyncBatch b;
+            b.synct = synct;
+            b.committing.swap(kv_committing);
+            b.deferred_stable.swap(deferred_stable);
+            b.deferred_done.swap(deferred_done);
+            b.new_nid_max = new_nid_max;
+            b.new_blobid_max = new_blobid_max;
+            b.start = start;
+            b.after_flush = after_flush;
+
+            if (!kv_sync_pipeline) {
+                _kv_sync_commit(b);
+                l.lock();
+                // previously deferred "done" are now "stable" by virtue of this
+                // commit cycle.
+                deferred_stable_queue.swap(b.deferred_done);
+            } else {
+                // hand the batch over to the commit thread and go on applying
+                // the next one while this one syncs; keep at most one batch
+                // waiting behind the one being synced
+                l.lock();
+                while (!kv_commit_queue.empty()) {
+                    kv_commit_cond.wait(l);
+                }
+                kv_commit_queue.push_back(std::move(b));
+                kv_commit_cond.notify_all();
+            }
+        }
+    }
+    dout(10) << __func__ << " finish" << dendl;
+    kv_sync_started = false;
+    kv_commit_cond.notify_all();
+}
+
+void BlueStore::_kv_sync_commit(KVSyncBatch &b)
+{
 #if defined(WITH_LTTNG)
-            auto sync_start = mono_clock::now();
+    auto sync_start = mono_clock::now();
 #endif
-            // submit synct synchronously (block and wait for it to commit)
-            int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
-            ceph_assert(r == 0);
+    // submit synct synchronously (block and wait for it to commit)
+    int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(b.synct);
+    ceph_assert(r == 0);
 
-#ifdef WITH_BLKIN
-            for (auto txc : kv_committing) {
-                if (txc->trace) {
-                    txc->trace.event("db sync submit");
-                    txc->trace.keyval("kv_committing size", kv_committing.size());
-                }
+    if (alloc_journal_active) {
+        // log releases before finalize hands them back to the allocator; they
+        // go out with the next record
+        for (auto txc : b.committing) {
+            if (!txc->released.empty()) {
+                _alloc_journal_log(txc->released, true);
             }
+        }
+    }
+
+#ifdef WITH_BLKIN
+    for (auto txc : b.committing) {
+        if (txc->trace) {
+            txc->trace.event("db sync submit");
+            txc->trace.keyval("kv_committing size", b.committing.size());
+        }
+    }
 #endif
 
-            int committing_size = kv_committing.size();
-            int deferred_size = deferred_stable.size();
+    int committing_size = b.committing.size();
+    int deferred_size = b.deferred_stable.size();
 
 #if defined(WITH_LTTNG)
-            double sync_latency = ceph::to_seconds<double>(mono_clock::now() - sync_start);
-            for (auto txc : kv_committing) {
-                if (txc->tracing) {
-                    tracepoint(
-                        bluestore,
-                        transaction_kv_sync_latency,
-                        txc->osr->get_sequencer_id(),
-                        txc->seq,
-                        kv_committing.size(),
-                        deferred_done.size(),
-                        deferred_stable.size(),
-                        sync_latency);
-                }
-            }
+    double sync_latency = ceph::to_seconds<double>(mono_clock::now() - sync_start);
+    for (auto txc : b.committing) {
+        if (txc->tracing) {
+            tracepoint(
+                bluestore,
+                transaction_kv_sync_latency,
+                txc->osr->get_sequencer_id(),
+                txc->seq,
+                b.committing.size(),
+                b.deferred_done.size(),
+                b.deferred_stable.size(),
+                sync_latency);
+        }
+    }
 #endif
 
-            {
-                std::unique_lock m{kv_finalize_lock};
-                if (kv_committing_to_finalize.empty()) {
-                    kv_committing_to_finalize.swap(kv_committing);
-                } else {
-                    kv_committing_to_finalize.insert(
-                                                 kv_committing_to_finalize.end(),
-                                                 kv_committing.begin(),
-                                                 kv_committing.end());
-                    kv_committing.clear();
-                }
-                if (deferred_stable_to_finalize.empty()) {
-                    deferred_stable_to_finalize.swap(deferred_stable);
-                } else {
-                    deferred_stable_to_finalize.insert(
-                                                   deferred_stable_to_finalize.end(),
-                                                   deferred_stable.begin(),
-                                                   deferred_stable.end());
-                    deferred_stable.clear();
-                }
-                if (!kv_finalize_in_progress) {
-                    kv_finalize_in_progress = true;
-                    kv_finalize_cond.notify_one();
-                }
-            }
+    {
+        std::unique_lock m{kv_finalize_lock};
+        if (kv_committing_to_finalize.empty()) {
+            kv_committing_to_finalize.swap(b.committing);
+        } else {
+            kv_committing_to_finalize.insert(
+                                         kv_committing_to_finalize.end(),
+                                         b.committing.begin(),
+                                         b.committing.end());
+            b.committing.clear();
+        }
+        if (deferred_stable_to_finalize.empty()) {
+            deferred_stable_to_finalize.swap(b.deferred_stable);
+        } else {
+            deferred_stable_to_finalize.insert(
+                                           deferred_stable_to_finalize.end(),
+                                           b.deferred_stable.begin(),
+                                           b.deferred_stable.end());
+            b.deferred_stable.clear();
+        }
+        if (!kv_finalize_in_progress) {
+            kv_finalize_in_progress = true;
+            kv_finalize_cond.notify_one();
+        }
+    }
 
-            if (new_nid_max) {
-                nid_max = new_nid_max;
-                dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-            }
-            if (new_blobid_max) {
-                blobid_max = new_blobid_max;
-                dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
-            }
+    if (b.new_nid_max) {
+        nid_max = b.new_nid_max;
+        dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+    }
+    if (b.new_blobid_max) {
+        blobid_max = b.new_blobid_max;
+        dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+    }
 
-            {
-                auto finish = mono_clock::now();
-                ceph::timespan dur_flush = after_flush - start;
-                ceph::timespan dur_kv = finish - after_flush;
-                ceph::timespan dur = finish - start;
-                dout(20) << __func__ << " committed " << committing_size
-                         << " cleaned " << deferred_size
-                         << " in " << dur
-                         << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
-                         << dendl;
-                log_latency("kv_flush",
-                            l_bluestore_kv_flush_lat,
-                            dur_flush,
-                            cct->_conf->bluestore_log_op_age);
-                log_latency("kv_commit",
-                            l_bluestore_kv_commit_lat,
-                            dur_kv,
-                            cct->_conf->bluestore_log_op_age);
-                log_latency("kv_sync",
-                            l_bluestore_kv_sync_lat,
-                            dur,
-                            cct->_conf->bluestore_log_op_age);
+    {
+        auto finish = mono_clock::now();
+        ceph::timespan dur_flush = b.after_flush - b.start;
+        ceph::timespan dur_kv = finish - b.after_flush;
+        ceph::timespan dur = finish - b.start;
+        dout(20) << __func__ << " committed " << committing_size
+                 << " cleaned " << deferred_size
+                 << " in " << dur
+                 << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+                 << dendl;
+        log_latency("kv_flush",
+                    l_bluestore_kv_flush_lat,
+                    dur_flush,
+                    cct->_conf->bluestore_log_op_age);
+        log_latency("kv_commit",
+                    l_bluestore_kv_commit_lat,
+                    dur_kv,
+                    cct->_conf->bluestore_log_op_age);
+        log_latency("kv_sync",
+                    l_bluestore_kv_sync_lat,
+                    dur,
+                    cct->_conf->bluestore_log_op_age);
+    }
+}
+
+void BlueStore::_kv_commit_thread()
+{
+    dout(10) << __func__ << " start" << dendl;
+    std::unique_lock l{kv_lock};
+    ceph_assert(!kv_commit_started);
+    kv_commit_started = true;
+    kv_commit_cond.notify_all();
+    while (true) {
+        if (kv_commit_queue.empty()) {
+            // the sync thread is the only producer, drain it before leaving
+            if (kv_commit_stop && !kv_sync_started) {
+                break;
             }
+            dout(20) << __func__ << " sleep" << dendl;
+            kv_commit_cond.wait(l);
+            dout(20) << __func__ << " wake" << dendl;
+        } else {
+            KVSyncBatch b = std::move(kv_commit_queue.front());
+            kv_commit_queue.pop_front();
+            kv_commit_cond.notify_all();
+            l.unlock();
+
+            _kv_sync_commit(b);
 
             l.lock();
             // previously deferred "done" are now "stable" by virtue of this
             // commit cycle.
-            deferred_stable_queue.swap(deferred_done);
+            deferred_stable_queue.insert(deferred_stable_queue.end(),
+                                         b.deferred_done.begin(),
+                                         b.deferred_done.end());
+            if (!b.deferred_done.empty() && deferred_aggressive &&
+                !kv_sync_in_progress) {
+                kv_sync_in_progress = true;
+                kv_cond.notify_one();
+            }
         }
     }
     dout(10) << __func__ << " finish" << dendl;
-    kv_sync_started = false;
+    kv_commit_started = false;
+}
+
+void BlueStore::_kv_finalize_txcs(deque<TransContext *> &kv_committed,
+                                  deque<DeferredBatch *> &deferred_stable)
+{
+    while (!kv_committed.empty()) {
+        TransContext *txc = kv_committed.front();
+        ceph_assert(txc->get_state() == TransContext::STATE_KV_SUBMITTED);
+        _txc_state_proc(txc);
+        kv_committed.pop_front();
+    }
+
+    for (auto b : deferred_stable) {
+        auto p = b->txcs.begin();
+        while (p != b->txcs.end()) {
+            TransContext *txc = &*p;
+            p = b->txcs.erase(p); // unlink here because
+            _txc_state_proc(txc); // this may destroy txc
+        }
+        delete b;
+    }
+    deferred_stable.clear();
 }
 
 void BlueStore::_kv_finalize_thread()
@@ -13755,23 +14682,44 @@ void BlueStore::_kv_finalize_thread()
 
             auto start = mono_clock::now();
 
-            while (!kv_committed.empty()) {
-                TransContext *txc = kv_committed.front();
-                ceph_assert(txc->get_state() == TransContext::STATE_KV_SUBMITTED);
-                _txc_state_proc(txc);
-                kv_committed.pop_front();
-            }
-
-            for (auto b : deferred_stable) {
-                auto p = b->txcs.begin();
-                while (p != b->txcs.end()) {
-                    TransContext *txc = &*p;
-                    p = b->txcs.erase(p); // unlink here because
-                    _txc_state_proc(txc); // this may destroy txc
+            if (!kv_finalize_shards.empty()) {
+                // hand off everything not owned by shard 0 (us).  all txcs
+                // and deferred batches of one osr land on the same shard, in
+                // commit order, so per-sequencer completion order holds.
+                size_t n = kv_finalize_shards.size() + 1;
+                auto shard_of = [&](OpSequencer *osr) {
+                    size_t idx = osr->get_sequencer_id() % n;
+                    return idx == 0 ? nullptr : kv_finalize_shards[idx - 1].get();
+                };
+                deque<TransContext *> committed_mine;
+                deque<DeferredBatch *> stable_mine;
+                for (auto txc : kv_committed) {
+                    auto shard = shard_of(txc->osr.get());
+                    if (!shard) {
+                        committed_mine.push_back(txc);
+                        continue;
+                    }
+                    std::lock_guard sl(shard->lock);
+                    shard->committed.push_back(txc);
+                }
+                for (auto b : deferred_stable) {
+                    auto shard = shard_of(b->osr);
+                    if (!shard) {
+                        stable_mine.push_back(b);
+                        continue;
+                    }
+                    std::lock_guard sl(shard->lock);
+                    shard->stable.push_back(b);
+                }
+                for (size_t i = 0; i < n - 1; ++i) {
+                    std::lock_guard sl(kv_finalize_shards[i]->lock);
+                    kv_finalize_shards[i]->cond.notify_all();
                 }
-                delete b;
+                kv_committed.swap(committed_mine);
+                deferred_stable.swap(stable_mine);
             }
-            deferred_stable.clear();
+
+            _kv_finalize_txcs(kv_committed, deferred_stable);
 
             if (!deferred_aggressive) {
                 if (deferred_queue_size >= deferred_batch_ops.load() ||
@@ -13798,6 +14746,32 @@ void BlueStore::_kv_finalize_thread()
     kv_finalize_started = false;
 }
 
+void BlueStore::_kv_finalize_shard_thread(KVFinalizeShard *shard)
+{
+    deque<TransContext *> kv_committed;
+    deque<DeferredBatch *> deferred_stable;
+    dout(10) << __func__ << " start" << dendl;
+    std::unique_lock l(shard->lock);
+    shard->started = true;
+    shard->cond.notify_all();
+    while (true) {
+        if (shard->committed.empty() && shard->stable.empty()) {
+            if (shard->stop) {
+                break;
+            }
+            shard->cond.wait(l);
+        } else {
+            kv_committed.swap(shard->committed);
+            deferred_stable.swap(shard->stable);
+            l.unlock();
+            _kv_finalize_txcs(kv_committed, deferred_stable);
+            l.lock();
+        }
+    }
+    dout(10) << __func__ << " finish" << dendl;
+    shard->started = false;
+}
+
 #ifdef HAVE_LIBZBD
 void BlueStore::_zoned_cleaner_start()
 {
@@ -14116,7 +15090,10 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     for (auto &txc : b->txcs) {
         throttle.log_state_latency(txc, logger, l_bluestore_state_deferred_queued_lat);
     }
-    uint64_t start = 0, pos = 0;
+    // iomap is ordered by disk offset and already free of overlaps, so a
+    // single ascending pass coalesces extents of all txcs in the batch that
+    // abut each other into one aio.
+    uint64_t start = 0, pos = 0, writes = 0;
     bufferlist bl;
     auto i = b->iomap.begin();
     while (true) {
@@ -14125,6 +15102,7 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
                 dout(20) << __func__ << " write 0x" << std::hex
                          << start << "~" << bl.length()
                          << " crc " << bl.crc32c(-1) << std::dec << dendl;
+                ++writes;
                 if (!g_conf()->bluestore_debug_omit_block_device_write) {
                     logger->inc(l_bluestore_submitted_deferred_writes);
                     logger->inc(l_bluestore_submitted_deferred_write_bytes, bl.length());
@@ -14149,6 +15127,12 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
         bl.claim_append(i->second.bl);
         ++i;
     }
+    dout(20) << __func__ << " " << b->queued_ios << " extents -> "
+             << writes << " writes, 0x" << std::hex << b->overwritten_bytes
+             << std::dec << " bytes overwritten" << dendl;
+    ceph_assert(b->queued_ios >= writes);
+    logger->inc(l_bluestore_deferred_write_merged_ios, b->queued_ios - writes);
+    logger->inc(l_bluestore_deferred_write_merged_bytes, b->overwritten_bytes);
 
     bdev->aio_submit(&b->ioc);
 }
@@ -14499,6 +15483,42 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 
     vector<OnodeRef> ovec(i.objects.size());
 
+    // the common case is a single collection; fetch the onodes of all the
+    // objects at once rather than one kv lookup per object.  Objects first
+    // created or touched are mostly new ones, leave them out of the batch.
+    if (cvec.size() == 1 && cvec[0] && i.objects.size() > 1) {
+        std::vector<bool> seen(i.objects.size());
+        std::vector<const ghobject_t *> to_preload;
+        for (auto p = t->begin(); p.have_op(); ) {
+            Transaction::Op *op = p.decode_op();
+            switch (op->op) {
+                case Transaction::OP_NOP:
+                case Transaction::OP_RMCOLL:
+                case Transaction::OP_MKCOLL:
+                case Transaction::OP_SPLIT_COLLECTION:
+                case Transaction::OP_SPLIT_COLLECTION2:
+                case Transaction::OP_MERGE_COLLECTION:
+                case Transaction::OP_COLL_HINT:
+                case Transaction::OP_COLL_SETATTR:
+                case Transaction::OP_COLL_RMATTR:
+                case Transaction::OP_COLL_SETATTRS:
+                case Transaction::OP_COLL_RENAME:
+                    continue; // no object
+            }
+            if (op->oid >= seen.size() || seen[op->oid]) {
+                continue;
+            }
+            seen[op->oid] = true;
+            if (op->op != Transaction::OP_CREATE && op->op != Transaction::OP_TOUCH) {
+                to_preload.push_back(&i.objects[op->oid]);
+            }
+        }
+        if (to_preload.size() > 1) {
+            std::unique_lock l(cvec[0]->lock);
+            cvec[0]->preload_onodes(to_preload);
+        }
+    }
+
     for (int pos = 0; i.have_op(); ++pos) {
         Transaction::Op *op = i.decode_op();
         int r = 0;
@@ -15756,6 +16776,12 @@ int BlueStore::_do_alloc_write(
     // We assume that allocator does its best to provide contiguous space,
     // and the condition is : (data_size < deferred).
 
+    // a dictionary trained for the pool, only zstd has them
+    Compressor::DictionaryRef cdict;
+    if (c && c->get_type() == Compressor::COMP_ALG_ZSTD) {
+        cdict = _get_compression_dict(coll->pool());
+    }
+
     auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
     for (auto &wi : wctx->writes) {
         if (c && wi.blob_length > min_alloc_size) {
@@ -15768,7 +16794,7 @@ int BlueStore::_do_alloc_write(
             // FIXME: memory alignment here is bad
             bufferlist t;
             std::optional<int32_t> compressor_message;
-            int r = c->compress(wi.bl, t, compressor_message);
+            int r = c->compress(wi.bl, t, compressor_message, cdict.get());
             uint64_t want_len_raw = wi.blob_length * crr;
             uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
             bool rejected = false;
@@ -15781,6 +16807,7 @@ int BlueStore::_do_alloc_write(
                 chdr.type = c->get_type();
                 chdr.length = t.length();
                 chdr.compressor_message = compressor_message;
+                chdr.set_dict(cdict ? cdict->get_id() : 0);
                 encode(chdr, wi.compressed_bl);
                 wi.compressed_bl.claim_append(t);
 
@@ -15801,6 +16828,9 @@ int BlueStore::_do_alloc_write(
                     txc->statfs_delta.compressed_original() += wi.blob_length;
                     txc->statfs_delta.compressed_allocated() += result_len;
                     logger->inc(l_bluestore_compress_success_count);
+                    if (chdr.dict_id) {
+                        logger->inc(l_bluestore_compress_dict_count);
+                    }
                     need += result_len;
                     data_size += result_len;
                 } else {
@@ -16035,6 +17065,16 @@ void BlueStore::_wctx_finish(
     set<uint32_t> zones_with_releases;
 #endif
 
+    {
+        std::vector<SharedBlobRef> sbs;
+        for (auto &lo : wctx->old_extents) {
+            if (!lo.r.empty() && lo.e.blob->get_blob().is_shared()) {
+                sbs.push_back(lo.e.blob->shared_blob);
+            }
+        }
+        c->load_shared_blobs(sbs);
+    }
+
     auto oep = wctx->old_extents.begin();
     while (oep != wctx->old_extents.end()) {
         auto &lo = *oep;
@@ -17610,6 +18650,15 @@ mono_clock::duration BlueStore::BlueStoreThrottle::log_state_latency(
     mono_clock::time_point now = mono_clock::now();
     mono_clock::duration lat = now - txc.last_stamp;
     logger->tinc(state, lat);
+    if (state >= l_bluestore_state_prepare_lat &&
+        state <= l_bluestore_state_deferred_cleanup_lat) {
+        int i = state - l_bluestore_state_prepare_lat;
+        logger->hinc(l_bluestore_state_prepare_lat_hist + i,
+                     lat.count(), txc.bytes);
+        if (!txc.state_lat.empty()) {
+            txc.state_lat[i] += lat;
+        }
+    }
 #if defined(WITH_LTTNG)
     if (txc.tracing &&
         state >= l_bluestore_state_prepare_lat &&
@@ -18457,8 +19506,13 @@ bool RocksDBBlueFSVolumeSelector::compare(BlueFSVolumeSelector *other)
 
 static const std::string allocator_dir    = "ALLOCATOR_NCB_DIR";
 static const std::string allocator_file   = "ALLOCATOR_NCB_FILE";
+static const std::string allocator_tmp_file = "ALLOCATOR_NCB_FILE.tmp";
+// the journal extending checkpoint N lives in allocator_journal_file[N % 2]
+static const std::string allocator_journal_file[2] = {
+    "ALLOCATOR_NCB_JOURNAL.0",
+    "ALLOCATOR_NCB_JOURNAL.1"
+};
 static uint32_t    s_format_version = 0x01; // support future changes to allocator-map file
-static uint32_t    s_serial         = 0x01;
 
 #if 1
 #define CEPHTOH_32 le32toh
@@ -18781,7 +19835,6 @@ int BlueStore::store_allocator(Allocator *src_allocator)
     // when storing allocations to file we must be sure there is no background compactions
     // the easiest way to achieve it is to make sure db is closed
     ceph_assert(db == nullptr);
-    utime_t  start_time = ceph_clock_now();
     int ret = 0;
 
     // create dir if doesn't exist already
@@ -18793,11 +19846,22 @@ int BlueStore::store_allocator(Allocator *src_allocator)
         }
     }
     bluefs->compact_log();
+    ret = __store_allocator(src_allocator, allocator_file, alloc_file_serial);
+    if (ret == 0) {
+        need_to_destage_allocation_file = false;
+    }
+    return ret;
+}
+
+//-----------------------------------------------------------------------------------
+int BlueStore::__store_allocator(Allocator *src_allocator, const std::string &file, uint32_t serial)
+{
+    utime_t  start_time = ceph_clock_now();
     // reuse previous file-allocation if exists
-    ret = bluefs->stat(allocator_dir, allocator_file, nullptr, nullptr);
+    int ret = bluefs->stat(allocator_dir, file, nullptr, nullptr);
     bool overwrite_file = (ret == 0);
     BlueFS::FileWriter *p_handle = nullptr;
-    ret = bluefs->open_for_write(allocator_dir, allocator_file, &p_handle, overwrite_file);
+    ret = bluefs->open_for_write(allocator_dir, file, &p_handle, overwrite_file);
     if (ret != 0) {
         derr <<  __func__ << "Failed open_for_write with error-code " << ret << dendl;
         return -1;
@@ -18818,7 +19882,7 @@ int BlueStore::store_allocator(Allocator *src_allocator)
     utime_t                 timestamp = ceph_clock_now();
     uint32_t                crc       = -1;
     {
-        allocator_image_header  header(timestamp, s_format_version, s_serial);
+        allocator_image_header  header(timestamp, s_format_version, serial);
         bufferlist              header_bl;
         encode(header, header_bl);
         crc = header_bl.crc32c(crc);
@@ -18865,7 +19929,7 @@ int BlueStore::store_allocator(Allocator *src_allocator)
     }
 
     {
-        allocator_image_trailer trailer(timestamp, s_format_version, s_serial, extent_count, allocation_size);
+        allocator_image_trailer trailer(timestamp, s_format_version, serial, extent_count, allocation_size);
         bufferlist trailer_bl;
         encode(trailer, trailer_bl);
         uint32_t crc = -1;
@@ -18879,12 +19943,11 @@ int BlueStore::store_allocator(Allocator *src_allocator)
     bluefs->fsync(p_handle);
 
     utime_t duration = ceph_clock_now() - start_time;
-    dout(5) << "WRITE-extent_count=" << extent_count << ", allocation_size=" << allocation_size << ", serial=" << s_serial
+    dout(5) << "WRITE-extent_count=" << extent_count << ", allocation_size=" << allocation_size << ", serial=" << serial
             << dendl;
     dout(5) << "p_handle->pos=" << p_handle->pos << " WRITE-duration=" << duration << " seconds" << dendl;
 
     bluefs->close_writer(p_handle);
-    need_to_destage_allocation_file = false;
     return 0;
 }
 
@@ -18908,7 +19971,7 @@ Allocator *BlueStore::create_bitmap_allocator(uint64_t bdev_size)
 size_t calc_allocator_image_header_size()
 {
     utime_t                 timestamp = ceph_clock_now();
-    allocator_image_header  header(timestamp, s_format_version, s_serial);
+    allocator_image_header  header(timestamp, s_format_version, 0);
     bufferlist              header_bl;
     encode(header, header_bl);
     uint32_t crc = -1;
@@ -18926,7 +19989,7 @@ int calc_allocator_image_trailer_size()
     uint64_t                allocation_size = -1;
     uint32_t                crc             = -1;
     bufferlist              trailer_bl;
-    allocator_image_trailer trailer(timestamp, s_format_version, s_serial, extent_count, allocation_size);
+    allocator_image_trailer trailer(timestamp, s_format_version, 0, extent_count, allocation_size);
 
     encode(trailer, trailer_bl);
     crc = trailer_bl.crc32c(crc);
@@ -18995,7 +20058,7 @@ int BlueStore::__restore_allocator(Allocator *allocator, uint64_t *num, uint64_t
         }
 
         // increment version for next store
-        s_serial = header.serial + 1;
+        alloc_file_serial = header.serial + 1;
     }
 
     // then read the payload (extents list) using a recycled buffer
@@ -19097,19 +20160,382 @@ int BlueStore::restore_allocator(Allocator *dest_allocator, uint64_t *num, uint6
 {
     utime_t    start = ceph_clock_now();
     auto temp_allocator = unique_ptr<Allocator>(create_bitmap_allocator(bdev->get_size()));
+    alloc_journal_need_checkpoint = true;
     int ret = __restore_allocator(temp_allocator.get(), num, bytes);
     if (ret != 0) {
         return ret;
     }
 
+    // replay whatever was journaled after the checkpoint was taken; a
+    // checkpoint in progress at the time of a crash leaves a second journal
+    interval_set<uint64_t> allocated, released;
+    uint64_t records = 0;
+    uint64_t base = alloc_file_serial - 1;
+    for (uint64_t b = base; b <= base + 1; b++) {
+        uint64_t n = 0;
+        _alloc_journal_replay(b, &allocated, &released, &n);
+        if (n) {
+            records += n;
+            alloc_file_serial = b + 1;
+        }
+    }
+    alloc_journal_need_checkpoint = (records > 0);
+    logger->inc(l_bluestore_alloc_journal_replayed, records);
+
+    // BlueFS allocates from the shared device without journaling, and the
+    // checkpoint may have been taken while running, so whatever BlueFS owns
+    // now must not come back as free.  Extents BlueFS released since then
+    // stay allocated, which fsck repairs as a leak.
+    interval_set<uint64_t> bluefs_used;
+    if (bluefs) {
+        bluefs->foreach_block_extents(
+            bluefs_layout.shared_bdev,
+            [&](uint64_t start, uint32_t len) {
+                bluefs_used.union_insert(start, len);
+            });
+    }
+
     uint64_t num_entries = 0;
-    dout(5) << " calling copy_allocator(bitmap_allocator -> shared_alloc.a)" << dendl;
-    copy_allocator(temp_allocator.get(), dest_allocator, &num_entries);
+    if (records == 0 && bluefs_used.empty()) {
+        dout(5) << " calling copy_allocator(bitmap_allocator -> shared_alloc.a)" << dendl;
+        copy_allocator(temp_allocator.get(), dest_allocator, &num_entries);
+    } else {
+        interval_set<uint64_t> free, overlap;
+        temp_allocator->foreach([&](uint64_t offset, uint64_t length) {
+            free.insert(offset, length);
+        });
+        free.union_of(released);
+        overlap.intersection_of(free, allocated);
+        free.subtract(overlap);
+        overlap.clear();
+        overlap.intersection_of(free, bluefs_used);
+        free.subtract(overlap);
+
+        *num = 0;
+        *bytes = 0;
+        for (auto p = free.begin(); p != free.end(); ++p) {
+            dest_allocator->init_add_free(p.get_start(), p.get_len());
+            ++(*num);
+            *bytes += p.get_len();
+        }
+        num_entries = *num;
+        dout(5) << "replayed " << records << " journal records, allocated=" << allocated.size()
+                << ", released=" << released.size()
+                << ", bluefs extents=" << bluefs_used.num_intervals() << dendl;
+    }
     utime_t duration = ceph_clock_now() - start;
     dout(5) << "restored in " << duration << " seconds, num_entries=" << num_entries << dendl;
     return ret;
 }
 
+//-----------------------------------------------------------------------------------
+// Allocation journal
+//
+// Every kv sync cycle appends one record with the allocations made by the
+// transactions about to be submitted and the releases of the transactions
+// already committed.  The record is synced before any of those transactions
+// is submitted to the kv store, and a released extent goes back to the
+// allocator only after it has been logged, so replaying the records on top
+// of the last checkpoint never frees an extent that is still referenced.
+// At worst an extent allocated by a transaction that didn't commit stays
+// allocated, which fsck reports and repairs as a leak.
+//
+// The journal is overwritten in place once it wrapped, so records carry the
+// checkpoint serial they extend and a sequence number; replay stops at the
+// first record which doesn't follow.
+//
+// record: magic, count, base, seq, count x (offset | release flag, length), crc
+const uint32_t ALLOC_JOURNAL_RECORD_MAGIC = 0xA110C8ED;
+const uint64_t ALLOC_JOURNAL_RELEASE      = 0x1; // offsets are min_alloc_size aligned
+const size_t   ALLOC_JOURNAL_HEADER_SIZE  = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+const size_t   ALLOC_JOURNAL_ENTRY_SIZE   = 2 * sizeof(uint64_t);
+
+static void alloc_journal_apply(interval_set<uint64_t> &to, interval_set<uint64_t> &from,
+                                uint64_t offset, uint64_t length)
+{
+    interval_set<uint64_t> e, overlap;
+    e.insert(offset, length);
+    overlap.intersection_of(e, from);
+    from.subtract(overlap);
+    to.union_of(e);
+}
+
+//-----------------------------------------------------------------------------------
+int BlueStore::_alloc_journal_replay(uint64_t base,
+                                     interval_set<uint64_t> *allocated,
+                                     interval_set<uint64_t> *released,
+                                     uint64_t *records)
+{
+    const std::string &file = allocator_journal_file[base % 2];
+    BlueFS::FileReader *p_temp_handle = nullptr;
+    int ret = bluefs->open_for_read(allocator_dir, file, &p_temp_handle, false);
+    if (ret != 0) {
+        dout(10) << file << " doesn't exist" << dendl;
+        return 0;
+    }
+    unique_ptr<BlueFS::FileReader> p_handle(p_temp_handle);
+    uint64_t file_size = p_handle->file->fnode.size;
+    bufferlist bl;
+    int64_t read_bytes = bluefs->read(p_handle.get(), 0, file_size, &bl, nullptr);
+    if (read_bytes < 0 || uint64_t(read_bytes) != file_size) {
+        derr << "Failed bluefs->read() of " << file << "::read_bytes=" << read_bytes
+             << ", file_size=" << file_size << dendl;
+        return -1;
+    }
+
+    uint64_t seq = 0;
+    auto p = bl.cbegin();
+    while (p.get_remaining() >= ALLOC_JOURNAL_HEADER_SIZE) {
+        auto start = p;
+        uint32_t magic, count;
+        uint64_t record_base, record_seq;
+        decode(magic, p);
+        decode(count, p);
+        decode(record_base, p);
+        decode(record_seq, p);
+        if (magic != ALLOC_JOURNAL_RECORD_MAGIC || record_base != base || record_seq != seq ||
+            p.get_remaining() < uint64_t(count) * ALLOC_JOURNAL_ENTRY_SIZE + sizeof(uint32_t)) {
+            break;
+        }
+        auto entries = p;
+        p += count * ALLOC_JOURNAL_ENTRY_SIZE;
+        uint32_t crc_calc = start.crc32c(p.get_off() - start.get_off(), -1);
+        uint32_t crc;
+        decode(crc, p);
+        if (crc != crc_calc) {
+            dout(5) << file << " crc mismatch at seq " << seq << ", stop" << dendl;
+            break;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t offset, length;
+            decode(offset, entries);
+            decode(length, entries);
+            if (offset & ALLOC_JOURNAL_RELEASE) {
+                alloc_journal_apply(*released, *allocated, offset & ~ALLOC_JOURNAL_RELEASE, length);
+            } else {
+                alloc_journal_apply(*allocated, *released, offset, length);
+            }
+        }
+        ++seq;
+    }
+    dout(5) << file << " base=" << base << ", records=" << seq << dendl;
+    *records = seq;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------------
+int BlueStore::_alloc_journal_read_base(const std::string &file, uint64_t *base)
+{
+    BlueFS::FileReader *p_temp_handle = nullptr;
+    int ret = bluefs->open_for_read(allocator_dir, file, &p_temp_handle, false);
+    if (ret != 0) {
+        return ret;
+    }
+    unique_ptr<BlueFS::FileReader> p_handle(p_temp_handle);
+    bufferlist bl;
+    int64_t read_bytes = bluefs->read(p_handle.get(), 0, ALLOC_JOURNAL_HEADER_SIZE, &bl, nullptr);
+    if (read_bytes != (int64_t)ALLOC_JOURNAL_HEADER_SIZE) {
+        return -ENODATA;
+    }
+    uint32_t magic, count;
+    auto p = bl.cbegin();
+    decode(magic, p);
+    decode(count, p);
+    decode(*base, p);
+    return magic == ALLOC_JOURNAL_RECORD_MAGIC ? 0 : -ENODATA;
+}
+
+//-----------------------------------------------------------------------------------
+// switch the journal to the one extending checkpoint 'base'; the previous
+// user of that file extended checkpoint base - 2, so it is stale by now
+int BlueStore::_alloc_journal_open(uint64_t base)
+{
+    if (alloc_journal_writer) {
+        bluefs->close_writer(alloc_journal_writer);
+        alloc_journal_writer = nullptr;
+    }
+    const std::string &file = allocator_journal_file[base % 2];
+    // overwrite in place, so that syncing a record doesn't need a bluefs log
+    // update as long as it falls within the old file size
+    bool overwrite_file = bluefs->stat(allocator_dir, file, nullptr, nullptr) == 0;
+    int ret = bluefs->open_for_write(allocator_dir, file, &alloc_journal_writer, overwrite_file);
+    if (ret != 0) {
+        derr << "Failed open_for_write of " << file << " with error-code " << ret << dendl;
+        alloc_journal_writer = nullptr;
+        return ret;
+    }
+    alloc_journal_base = base;
+    alloc_journal_seq = 0;
+    dout(5) << file << " base=" << base << dendl;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------------
+// write the allocation map as checkpoint 'serial' next to the current one
+// and switch over atomically
+int BlueStore::_alloc_journal_write_checkpoint(uint32_t serial)
+{
+    int ret = __store_allocator(alloc, allocator_tmp_file, serial);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = bluefs->rename(allocator_dir, allocator_tmp_file, allocator_dir, allocator_file);
+    if (ret != 0) {
+        derr << "Failed rename with error-code " << ret << dendl;
+        return ret;
+    }
+    bluefs->sync_metadata(false);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------------
+int BlueStore::_alloc_journal_start()
+{
+    ceph_assert(!alloc_journal_writer);
+    // whatever happens, the map has to be stored on umount
+    need_to_destage_allocation_file = true;
+    if (!bluefs->dir_exists(allocator_dir)) {
+        int ret = bluefs->mkdir(allocator_dir);
+        if (ret != 0) {
+            derr << "Failed mkdir with error-code " << ret << dendl;
+            return invalidate_allocation_file_on_bluefs();
+        }
+    }
+
+    int ret = 0;
+    if (alloc_journal_need_checkpoint) {
+        // the checkpoint on disk (if any) doesn't describe the map we are
+        // starting with, replace it before any journal it depends on is
+        // reused; stay clear of serials the journals on disk still refer to
+        for (auto &file : allocator_journal_file) {
+            uint64_t base;
+            if (_alloc_journal_read_base(file, &base) == 0 && base >= alloc_file_serial) {
+                alloc_file_serial = base + 1;
+            }
+        }
+        ret = _alloc_journal_write_checkpoint(alloc_file_serial);
+        if (ret == 0) {
+            alloc_file_serial++;
+        }
+    }
+    if (ret == 0) {
+        ret = _alloc_journal_open(alloc_file_serial - 1);
+    }
+    if (ret != 0) {
+        derr << "failed to start the allocation journal, fall back to invalidating the allocation file" << dendl;
+        return invalidate_allocation_file_on_bluefs();
+    }
+    alloc_journal_need_checkpoint = false;
+    alloc_journal_active = true;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------------
+void BlueStore::_alloc_journal_stop()
+{
+    if (!alloc_journal_writer) {
+        return;
+    }
+    _alloc_journal_flush();
+    if (alloc_journal_checkpoint_thread.joinable()) {
+        alloc_journal_checkpoint_thread.join();
+    }
+    alloc_journal_active = false;
+    if (alloc_journal_writer) {
+        bluefs->close_writer(alloc_journal_writer);
+        alloc_journal_writer = nullptr;
+    }
+    std::lock_guard l(alloc_journal_lock);
+    alloc_journal_pending.clear();
+    alloc_journal_pending_count = 0;
+}
+
+//-----------------------------------------------------------------------------------
+void BlueStore::_alloc_journal_log(const interval_set<uint64_t> &extents, bool release)
+{
+    std::lock_guard l(alloc_journal_lock);
+    for (auto p = extents.begin(); p != extents.end(); ++p) {
+        ceph_assert((p.get_start() & ALLOC_JOURNAL_RELEASE) == 0);
+        encode(p.get_start() | (release ? ALLOC_JOURNAL_RELEASE : 0), alloc_journal_pending);
+        encode(p.get_len(), alloc_journal_pending);
+    }
+    alloc_journal_pending_count += extents.num_intervals();
+}
+
+//-----------------------------------------------------------------------------------
+void BlueStore::_alloc_journal_flush()
+{
+    bufferlist bl;
+    uint32_t count;
+    {
+        std::lock_guard l(alloc_journal_lock);
+        if (alloc_journal_pending_count == 0) {
+            return;
+        }
+        count = alloc_journal_pending_count;
+        encode(ALLOC_JOURNAL_RECORD_MAGIC, bl);
+        encode(count, bl);
+        encode(alloc_journal_base, bl);
+        encode(alloc_journal_seq, bl);
+        bl.claim_append(alloc_journal_pending);
+        alloc_journal_pending_count = 0;
+    }
+    ceph_assert(bl.length() == ALLOC_JOURNAL_HEADER_SIZE + count * ALLOC_JOURNAL_ENTRY_SIZE);
+    uint32_t crc = bl.crc32c(-1);
+    encode(crc, bl);
+    alloc_journal_writer->append(bl);
+    bluefs->fsync(alloc_journal_writer);
+    alloc_journal_seq++;
+    logger->inc(l_bluestore_alloc_journal_records);
+    logger->inc(l_bluestore_alloc_journal_bytes, bl.length());
+
+    // the journal a running checkpoint replaces is still needed until it
+    // completes, so don't switch again before that
+    if (alloc_journal_writer->pos > cct->_conf->bluestore_allocation_journal_max_size &&
+        alloc_journal_active && !alloc_journal_checkpointing) {
+        _alloc_journal_checkpoint();
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// take a checkpoint while the store is running: new records go to the next
+// journal before the map is copied, so anything which changed since is
+// replayed on top of it; the journal the checkpoint replaces stays around
+// until the next checkpoint in case we crash in between.
+// Only the switch happens in the kv sync thread, copying the map and writing
+// the file is left to a background thread.
+void BlueStore::_alloc_journal_checkpoint()
+{
+    if (alloc_journal_checkpoint_thread.joinable()) {
+        alloc_journal_checkpoint_thread.join();
+    }
+    uint32_t serial = alloc_file_serial;
+    int ret = _alloc_journal_open(serial);
+    if (ret != 0) {
+        derr << "failed to switch the allocation journal, disabling it" << dendl;
+        alloc_journal_active = false;
+        invalidate_allocation_file_on_bluefs();
+        return;
+    }
+    alloc_file_serial = serial + 1;
+    alloc_journal_checkpointing = true;
+    alloc_journal_checkpoint_thread = make_named_thread("bstore_alloc_ckpt", [this, serial] {
+        utime_t start = ceph_clock_now();
+        int r = _alloc_journal_write_checkpoint(serial);
+        if (r != 0) {
+            derr << "allocation map checkpoint " << serial
+                 << " failed, disabling the allocation journal" << dendl;
+            alloc_journal_active = false;
+            invalidate_allocation_file_on_bluefs();
+        } else {
+            logger->inc(l_bluestore_alloc_journal_checkpoints);
+            dout(5) << "checkpoint " << serial << " done in " << (ceph_clock_now() - start)
+                    << " seconds" << dendl;
+        }
+        alloc_journal_checkpointing = false;
+    });
+}
+
 //-----------------------------------------------------------------------------------
 void BlueStore::set_allocation_in_simple_bmap(SimpleBitmap *sbmap, uint64_t offset, uint64_t length)
 {
@@ -19148,7 +20574,7 @@ void BlueStore::ExtentDecoderPartial::_consume_new_blob(bool spanning,
                 ++stats.skipped_illegal_extent;
                 continue;
             }
-            store.set_allocation_in_simple_bmap(&sbmap, pe.offset, pe.length);
+            _set_allocation(pe.offset, pe.length);
 
             per_pool_statfs->allocated() += pe.length;
             if (compressed) {
@@ -19168,6 +20594,10 @@ void BlueStore::ExtentDecoderPartial::_consume_new_blob(bool spanning,
         }
         auto &sbi = *it;
         auto pool_id = oid.hobj.get_logical_pool();
+        std::unique_lock<ceph::mutex> l;
+        if (sbmap_lock) {
+            l = std::unique_lock(*sbmap_lock);
+        }
         if (sbi.pool_id == sb_info_t::INVALID_POOL_ID) {
             sbi.pool_id = pool_id;
             size_t alloc_delta = sbi.allocated_chunks << min_alloc_size_order;
@@ -19184,6 +20614,32 @@ void BlueStore::ExtentDecoderPartial::_consume_new_blob(bool spanning,
     }
 }
 
+void BlueStore::ExtentDecoderPartial::_set_allocation(uint64_t offset,
+        uint64_t length)
+{
+    if (!sbmap_lock) {
+        store.set_allocation_in_simple_bmap(&sbmap, offset, length);
+        return;
+    }
+    pending_extents.emplace_back(offset, length);
+    if (pending_extents.size() >= MAX_PENDING_EXTENTS) {
+        flush();
+    }
+}
+
+void BlueStore::ExtentDecoderPartial::flush()
+{
+    if (pending_extents.empty()) {
+        return;
+    }
+    ceph_assert(sbmap_lock);
+    std::lock_guard l(*sbmap_lock);
+    for (auto &[offset, length] : pending_extents) {
+        store.set_allocation_in_simple_bmap(&sbmap, offset, length);
+    }
+    pending_extents.clear();
+}
+
 void BlueStore::ExtentDecoderPartial::consume_blobid(Extent *le,
         bool spanning,
         uint64_t blobid)
@@ -19270,7 +20726,87 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
         }
     }
 
-    it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
+    utime_t start = ceph_clock_now();
+    const size_t thread_count = cct->_conf->bluestore_allocation_recovery_threads;
+    if (thread_count <= 1) {
+        int r = read_allocation_from_onode_range(sbmap, sb_info, nullptr,
+                KeyValueDB::IteratorBounds(), stats);
+        if (r < 0) {
+            return r;
+        }
+    } else {
+        // Split the onode keyspace into ranges and let a pool of workers pull
+        // them one by one. The ranges are much more numerous than the workers
+        // so the load is balanced even if a few PGs hold most of the objects.
+        std::vector<KeyValueDB::IteratorBounds> ranges;
+        get_onode_key_ranges(&ranges);
+        dout(5) << __func__ << " scanning " << ranges.size()
+                << " onode key ranges with " << thread_count << " threads"
+                << dendl;
+
+        ceph::mutex sbmap_lock =
+            ceph::make_mutex("BlueStore::read_allocation_from_onodes::sbmap_lock");
+        std::atomic<size_t> next_range = {0};
+        std::atomic<int> ret = {0};
+        std::vector<read_alloc_stats_t> shard_stats(thread_count);
+        std::vector<std::thread> workers;
+        workers.reserve(thread_count);
+        for (size_t i = 0; i < thread_count; i++) {
+            workers.emplace_back(make_named_thread("bstore_alloc_rd", [&, i] {
+                for (size_t n = next_range++;
+                     n < ranges.size() && ret == 0;
+                     n = next_range++) {
+                    int r = read_allocation_from_onode_range(
+                                sbmap, sb_info, &sbmap_lock, ranges[n], shard_stats[i]);
+                    if (r < 0) {
+                        ret = r;
+                    }
+                }
+            }));
+        }
+        for (auto &t : workers) {
+            t.join();
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        for (auto &st : shard_stats) {
+            stats.merge(st);
+        }
+    }
+    logger->tinc(l_bluestore_alloc_recovery_lat, ceph_clock_now() - start);
+
+    std::lock_guard l(vstatfs_lock);
+    store_statfs_t s;
+    osd_pools.clear();
+    for (auto &p : stats.actual_pool_vstatfs) {
+        if (per_pool_stat_collection) {
+            osd_pools[p.first] = p.second;
+        }
+        stats.actual_store_vstatfs += p.second;
+        p.second.publish(&s);
+        dout(5) << __func__ << " recovered pool "
+                << std::hex
+                << p.first << "->" << s
+                << std::dec
+                << " per-pool:" << per_pool_stat_collection
+                << dendl;
+    }
+    vstatfs = stats.actual_store_vstatfs;
+    vstatfs.publish(&s);
+    dout(5) << __func__ << " recovered " << s
+            << dendl;
+    return 0;
+}
+
+int BlueStore::read_allocation_from_onode_range(
+    SimpleBitmap *sbmap,
+    sb_info_space_efficient_map_t &sb_info,
+    ceph::mutex *sbmap_lock,
+    const KeyValueDB::IteratorBounds &bounds,
+    read_alloc_stats_t &stats)
+{
+    auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE, bounds);
     if (!it) {
         derr << "failed getting onode's iterator" << dendl;
         return -ENOENT;
@@ -19278,20 +20814,32 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
 
     uint64_t            kv_count       = 0;
     uint64_t            count_interval = 1'000'000;
+    // progress is published in batches to keep the shared counter off
+    // the per-onode path when several ranges are scanned in parallel
+    uint64_t            unreported_onodes = 0;
+    uint64_t            report_interval   = 10'000;
     ExtentDecoderPartial edecoder(*this,
                                   stats,
                                   *sbmap,
                                   sb_info,
-                                  min_alloc_size_order);
+                                  min_alloc_size_order,
+                                  sbmap_lock);
 
     // iterate over all ONodes stored in RocksDB
-    for (it->lower_bound(string()); it->valid(); it->next(), kv_count++) {
+    for (it->lower_bound(bounds.lower_bound.value_or(string()));
+         it->valid();
+         it->next(), kv_count++) {
         // trace an even after every million processed objects (typically every 5-10 seconds)
         if (kv_count && (kv_count % count_interval == 0)) {
             dout(5) << __func__ << " processed objects count = " << kv_count << dendl;
         }
 
         auto key = it->key();
+        if (bounds.upper_bound && key >= *bounds.upper_bound) {
+            // the default column family iterator and the ones with
+            // osd_rocksdb_iterator_bounds_enabled off don't stop by themselves
+            break;
+        }
         auto okey = key;
         dout(20) << __func__ << " decode onode " << pretty_binary_string(key) << dendl;
         ghobject_t oid;
@@ -19309,6 +20857,10 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
                               it->value(),
                               edecoder);
             ++stats.onode_count;
+            if (++unreported_onodes >= report_interval) {
+                logger->inc(l_bluestore_alloc_recovery_onodes, unreported_onodes);
+                unreported_onodes = 0;
+            }
         } else {
             uint32_t offset;
             int r = get_key_extent_shard(key, &okey, &offset);
@@ -19330,28 +20882,38 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
             ++stats.shard_count;
         }
     }
+    edecoder.flush();
+    logger->inc(l_bluestore_alloc_recovery_onodes, unreported_onodes);
+    return 0;
+}
 
-    std::lock_guard l(vstatfs_lock);
-    store_statfs_t s;
-    osd_pools.clear();
-    for (auto &p : stats.actual_pool_vstatfs) {
-        if (per_pool_stat_collection) {
-            osd_pools[p.first] = p.second;
+// Build a list of key ranges covering the whole PREFIX_OBJ keyspace.
+// Collection boundaries are used as split points, so an onode and its
+// extent shards always land in the same range; the gaps between
+// collections are returned as ranges of their own to pick up any
+// orphaned objects as well.
+void BlueStore::get_onode_key_ranges(std::vector<KeyValueDB::IteratorBounds> *ranges)
+{
+    std::set<string> split_keys;
+    {
+        std::shared_lock l(coll_lock);
+        for (auto &[cid, c] : coll_map) {
+            ghobject_t temp_start, temp_end, start, end;
+            get_coll_range(cid, c->cnode.bits, &temp_start, &temp_end,
+                           &start, &end, false);
+            for (auto *o : {&temp_start, &temp_end, &start, &end}) {
+                string key;
+                get_object_key(cct, *o, &key);
+                split_keys.insert(key);
+            }
         }
-        stats.actual_store_vstatfs += p.second;
-        p.second.publish(&s);
-        dout(5) << __func__ << " recovered pool "
-                << std::hex
-                << p.first << "->" << s
-                << std::dec
-                << " per-pool:" << per_pool_stat_collection
-                << dendl;
     }
-    vstatfs = stats.actual_store_vstatfs;
-    vstatfs.publish(&s);
-    dout(5) << __func__ << " recovered " << s
-            << dendl;
-    return 0;
+    std::optional<string> lower;
+    for (auto &k : split_keys) {
+        ranges->push_back({lower, k});
+        lower = k;
+    }
+    ranges->push_back({lower, std::nullopt});
 }
 
 //---------------------------------------------------------
@@ -19850,6 +21412,9 @@ int BlueStore::commit_to_real_manager()
     if (ret == 0) {
         //remove the allocation_file
         invalidate_allocation_file_on_bluefs();
+        for (auto &file : allocator_journal_file) {
+            bluefs->unlink(allocator_dir, file);
+        }
         ret = bluefs->unlink(allocator_dir, allocator_file);
         bluefs->sync_metadata(false);
         if (ret == 0) {
@@ -25,6 +25,7 @@
 #include <ratio>
 #include <mutex>
 #include <condition_variable>
+#include <thread>
 
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/unordered_set.hpp>
@@ -46,6 +47,7 @@
 #include "common/Throttle.h"
 #include "common/perf_counters.h"
 #include "common/PriorityCache.h"
+#include "common/Readahead.h"
 #include "compressor/Compressor.h"
 #include "os/ObjectStore.h"
 
@@ -95,6 +97,19 @@ enum {
     l_bluestore_state_deferred_aio_wait_lat,
     l_bluestore_state_deferred_cleanup_lat,
 
+    // latency vs. txc size, same order as the state latencies above
+    l_bluestore_state_prepare_lat_hist,
+    l_bluestore_state_aio_wait_lat_hist,
+    l_bluestore_state_io_done_lat_hist,
+    l_bluestore_state_kv_queued_lat_hist,
+    l_bluestore_state_kv_committing_lat_hist,
+    l_bluestore_state_kv_done_lat_hist,
+    l_bluestore_state_finishing_lat_hist,
+    l_bluestore_state_done_lat_hist,
+    l_bluestore_state_deferred_queued_lat_hist,
+    l_bluestore_state_deferred_aio_wait_lat_hist,
+    l_bluestore_state_deferred_cleanup_lat_hist,
+
     l_bluestore_commit_lat,
     //****************************************
 
@@ -113,6 +128,8 @@ enum {
     l_bluestore_read_eio,
     l_bluestore_reads_with_retries,
     l_bluestore_read_lat,
+    l_bluestore_readahead_count,
+    l_bluestore_readahead_bytes,
     //****************************************
 
     // kv_thread latencies
@@ -121,6 +138,10 @@ enum {
     l_bluestore_kv_commit_lat,
     l_bluestore_kv_sync_lat,
     l_bluestore_kv_final_lat,
+    l_bluestore_alloc_journal_records,
+    l_bluestore_alloc_journal_bytes,
+    l_bluestore_alloc_journal_checkpoints,
+    l_bluestore_alloc_journal_replayed,
     //****************************************
 
     // write op stats
@@ -143,6 +164,8 @@ enum {
     l_bluestore_issued_deferred_write_bytes,
     l_bluestore_submitted_deferred_writes,
     l_bluestore_submitted_deferred_write_bytes,
+    l_bluestore_deferred_write_merged_ios,
+    l_bluestore_deferred_write_merged_bytes,
 
     l_bluestore_write_big_skipped_blobs,
     l_bluestore_write_big_skipped_bytes,
@@ -158,6 +181,7 @@ enum {
     l_bluestore_compress_lat,
     l_bluestore_decompress_lat,
     l_bluestore_compress_success_count,
+    l_bluestore_compress_dict_count,
     l_bluestore_compress_rejected_count,
     //****************************************
 
@@ -169,6 +193,7 @@ enum {
     l_bluestore_onode_misses,
     l_bluestore_onode_shard_hits,
     l_bluestore_onode_shard_misses,
+    l_bluestore_onode_shard_packed,
     l_bluestore_extents,
     l_bluestore_blobs,
     //****************************************
@@ -214,6 +239,12 @@ enum {
     //****************************************
     l_bluestore_allocate_hist,
     //****************************************
+
+    // allocation recovery stats
+    //****************************************
+    l_bluestore_alloc_recovery_onodes,
+    l_bluestore_alloc_recovery_lat,
+    //****************************************
     l_bluestore_last
 };
 
@@ -954,6 +985,7 @@ public:
             unsigned extents = 0;  ///< count extents in this shard
             bool loaded = false;   ///< true if shard is loaded
             bool dirty = false;    ///< true if shard is dirty and needs reencoding
+            ceph::buffer::list packed; ///< encoded extents of an unloaded clean shard, if any
         };
 
         mempool::bluestore_cache_meta::vector<Shard> shards;    ///< shards
@@ -1126,6 +1158,9 @@ public:
         void fault_range(KeyValueDB *db,
                          uint32_t offset, uint32_t length);
 
+        /// drop decoded extents of clean shards, keeping them packed in memory
+        unsigned pack_clean_shards();
+
         /// ensure a range of the map is marked dirty
         void dirty_range(uint32_t offset, uint32_t length);
 
@@ -1298,6 +1333,8 @@ public:
         bool cached;              ///< Onode is logically in the cache
         /// (it can be pinned and hence physically out
         /// of it at the moment though)
+        std::atomic<bool> lru_linked = {false};  ///< lru_item is linked, readable without the shard lock
+        std::atomic<bool> lru_touched = {false}; ///< unpinned since last seen by the trimmer
         ExtentMap extent_map;
 
         // track txc's that have not been committed to kv store (and whose
@@ -1308,6 +1345,7 @@ public:
         ceph::mutex flush_lock = ceph::make_mutex("BlueStore::Onode::flush_lock");
         ceph::condition_variable flush_cond;   ///< wait here for uncommitted txns
         std::shared_ptr<int64_t> cache_age_bin;  ///< cache age bin
+        std::unique_ptr<Readahead> readahead;    ///< read stream state, under flush_lock
 
         Onode(Collection *c, const ghobject_t &o,
               const mempool::bluestore_cache_meta::string &k)
@@ -1413,7 +1451,7 @@ public:
         }
 
         void rewrite_omap_key(const std::string &old, std::string *out);
-        void decode_omap_key(const std::string &key, std::string *user_key);
+        void decode_omap_key(std::string_view key, std::string *user_key);
 
 #ifdef HAVE_LIBZBD
         // Return the offset of an object on disk.  This function is intended *only*
@@ -1657,6 +1695,8 @@ public:
             return onode_space.cache;
         }
         OnodeRef get_onode(const ghobject_t &oid, bool create, bool is_createop = false);
+        /// bring the onodes of oids into the cache with one kv lookup
+        void preload_onodes(const std::vector<const ghobject_t *> &oids);
 
         // the terminology is confusing here, sorry!
         //
@@ -1671,6 +1711,7 @@ public:
         //  loaded = SharedBlob::shared_blob_t is loaded from kv store
         void open_shared_blob(uint64_t sbid, BlobRef b);
         void load_shared_blob(SharedBlobRef sb);
+        void load_shared_blobs(const std::vector<SharedBlobRef> &sbs);
         void make_blob_shared(uint64_t sbid, BlobRef b);
         uint64_t make_blob_unshared(SharedBlob *sb);
 
@@ -1984,6 +2025,8 @@ public:
         uint64_t seq = 0;
         ceph::mono_clock::time_point start;
         ceph::mono_clock::time_point last_stamp;
+        /// per state latencies, only tracked for sampled txcs
+        std::vector<ceph::timespan> state_lat;
 
         uint64_t last_nid = 0;     ///< if non-zero, highest new nid we allocated
         uint64_t last_blobid = 0;  ///< if non-zero, highest new blobid we allocated
@@ -2196,6 +2239,10 @@ public:
         IOContext ioc;                   ///< our aios
         /// bytes of pending io for each deferred seq (may be 0)
         std::map<uint64_t, int> seq_bytes;
+        /// number of extents queued via prepare_write
+        uint64_t queued_ios = 0;
+        /// bytes superseded by a later overlapping write in this batch
+        uint64_t overwritten_bytes = 0;
 
         void _discard(CephContext *cct, uint64_t offset, uint64_t length);
         void _audit(CephContext *cct);
@@ -2381,6 +2428,44 @@ public:
             return NULL;
         }
     };
+    struct KVCommitThread : public Thread {
+        BlueStore *store;
+        explicit KVCommitThread(BlueStore *s) : store(s) {}
+        void *entry() override
+        {
+            store->_kv_commit_thread();
+            return NULL;
+        }
+    };
+
+    /// one kv_sync_thread cycle, handed to the commit thread when pipelined
+    struct KVSyncBatch {
+        KeyValueDB::Transaction synct;
+        std::deque<TransContext *> committing;
+        std::deque<DeferredBatch *> deferred_stable;
+        std::deque<DeferredBatch *> deferred_done;
+        uint64_t new_nid_max = 0;
+        uint64_t new_blobid_max = 0;
+        mono_clock::time_point start;
+        mono_clock::time_point after_flush;
+    };
+
+    /// extra finalizer, owns the OpSequencers with sequencer_id % n == idx
+    struct KVFinalizeShard : public Thread {
+        BlueStore *store;
+        ceph::mutex lock = ceph::make_mutex("BlueStore::KVFinalizeShard::lock");
+        ceph::condition_variable cond;
+        std::deque<TransContext *> committed;
+        std::deque<DeferredBatch *> stable;
+        bool started = false;
+        bool stop = false;
+        explicit KVFinalizeShard(BlueStore *s) : store(s) {}
+        void *entry() override
+        {
+            store->_kv_finalize_shard_thread(this);
+            return NULL;
+        }
+    };
 
 #ifdef HAVE_LIBZBD
     struct ZonedCleanerThread : public Thread {
@@ -2440,6 +2525,20 @@ private:
     // store open_db options:
     bool db_was_opened_read_only = true;
     bool need_to_destage_allocation_file = false;
+    uint32_t alloc_file_serial = 1; ///< serial of the next allocation file stored
+
+    // NCB allocation journal: allocations and releases logged between two
+    // checkpoints of the allocation file (see _alloc_journal_*)
+    std::atomic<bool> alloc_journal_active = {false};
+    bool alloc_journal_need_checkpoint = true; ///< map on disk doesn't match alloc
+    ceph::mutex alloc_journal_lock = ceph::make_mutex("BlueStore::alloc_journal_lock");
+    ceph::buffer::list alloc_journal_pending;  ///< encoded entries, not written yet
+    uint32_t alloc_journal_pending_count = 0;
+    BlueFS::FileWriter *alloc_journal_writer = nullptr; ///< used by kv sync thread only
+    uint64_t alloc_journal_base = 0;           ///< serial of the checkpoint it extends
+    uint64_t alloc_journal_seq = 0;            ///< next record seq
+    std::atomic<bool> alloc_journal_checkpointing = {false};
+    std::thread alloc_journal_checkpoint_thread; ///< writes the checkpoint
 
     ///< rwlock to protect coll_map/new_coll_map
     ceph::shared_mutex coll_lock = ceph::make_shared_mutex("BlueStore::coll_lock");
@@ -2482,14 +2581,23 @@ private:
     std::deque<TransContext *> kv_queue_unsubmitted; ///< ready, need submit by kv thread
     std::deque<TransContext *> kv_committing;       ///< currently syncing
     std::deque<DeferredBatch *> deferred_done_queue;  ///< deferred ios done
+    std::deque<DeferredBatch *> deferred_stable_queue; ///< deferred ios done + stable
     bool kv_sync_in_progress = false;
 
+    bool kv_sync_pipeline = false; ///< sync batch N while applying batch N+1
+    KVCommitThread kv_commit_thread;
+    ceph::condition_variable kv_commit_cond; ///< protected by kv_lock
+    std::deque<KVSyncBatch> kv_commit_queue; ///< applied, waiting for sync
+    bool kv_commit_started = false;
+    bool kv_commit_stop = false;
+
     KVFinalizeThread kv_finalize_thread;
     ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
     ceph::condition_variable kv_finalize_cond;
     std::deque<TransContext *> kv_committing_to_finalize;  ///< pending finalization
     std::deque<DeferredBatch *> deferred_stable_to_finalize; ///< pending finalization
     bool kv_finalize_in_progress = false;
+    std::vector<std::unique_ptr<KVFinalizeShard>> kv_finalize_shards;
 
 #ifdef HAVE_LIBZBD
     ZonedCleanerThread zoned_cleaner_thread;
@@ -2502,6 +2610,23 @@ private:
 
     PerfCounters *logger = nullptr;
 
+    class SocketHook;
+    SocketHook *asok_hook = nullptr;
+
+    /// state latencies of a sampled txc, kept after it is done
+    struct txc_timeline_t {
+        uint64_t seq;
+        coll_t cid;
+        uint64_t bytes;
+        uint64_t ios;
+        ceph::timespan total;
+        std::vector<ceph::timespan> state_lat;
+    };
+    std::atomic<uint64_t> txc_timeline_seq = {0};  ///< sampling counter
+    ceph::mutex txc_timeline_lock = ceph::make_mutex("BlueStore::txc_timeline_lock");
+    boost::circular_buffer<txc_timeline_t> txc_timelines; ///< most recent sampled txcs
+
+    ceph::mutex reap_lock = ceph::make_mutex("BlueStore::reap_lock");
     std::list<CollectionRef> removed_collections;
 
     ceph::shared_mutex debug_read_error_lock =
@@ -2549,6 +2674,16 @@ private:
     std::atomic<Compressor::CompressionMode> comp_mode =
     {Compressor::COMP_NONE}; ///< compression mode
     CompressorRef compressor;
+
+    // trained compression dictionaries of a pool
+    struct compression_dicts_t {
+        std::map<uint32_t, Compressor::DictionaryRef> by_id;
+        Compressor::DictionaryRef active;  ///< used for new writes
+    };
+    ceph::shared_mutex compression_dicts_lock =
+        ceph::make_shared_mutex("BlueStore::compression_dicts_lock");
+    std::map<int64_t, compression_dicts_t> compression_dicts;  ///< by pool
+
     std::atomic<uint64_t> comp_min_blob_size = {0};
     std::atomic<uint64_t> comp_max_blob_size = {0};
 
@@ -2742,7 +2877,8 @@ private:
                        mempool::bluestore_cache_other::allocated_bytes() +
                        mempool::bluestore_cache_onode::allocated_bytes() +
                        mempool::bluestore_shared_blob::allocated_bytes() +
-                       mempool::bluestore_inline_bl::allocated_bytes();
+                       mempool::bluestore_inline_bl::allocated_bytes() +
+                       mempool::bluestore_packed_shard::allocated_bytes();
             }
             virtual void shift_bins()
             {
@@ -2911,6 +3047,8 @@ private:
     void _post_init_alloc(const std::map<uint64_t, uint64_t> &zone_adjustments);
     void _close_alloc();
     int _open_collections();
+    void _open_compression_dicts();
+    Compressor::DictionaryRef _get_compression_dict(int64_t pool, uint32_t id = 0);
     void _fsck_collections(int64_t *errors);
     void _close_collections();
 
@@ -2977,6 +3115,7 @@ private:
     void _txc_committed_kv(TransContext *txc);
     void _txc_finish(TransContext *txc);
     void _txc_release_alloc(TransContext *txc);
+    void _txc_record_timeline(TransContext *txc);
 
     void _osr_attach(Collection *c);
     void _osr_register_zombie(OpSequencer *osr);
@@ -2987,7 +3126,12 @@ private:
     void _kv_start();
     void _kv_stop();
     void _kv_sync_thread();
+    void _kv_sync_commit(KVSyncBatch &b);
+    void _kv_commit_thread();
     void _kv_finalize_thread();
+    void _kv_finalize_shard_thread(KVFinalizeShard *shard);
+    void _kv_finalize_txcs(std::deque<TransContext *> &kv_committed,
+                           std::deque<DeferredBatch *> &deferred_stable);
 
 #ifdef HAVE_LIBZBD
     void _zoned_cleaner_start();
@@ -3242,6 +3386,14 @@ public:
         logger->dump_formatted(f, false, false);
         f->close_section();
     }
+    /// dump the slowest of the recently sampled txcs with their state latencies
+    void dump_slowest_txcs(ceph::Formatter *f, size_t count);
+    /// train a zstd dictionary on small objects of a pool and start using it
+    int train_compression_dict(int64_t pool,
+                               unsigned max_samples,
+                               uint64_t max_object_size,
+                               uint64_t dict_size,
+                               ceph::Formatter *f);
 
     int add_new_bluefs_device(int id, const std::string &path);
     int migrate_to_existing_bluefs_device(const std::set<int> &devs_source,
@@ -3356,6 +3508,13 @@ private:
         bool *csum_error,
         ceph::buffer::list &bl);
 
+    uint64_t _get_readahead(
+        Collection *c,
+        OnodeRef &o,
+        uint64_t offset,
+        uint64_t length,
+        uint32_t op_flags);
+
     int _do_read(
         Collection *c,
         OnodeRef &o,
@@ -3363,7 +3522,17 @@ private:
         size_t len,
         ceph::buffer::list &bl,
         uint32_t op_flags = 0,
-        uint64_t retry_count = 0);
+        uint64_t retry_count = 0,
+        bool readahead = false);
+    int _do_read_without_readahead(
+        Collection *c,
+        OnodeRef &o,
+        uint64_t offset,
+        size_t len,
+        ceph::buffer::list &bl,
+        uint32_t op_flags,
+        uint64_t retry_count,
+        int r);
 
     int _do_readv(
         Collection *c,
@@ -3673,7 +3842,7 @@ private:
         uint64_t blob_xoffset,
         const ceph::buffer::list &bl,
         uint64_t logical_offset) const;
-    int _decompress(ceph::buffer::list &source, ceph::buffer::list *result);
+    int _decompress(int64_t pool, ceph::buffer::list &source, ceph::buffer::list *result);
 
 
     // --------------------------------------------------------
@@ -4042,20 +4211,46 @@ private:
 
         std::map<uint64_t, volatile_statfs> actual_pool_vstatfs;
         volatile_statfs actual_store_vstatfs;
+
+        // accumulate the results of a single onode key range scan
+        void merge(const read_alloc_stats_t &other)
+        {
+            onode_count += other.onode_count;
+            shard_count += other.shard_count;
+            skipped_illegal_extent += other.skipped_illegal_extent;
+            shared_blob_count += other.shared_blob_count;
+            compressed_blob_count += other.compressed_blob_count;
+            spanning_blob_count += other.spanning_blob_count;
+            insert_count += other.insert_count;
+            extent_count += other.extent_count;
+            for (auto &p : other.actual_pool_vstatfs) {
+                actual_pool_vstatfs[p.first] += p.second;
+            }
+            actual_store_vstatfs += other.actual_store_vstatfs;
+        }
     };
     class ExtentDecoderPartial : public ExtentMap::ExtentDecoder
     {
+        // max number of extents buffered before they are applied to the
+        // shared bitmap under sbmap_lock
+        static constexpr size_t MAX_PENDING_EXTENTS = 4096;
+
         BlueStore &store;
         read_alloc_stats_t &stats;
         SimpleBitmap &sbmap;
         sb_info_space_efficient_map_t &sb_info;
         uint8_t min_alloc_size_order;
+        // set when several decoders run in parallel over the same
+        // sbmap/sb_info, nullptr otherwise
+        ceph::mutex *sbmap_lock = nullptr;
+        std::vector<std::pair<uint64_t, uint64_t>> pending_extents;
         Extent extent;
         ghobject_t oid;
         volatile_statfs *per_pool_statfs = nullptr;
         blob_map_t blobs;
         blob_map_t spanning_blobs;
 
+        void _set_allocation(uint64_t offset, uint64_t length);
         void _consume_new_blob(bool spanning,
                                uint64_t extent_no,
                                uint64_t sbid,
@@ -4081,9 +4276,11 @@ private:
                              read_alloc_stats_t &_stats,
                              SimpleBitmap &_sbmap,
                              sb_info_space_efficient_map_t &_sb_info,
-                             uint8_t _min_alloc_size_order)
+                             uint8_t _min_alloc_size_order,
+                             ceph::mutex *_sbmap_lock = nullptr)
             : store(_store), stats(_stats), sbmap(_sbmap), sb_info(_sb_info),
-              min_alloc_size_order(_min_alloc_size_order)
+              min_alloc_size_order(_min_alloc_size_order),
+              sbmap_lock(_sbmap_lock)
         {}
         const ghobject_t &get_oid() const
         {
@@ -4091,6 +4288,8 @@ private:
         }
         void reset(const ghobject_t _oid,
                    volatile_statfs *_per_pool_statfs);
+        // apply buffered extents to the bitmap, no-op in single-threaded mode
+        void flush();
     };
 
     friend std::ostream &operator<<(std::ostream &out, const read_alloc_stats_t &stats)
@@ -4138,9 +4337,28 @@ private:
     int  invalidate_allocation_file_on_bluefs();
     int  __restore_allocator(Allocator *allocator, uint64_t *num, uint64_t *bytes);
     int  restore_allocator(Allocator *allocator, uint64_t *num, uint64_t *bytes);
+    int  __store_allocator(Allocator *src_allocator, const std::string &file, uint32_t serial);
+    int  _alloc_journal_start();
+    void _alloc_journal_stop();
+    int  _alloc_journal_open(uint64_t base);
+    void _alloc_journal_log(const interval_set<uint64_t> &extents, bool release);
+    void _alloc_journal_flush();
+    void _alloc_journal_checkpoint();
+    int  _alloc_journal_write_checkpoint(uint32_t serial);
+    int  _alloc_journal_read_base(const std::string &file, uint64_t *base);
+    int  _alloc_journal_replay(uint64_t base,
+                               interval_set<uint64_t> *allocated,
+                               interval_set<uint64_t> *released,
+                               uint64_t *records);
     int  read_allocation_from_drive_on_startup();
     int  reconstruct_allocations(SimpleBitmap *smbmp, read_alloc_stats_t &stats);
     int  read_allocation_from_onodes(SimpleBitmap *smbmp, read_alloc_stats_t &stats);
+    int  read_allocation_from_onode_range(SimpleBitmap *sbmap,
+                                          sb_info_space_efficient_map_t &sb_info,
+                                          ceph::mutex *sbmap_lock,
+                                          const KeyValueDB::IteratorBounds &bounds,
+                                          read_alloc_stats_t &stats);
+    void get_onode_key_ranges(std::vector<KeyValueDB::IteratorBounds> *ranges);
     int  commit_freelist_type();
     int  commit_to_null_manager();
     int  commit_to_real_manager();
@@ -0,0 +1,427 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ShardedAllocator.h"
+
+#include <bit>
+#include <limits>
+
+#include "common/config_proxy.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef  dout_prefix
+#define dout_prefix *_dout << "ShardedAllocator "
+
+// region boundaries are kept aligned to this so that any sane allocation
+// unit never straddles two regions
+static constexpr uint64_t REGION_ALIGN = 16 << 20;
+
+// bound the number of segments looked at per size class on the fast path,
+// a miss falls through to the next class or the next region
+static constexpr unsigned MAX_SCAN = 64;
+
+ShardedAllocator::ShardedAllocator(CephContext *cct,
+                                   int64_t device_size,
+                                   int64_t block_size,
+                                   std::string_view name) :
+    Allocator(name, device_size, block_size),
+    cct(cct)
+{
+    uint64_t n = std::max<uint64_t>(
+                     1, cct->_conf.get_val<uint64_t>("bluestore_sharded_alloc_regions"));
+    region_size = std::max(p2roundup<uint64_t>(device_size / n, REGION_ALIGN),
+                           REGION_ALIGN);
+    n = std::max<uint64_t>(1, (device_size + region_size - 1) / region_size);
+    regions.reserve(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        regions.emplace_back(new region_t);
+    }
+    ldout(cct, 10) << __func__ << std::hex
+                   << " device_size 0x" << device_size
+                   << " region_size 0x" << region_size
+                   << std::dec << " regions " << n << dendl;
+}
+
+ShardedAllocator::~ShardedAllocator()
+{
+    shutdown();
+}
+
+unsigned ShardedAllocator::_size_class(uint64_t length) const
+{
+    uint64_t blocks = length / block_size;
+    if (blocks == 0) {
+        return 0;
+    }
+    return std::min<unsigned>(std::bit_width(blocks) - 1, NUM_CLASSES - 1);
+}
+
+unsigned ShardedAllocator::_fit_class(uint64_t size, uint64_t unit) const
+{
+    // a segment of class k is at least block_size << k long and loses less
+    // than unit to alignment, so from this class on any segment will do
+    uint64_t blocks = std::max<uint64_t>(1, (size + unit - 1) / block_size);
+    return std::min<unsigned>(std::bit_width(blocks - 1), NUM_CLASSES);
+}
+
+size_t ShardedAllocator::_home_region(int64_t hint) const
+{
+    if (hint > 0 && hint < device_size) {
+        return hint / region_size;
+    }
+    static std::atomic<unsigned> next_home = {0};
+    thread_local unsigned home = next_home++;
+    return home % regions.size();
+}
+
+void ShardedAllocator::_insert_seg(region_t &r, uint64_t start, uint64_t end)
+{
+    unsigned k = _size_class(end - start);
+    r.range_tree.emplace(start, end);
+    r.size_classes[k].emplace(start, end);
+    r.class_mask.store(r.class_mask.load(std::memory_order_relaxed) | (1u << k),
+                       std::memory_order_relaxed);
+    ++r.num_segments;
+}
+
+void ShardedAllocator::_erase_seg(region_t &r, uint64_t start, uint64_t end)
+{
+    unsigned k = _size_class(end - start);
+    r.range_tree.erase(start);
+    r.size_classes[k].erase(start);
+    if (r.size_classes[k].empty()) {
+        r.class_mask.store(r.class_mask.load(std::memory_order_relaxed) & ~(1u << k),
+                           std::memory_order_relaxed);
+    }
+    --r.num_segments;
+}
+
+void ShardedAllocator::_add_free(region_t &r, uint64_t start, uint64_t length)
+{
+    ceph_assert(length != 0);
+    uint64_t end = start + length;
+    uint64_t new_start = start, new_end = end;
+
+    auto rs_after = r.range_tree.upper_bound(start);
+    if (rs_after != r.range_tree.begin()) {
+        auto rs_before = std::prev(rs_after);
+        // make sure we don't overlap with our neighbor
+        ceph_assert(rs_before->second <= start);
+        if (rs_before->second == start) {
+            new_start = rs_before->first;
+        }
+    }
+    if (rs_after != r.range_tree.end()) {
+        ceph_assert(rs_after->first >= end);
+        if (rs_after->first == end) {
+            new_end = rs_after->second;
+        }
+    }
+    // btree iterators don't survive an erase, go by key
+    if (new_start != start) {
+        _erase_seg(r, new_start, start);
+    }
+    if (new_end != end) {
+        _erase_seg(r, end, new_end);
+    }
+    _insert_seg(r, new_start, new_end);
+    r.num_free += length;
+    r.free.store(r.num_free, std::memory_order_relaxed);
+}
+
+void ShardedAllocator::_remove_free(region_t &r, uint64_t start, uint64_t length)
+{
+    ceph_assert(length != 0);
+    ceph_assert(length <= r.num_free);
+    uint64_t end = start + length;
+
+    auto rs = r.range_tree.upper_bound(start);
+    // make sure we completely overlap with someone
+    ceph_assert(rs != r.range_tree.begin());
+    --rs;
+    uint64_t seg_start = rs->first;
+    uint64_t seg_end = rs->second;
+    ceph_assert(seg_start <= start);
+    ceph_assert(seg_end >= end);
+
+    _erase_seg(r, seg_start, seg_end);
+    if (seg_start < start) {
+        _insert_seg(r, seg_start, start);
+    }
+    if (end < seg_end) {
+        _insert_seg(r, end, seg_end);
+    }
+    r.num_free -= length;
+    r.free.store(r.num_free, std::memory_order_relaxed);
+}
+
+uint64_t ShardedAllocator::_pick_fit(region_t &r, uint64_t size, uint64_t unit,
+                                     bool exhaustive)
+{
+    // lowest offset in the smallest size class which has room for us; below
+    // the fit class a segment may be too short once aligned, so look for one
+    unsigned fit_class = _fit_class(size, unit);
+    for (unsigned k = _size_class(size); k < fit_class; ++k) {
+        unsigned scanned = 0;
+        for (auto &rs : r.size_classes[k]) {
+            uint64_t offset = p2roundup(rs.first, unit);
+            if (offset + size <= rs.second) {
+                return offset;
+            }
+            if (!exhaustive && ++scanned >= MAX_SCAN) {
+                break;
+            }
+        }
+    }
+    for (unsigned k = fit_class; k < NUM_CLASSES; ++k) {
+        if (!r.size_classes[k].empty()) {
+            auto &rs = *r.size_classes[k].begin();
+            uint64_t offset = p2roundup(rs.first, unit);
+            ceph_assert(offset + size <= rs.second);
+            return offset;
+        }
+    }
+    return -1ULL;
+}
+
+uint64_t ShardedAllocator::_pick_largest(region_t &r, uint64_t size,
+        uint64_t unit, uint64_t *offset)
+{
+    uint64_t best = 0;
+    for (int k = NUM_CLASSES - 1; k >= 0 && best < size; --k) {
+        unsigned scanned = 0;
+        for (auto &rs : r.size_classes[k]) {
+            uint64_t start = std::min(p2roundup(rs.first, unit), rs.second);
+            uint64_t len = p2align(rs.second - start, unit);
+            if (len > best) {
+                best = len;
+                *offset = start;
+            }
+            // don't give up on the region before finding anything usable
+            if (++scanned >= MAX_SCAN && best) {
+                break;
+            }
+        }
+    }
+    return std::min(best, size);
+}
+
+uint64_t ShardedAllocator::_allocate(
+    region_t &r,
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    bool exhaustive,
+    bool may_fragment,
+    PExtentVector *extents)
+{
+    uint64_t allocated = 0;
+    while (allocated < want) {
+        uint64_t size = _chunk_size(want - allocated, unit, max_alloc_size);
+        uint64_t offset = _pick_fit(r, size, unit, exhaustive);
+        if (offset == -1ULL) {
+            if (!may_fragment) {
+                break;
+            }
+            // no single segment is big enough, take what we can get
+            size = _pick_largest(r, size, unit, &offset);
+            if (size == 0) {
+                break;
+            }
+        }
+        dout(20) << __func__ << std::hex << " 0x" << offset << "~" << size
+                 << std::dec << dendl;
+        _remove_free(r, offset, size);
+        extents->emplace_back(offset, size);
+        allocated += size;
+    }
+    return allocated;
+}
+
+int64_t ShardedAllocator::allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t  hint,
+    PExtentVector *extents)
+{
+    ldout(cct, 10) << __func__ << std::hex
+                   << " want 0x" << want
+                   << " unit 0x" << unit
+                   << " max_alloc_size 0x" << max_alloc_size
+                   << " hint 0x" << hint
+                   << std::dec << dendl;
+    ceph_assert(std::has_single_bit(unit));
+    ceph_assert(want % unit == 0);
+
+    if (max_alloc_size == 0) {
+        max_alloc_size = want;
+    }
+    if (constexpr auto cap = std::numeric_limits<decltype(bluestore_pextent_t::length)>::max();
+        max_alloc_size >= cap) {
+        max_alloc_size = p2align(uint64_t(cap), (uint64_t)block_size);
+    }
+
+    size_t n = regions.size();
+    size_t home = _home_region(hint);
+    uint64_t allocated = 0;
+    // pass 0 only visits regions whose summary promises a segment which fits
+    // wherever it starts, pass 1 searches every region which may hold one,
+    // and only then pass 2 splits the request over whatever is left
+    for (int pass = 0; pass < 3 && allocated < want; ++pass) {
+        for (size_t i = 0; i < n && allocated < want; ++i) {
+            region_t &r = *regions[(home + i) % n];
+            if (r.free.load(std::memory_order_relaxed) < unit) {
+                continue;
+            }
+            if (pass < 2) {
+                uint64_t size = _chunk_size(want - allocated, unit, max_alloc_size);
+                unsigned k = pass == 0 ? _fit_class(size, unit) : _size_class(size);
+                if (k >= NUM_CLASSES ||
+                    (r.class_mask.load(std::memory_order_relaxed) >> k) == 0) {
+                    continue;
+                }
+            }
+            std::lock_guard l(r.lock);
+            allocated += _allocate(r, want - allocated, unit, max_alloc_size,
+                                   pass > 0, pass == 2, extents);
+        }
+    }
+    return allocated ? allocated : -ENOSPC;
+}
+
+void ShardedAllocator::release(const interval_set<uint64_t> &release_set)
+{
+    for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+        const auto offset = p.get_start();
+        const auto length = p.get_len();
+        ceph_assert(offset + length <= uint64_t(device_size));
+        ldout(cct, 10) << __func__ << std::hex
+                       << " offset 0x" << offset
+                       << " length 0x" << length
+                       << std::dec << dendl;
+        _for_each_region(offset, length,
+        [this](region_t &r, uint64_t o, uint64_t l) {
+            std::lock_guard rl(r.lock);
+            _add_free(r, o, l);
+        });
+    }
+}
+
+uint64_t ShardedAllocator::get_free()
+{
+    uint64_t free = 0;
+    for (auto &r : regions) {
+        free += r->free.load(std::memory_order_relaxed);
+    }
+    return free;
+}
+
+double ShardedAllocator::get_fragmentation()
+{
+    uint64_t num_free = 0, num_segments = 0;
+    for (auto &r : regions) {
+        std::lock_guard l(r->lock);
+        num_free += r->num_free;
+        num_segments += r->num_segments;
+    }
+    auto free_blocks = p2align(num_free, (uint64_t)block_size) / block_size;
+    if (free_blocks <= 1) {
+        return .0;
+    }
+    return (static_cast<double>(num_segments - 1) / (free_blocks - 1));
+}
+
+void ShardedAllocator::dump()
+{
+    for (size_t i = 0; i < regions.size(); ++i) {
+        auto &r = *regions[i];
+        std::lock_guard l(r.lock);
+        ldout(cct, 0) << __func__ << " region " << i
+                      << " free 0x" << std::hex << r.num_free << std::dec
+                      << " segments " << r.num_segments
+                      << " class_mask 0x" << std::hex << r.class_mask.load()
+                      << std::dec << dendl;
+        for (auto &rs : r.range_tree) {
+            ldout(cct, 0) << std::hex
+                          << "0x" << rs.first << "~" << rs.second - rs.first
+                          << std::dec
+                          << dendl;
+        }
+    }
+}
+
+void ShardedAllocator::foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+    // glue back segments which were only split by a region boundary
+    uint64_t pending_offset = 0, pending_length = 0;
+    for (auto &r : regions) {
+        std::lock_guard l(r->lock);
+        for (auto &rs : r->range_tree) {
+            if (pending_length && pending_offset + pending_length == rs.first) {
+                pending_length += rs.second - rs.first;
+                continue;
+            }
+            if (pending_length) {
+                notify(pending_offset, pending_length);
+            }
+            pending_offset = rs.first;
+            pending_length = rs.second - rs.first;
+        }
+    }
+    if (pending_length) {
+        notify(pending_offset, pending_length);
+    }
+}
+
+void ShardedAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+    if (!length) {
+        return;
+    }
+    ceph_assert(offset + length <= uint64_t(device_size));
+    ldout(cct, 10) << __func__ << std::hex
+                   << " offset 0x" << offset
+                   << " length 0x" << length
+                   << std::dec << dendl;
+    _for_each_region(offset, length,
+    [this](region_t &r, uint64_t o, uint64_t l) {
+        std::lock_guard rl(r.lock);
+        _add_free(r, o, l);
+    });
+}
+
+void ShardedAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+    if (!length) {
+        return;
+    }
+    ceph_assert(offset + length <= uint64_t(device_size));
+    ldout(cct, 10) << __func__ << std::hex
+                   << " offset 0x" << offset
+                   << " length 0x" << length
+                   << std::dec << dendl;
+    _for_each_region(offset, length,
+    [this](region_t &r, uint64_t o, uint64_t l) {
+        std::lock_guard rl(r.lock);
+        _remove_free(r, o, l);
+    });
+}
+
+void ShardedAllocator::shutdown()
+{
+    for (auto &r : regions) {
+        std::lock_guard l(r->lock);
+        r->range_tree.clear();
+        for (auto &c : r->size_classes) {
+            c.clear();
+        }
+        r->num_free = 0;
+        r->num_segments = 0;
+        r->free = 0;
+        r->class_mask = 0;
+    }
+}
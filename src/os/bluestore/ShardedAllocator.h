@@ -0,0 +1,130 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:nil -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "include/cpp-btree/btree_map.h"
+#include "Allocator.h"
+#include "os/bluestore/bluestore_types.h"
+#include "include/mempool.h"
+
+/*
+ * Splits the device into independently locked regions so that concurrent
+ * allocate()/release() calls from different threads rarely contend.
+ *
+ * Each region keeps its free extents in an offset ordered tree (for
+ * merging on release) and in per size class lists, class k holding extents
+ * of [block_size << k, block_size << (k + 1)) bytes.  A lock-free summary
+ * per region (free bytes and a mask of non-empty size classes) lets the
+ * caller skip regions that can't serve a request without taking their lock.
+ * A request is served in one piece from any region that can before it is
+ * split over several extents.
+ *
+ * Every thread gets a home region assigned round-robin on first use, so
+ * threads mostly work on disjoint regions (and disjoint allocator memory).
+ */
+class ShardedAllocator : public Allocator
+{
+    static constexpr unsigned NUM_CLASSES = 24;
+
+    template<class T>
+    using pool_allocator = mempool::bluestore_alloc::pool_allocator<T>;
+    using range_tree_t =
+        btree::btree_map <
+        uint64_t /* start */,
+        uint64_t /* end */,
+        std::less<uint64_t>,
+        pool_allocator<std::pair<uint64_t, uint64_t> >>;
+
+    struct region_t {
+        std::mutex lock;
+        range_tree_t range_tree;                ///< all free segments
+        range_tree_t size_classes[NUM_CLASSES]; ///< same segments, by size class
+        uint64_t num_free = 0;
+        uint64_t num_segments = 0;
+
+        // summary, readable without the lock
+        std::atomic<uint64_t> free = {0};
+        std::atomic<uint32_t> class_mask = {0};
+    };
+
+public:
+    ShardedAllocator(CephContext *cct, int64_t device_size, int64_t block_size,
+                     std::string_view name);
+    ~ShardedAllocator();
+    const char *get_type() const override
+    {
+        return "sharded";
+    }
+    int64_t allocate(
+        uint64_t want,
+        uint64_t unit,
+        uint64_t max_alloc_size,
+        int64_t  hint,
+        PExtentVector *extents) override;
+    void release(const interval_set<uint64_t> &release_set) override;
+    uint64_t get_free() override;
+    double get_fragmentation() override;
+
+    void dump() override;
+    void foreach(
+        std::function<void(uint64_t offset, uint64_t length)> notify) override;
+    void init_add_free(uint64_t offset, uint64_t length) override;
+    void init_rm_free(uint64_t offset, uint64_t length) override;
+    void shutdown() override;
+
+    size_t get_num_regions() const
+    {
+        return regions.size();
+    }
+
+private:
+    CephContext *cct;
+    uint64_t region_size = 0;
+    std::vector<std::unique_ptr<region_t>> regions;
+
+    unsigned _size_class(uint64_t length) const;
+    unsigned _fit_class(uint64_t size, uint64_t unit) const;
+    size_t _home_region(int64_t hint) const;
+
+    // call f(region, offset, length) for each per-region piece of the range
+    template <typename F>
+    void _for_each_region(uint64_t offset, uint64_t length, F &&f)
+    {
+        while (length) {
+            size_t idx = offset / region_size;
+            uint64_t l = std::min(length, (idx + 1) * region_size - offset);
+            f(*regions[idx], offset, l);
+            offset += l;
+            length -= l;
+        }
+    }
+
+    // size of the next extent to look for
+    static uint64_t _chunk_size(uint64_t want, uint64_t unit,
+                                uint64_t max_alloc_size)
+    {
+        return std::max(p2align(std::min(max_alloc_size, want), unit), unit);
+    }
+
+    // all of the below expect region lock to be held
+    void _insert_seg(region_t &r, uint64_t start, uint64_t end);
+    void _erase_seg(region_t &r, uint64_t start, uint64_t end);
+    void _add_free(region_t &r, uint64_t start, uint64_t length);
+    void _remove_free(region_t &r, uint64_t start, uint64_t length);
+    uint64_t _pick_fit(region_t &r, uint64_t size, uint64_t unit,
+                       bool exhaustive);
+    uint64_t _pick_largest(region_t &r, uint64_t size, uint64_t unit,
+                           uint64_t *offset);
+    uint64_t _allocate(region_t &r,
+                       uint64_t want,
+                       uint64_t unit,
+                       uint64_t max_alloc_size,
+                       bool exhaustive,
+                       bool may_fragment,
+                       PExtentVector *extents);
+};
@@ -1206,6 +1206,7 @@ void bluestore_compression_header_t::dump(Formatter *f) const
     if (compressor_message) {
         f->dump_int("compressor_message", *compressor_message);
     }
+    f->dump_unsigned("dict_id", dict_id);
 }
 
 void bluestore_compression_header_t::generate_test_instances(
@@ -1214,6 +1215,9 @@ void bluestore_compression_header_t::generate_test_instances(
     o.push_back(new bluestore_compression_header_t);
     o.push_back(new bluestore_compression_header_t(1));
     o.back()->length = 1234;
+    o.push_back(new bluestore_compression_header_t(3));
+    o.back()->length = 567;
+    o.back()->set_dict(89);
 }
 
 // adds more salt to build a hash func input
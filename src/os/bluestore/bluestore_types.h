@@ -422,11 +422,7 @@ struct bluestore_blob_use_tracker_t {
             if (!num_au) {
                 denc_varint(total_bytes, p);
             } else {
-                size_t elem_size = 0;
-                denc_varint((uint32_t)0, elem_size);
-                for (size_t i = 0; i < num_au; ++i) {
-                    denc_varint(bytes_per_au[i], p);
-                }
+                denc_varint_array(bytes_per_au, num_au, p);
             }
         }
     }
@@ -442,9 +438,7 @@ struct bluestore_blob_use_tracker_t {
                 denc_varint(total_bytes, p);
             } else {
                 allocate(_num_au);
-                for (size_t i = 0; i < _num_au; ++i) {
-                    denc_varint(bytes_per_au[i], p);
-                }
+                denc_varint_array(bytes_per_au, _num_au, p);
             }
         }
     }
@@ -1200,22 +1194,46 @@ struct bluestore_deferred_transaction_t {
 WRITE_CLASS_DENC(bluestore_deferred_transaction_t)
 
 struct bluestore_compression_header_t {
+    /// or'ed into type for blobs compressed with a dictionary.  Older code
+    /// doesn't know the resulting algorithm and fails the read instead of
+    /// decompressing without the dictionary (struct compat isn't checked).
+    static constexpr uint8_t TYPE_DICT = 0x80;
+
     uint8_t type = Compressor::COMP_ALG_NONE;
     uint32_t length = 0;
     std::optional<int32_t> compressor_message;
+    uint32_t dict_id = 0;  ///< compression dictionary, 0 if none
 
     bluestore_compression_header_t() {}
     bluestore_compression_header_t(uint8_t _type)
         : type(_type) {}
 
+    int get_alg() const
+    {
+        return type & ~TYPE_DICT;
+    }
+    void set_dict(uint32_t id)
+    {
+        dict_id = id;
+        if (id) {
+            type |= TYPE_DICT;
+        } else {
+            type &= ~TYPE_DICT;
+        }
+    }
+
     DENC(bluestore_compression_header_t, v, p)
     {
-        DENC_START(2, 1, p);
+        // without a dictionary the header stays v2
+        DENC_START(v.dict_id ? 3 : 2, 1, p);
         denc(v.type, p);
         denc(v.length, p);
         if (struct_v >= 2) {
             denc(v.compressor_message, p);
         }
+        if (struct_v >= 3) {
+            denc(v.dict_id, p);
+        }
         DENC_FINISH(p);
     }
     void dump(ceph::Formatter *f) const;
@@ -115,6 +115,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::read_request_t &rhs)
     return lhs << "read_request_t(to_read=[" << rhs.to_read << "]"
            << ", need=" << rhs.need
            << ", want_attrs=" << rhs.want_attrs
+           << ", direct=" << rhs.direct
            << ")";
 }
 
@@ -179,8 +180,11 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
         << " pending_apply=" << rhs.pending_apply
         << " pending_commit=" << rhs.pending_commit
         << " plan.to_read=" << rhs.plan.to_read
-        << " plan.will_write=" << rhs.plan.will_write
-        << ")";
+        << " plan.will_write=" << rhs.plan.will_write;
+    if (rhs.delta_write) {
+        lhs << " delta_write plan.delta_writes=" << rhs.plan.delta_writes;
+    }
+    lhs << ")";
     return lhs;
 }
 
@@ -1068,22 +1072,64 @@ void ECBackend::handle_sub_read(
                 dout(25) << __func__ << " case2: going to do fragmented read." << dendl;
                 int subchunk_size =
                     sinfo.get_chunk_size() / ec_impl->get_sub_chunk_count();
-                bool error = false;
-                for (int m = 0; m < (int)j->get<1>() && !error;
-                     m += sinfo.get_chunk_size()) {
-                    for (auto &&k : op.subchunks.find(i->first)->second) {
-                        bufferlist bl0;
-                        r = store->read(
+                const auto &runs = op.subchunks.find(i->first)->second;
+                bool ascending = true;
+                for (size_t k = 1; k < runs.size(); ++k) {
+                    if (runs[k].first < runs[k - 1].first + runs[k - 1].second) {
+                        ascending = false;
+                        break;
+                    }
+                }
+                struct stat st;
+                if (ascending) {
+                    r = store->stat(
+                            ch,
+                            ghobject_t(i->first, ghobject_t::NO_GEN, shard),
+                            &st, true);
+                }
+                if (ascending && r >= 0) {
+                    // the planes of every chunk in one vectored read, in the
+                    // order decode expects them.  recovery asks for whole
+                    // recovery chunks, so clip to the shard: readv (unlike
+                    // read) wants ranges that exist.
+                    interval_set<uint64_t> m;
+                    for (uint64_t off = 0; off < j->get<1>();
+                         off += sinfo.get_chunk_size()) {
+                        for (auto &&k : runs) {
+                            m.union_insert(j->get<0>() + off + k.first * subchunk_size,
+                                           k.second * subchunk_size);
+                        }
+                    }
+                    interval_set<uint64_t> exists;
+                    if (st.st_size > 0) {
+                        exists.insert(0, st.st_size);
+                    }
+                    m.intersection_of(exists);
+                    r = 0;
+                    if (!m.empty()) {
+                        r = store->readv(
                                 ch,
                                 ghobject_t(i->first, ghobject_t::NO_GEN, shard),
-                                j->get<0>() + m + (k.first) * subchunk_size,
-                                (k.second) * subchunk_size,
-                                bl0, j->get<2>());
-                        if (r < 0) {
-                            error = true;
-                            break;
+                                m, bl, j->get<2>());
+                    }
+                } else if (r >= 0) {
+                    bool error = false;
+                    for (int m = 0; m < (int)j->get<1>() && !error;
+                         m += sinfo.get_chunk_size()) {
+                        for (auto &&k : runs) {
+                            bufferlist bl0;
+                            r = store->read(
+                                    ch,
+                                    ghobject_t(i->first, ghobject_t::NO_GEN, shard),
+                                    j->get<0>() + m + (k.first) * subchunk_size,
+                                    (k.second) * subchunk_size,
+                                    bl0, j->get<2>());
+                            if (r < 0) {
+                                error = true;
+                                break;
+                            }
+                            bl.claim_append(bl0);
                         }
-                        bl.claim_append(bl0);
                     }
                 }
             }
@@ -1233,8 +1279,9 @@ void ECBackend::handle_sub_read_reply(
             dout(20) << __func__ << " to_read skipping" << dendl;
             continue;
         }
+        const read_request_t &req = rop.to_read.find(i->first)->second;
         list<boost::tuple<uint64_t, uint64_t, uint32_t> >::const_iterator req_iter =
-            rop.to_read.find(i->first)->second.to_read.begin();
+            req.to_read.begin();
         list <
         boost::tuple <
         uint64_t, uint64_t, map<pg_shard_t, bufferlist> > >::iterator riter =
@@ -1242,9 +1289,19 @@ void ECBackend::handle_sub_read_reply(
         for (list<pair<uint64_t, bufferlist> >::iterator j = i->second.begin();
              j != i->second.end();
              ++j, ++req_iter, ++riter) {
-            ceph_assert(req_iter != rop.to_read.find(i->first)->second.to_read.end());
+            if (req.direct) {
+                // the extents not stored on this shard were not read from it
+                while (req_iter != req.to_read.end() &&
+                       get_direct_read_range(from.shard, *req_iter).second == 0) {
+                    ++req_iter;
+                    ++riter;
+                }
+            }
+            ceph_assert(req_iter != req.to_read.end());
             ceph_assert(riter != rop.complete[i->first].returned.end());
             pair<uint64_t, uint64_t> adjusted =
+                req.direct ?
+                get_direct_read_range(from.shard, *req_iter) :
                 sinfo.aligned_offset_len_to_chunk(
                     make_pair(req_iter->get<0>(), req_iter->get<1>()));
             ceph_assert(adjusted.first == j->first);
@@ -1291,12 +1348,22 @@ void ECBackend::handle_sub_read_reply(
              iter != rop.complete.end();
              ++iter) {
             set<int> have;
-            for (map<pg_shard_t, bufferlist>::const_iterator j =
-                     iter->second.returned.front().get<2>().begin();
-                 j != iter->second.returned.front().get<2>().end();
-                 ++j) {
-                have.insert(j->first.shard);
-                dout(20) << __func__ << " have shard=" << j->first.shard << dendl;
+            if (rop.to_read.at(iter->first).direct) {
+                // not every shard of a direct read holds part of each extent
+                for (auto &&j : rop.obj_to_source[iter->first]) {
+                    if (!iter->second.errors.count(j)) {
+                        have.insert(j.shard);
+                        dout(20) << __func__ << " have shard=" << j.shard << dendl;
+                    }
+                }
+            } else {
+                for (map<pg_shard_t, bufferlist>::const_iterator j =
+                         iter->second.returned.front().get<2>().begin();
+                     j != iter->second.returned.front().get<2>().end();
+                     ++j) {
+                    have.insert(j->first.shard);
+                    dout(20) << __func__ << " have shard=" << j->first.shard << dendl;
+                }
             }
             map<int, vector<pair<int, int>>> dummy_minimum;
             int err;
@@ -1306,7 +1373,10 @@ void ECBackend::handle_sub_read_reply(
                     // If we don't have enough copies, try other pg_shard_ts if available.
                     // During recovery there may be multiple osds with copies of the same shard,
                     // so getting EIO from one may result in multiple passes through this code path.
-                    if (!rop.do_redundant_reads) {
+                    // a failed direct read is redone as a decoding read by
+                    // its callback
+                    if (!rop.do_redundant_reads &&
+                        !rop.to_read.at(iter->first).direct) {
                         int r = send_all_remaining_reads(iter->first, rop);
                         if (r == 0) {
                             // We changed the rop's to_read and not incrementing is_complete
@@ -1718,13 +1788,15 @@ int ECBackend::get_min_avail_to_read_shards(
 
 int ECBackend::get_remaining_shards(
     const hobject_t &hoid,
-    const set<int> &avail,
+    const map<int, vector<pair<int, int>>> &avail,
     const set<int> &want,
     const read_result_t &result,
     map<pg_shard_t, vector<pair<int, int>>> *to_read,
+    set<int> *stale,
     bool for_recovery)
 {
     ceph_assert(to_read);
+    ceph_assert(stale);
 
     set<int> have;
     map<shard_id_t, pg_shard_t> shards;
@@ -1743,23 +1815,38 @@ int ECBackend::get_remaining_shards(
         return -EIO;
     }
 
-    set<int> shards_left;
-    for (auto p : need) {
-        if (avail.find(p.first) == avail.end()) {
-            shards_left.insert(p.first);
-        }
+    map<int, vector<pair<int, int>>> remaining;
+    get_remaining_reads(need, avail, &remaining, stale);
+    for (auto &&p : remaining) {
+        ceph_assert(shards.count(shard_id_t(p.first)));
+        to_read->insert(make_pair(shards[shard_id_t(p.first)], p.second));
     }
+    return 0;
+}
 
-    vector<pair<int, int>> subchunks;
-    subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
-    for (set<int>::iterator i = shards_left.begin();
-         i != shards_left.end();
-         ++i) {
-        ceph_assert(shards.count(shard_id_t(*i)));
-        ceph_assert(avail.find(*i) == avail.end());
-        to_read->insert(make_pair(shards[shard_id_t(*i)], subchunks));
+void ECBackend::get_remaining_reads(
+    const map<int, vector<pair<int, int>>> &need,
+    const map<int, vector<pair<int, int>>> &avail,
+    map<int, vector<pair<int, int>>> *to_read,
+    set<int> *stale)
+{
+    // read the new helpers with the sub-chunks the new plan asks for, so a
+    // CLAY repair which lost a helper still only transfers the repair planes
+    for (auto &&p : need) {
+        auto a = avail.find(p.first);
+        if (a != avail.end() && a->second == p.second) {
+            continue;
+        }
+        if (a != avail.end()) {
+            stale->insert(p.first);
+        }
+        to_read->insert(p);
+    }
+    for (auto &&a : avail) {
+        if (!need.count(a.first)) {
+            stale->insert(a.first);
+        }
     }
-    return 0;
 }
 
 void ECBackend::start_read_op(
@@ -1813,11 +1900,28 @@ void ECBackend::do_read_op(ReadOp &op)
             messages[j->first].subchunks[i->first] = j->second;
             op.obj_to_source[i->first].insert(j->first);
             op.source_to_obj[j->first].insert(i->first);
+            op.obj_to_subchunks[i->first][j->first] = j->second;
         }
         for (list<boost::tuple<uint64_t, uint64_t, uint32_t> >::const_iterator j =
                  i->second.to_read.begin();
              j != i->second.to_read.end();
              ++j) {
+            if (i->second.direct) {
+                for (auto k = i->second.need.begin();
+                     k != i->second.need.end();
+                     ++k) {
+                    pair<uint64_t, uint64_t> range =
+                        get_direct_read_range(k->first.shard, *j);
+                    if (range.second) {
+                        messages[k->first].to_read[i->first].push_back(
+                            boost::make_tuple(
+                                range.first,
+                                range.second,
+                                j->get<2>()));
+                    }
+                }
+                continue;
+            }
             pair<uint64_t, uint64_t> chunk_off_len =
                 sinfo.aligned_offset_len_to_chunk(make_pair(j->get<0>(), j->get<1>()));
             for (auto k = i->second.need.begin();
@@ -1951,6 +2055,178 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
     check_ops();
 }
 
+const ECBackend::Op *ECBackend::get_delta_write_in_flight(const Op &op) const
+{
+    // a delta write bypasses the cache, so the chunks it writes cannot be
+    // pinned for later rmw reads: those wait until it committed
+    for (auto *ops : {&waiting_reads, &waiting_commit}) {
+        for (auto &&i : *ops) {
+            if (!i.delta_write) {
+                continue;
+            }
+            for (auto &&hpair : op.plan.to_read) {
+                if (i.plan.delta_writes.count(hpair.first)) {
+                    return &i;
+                }
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool ECBackend::get_delta_write_shards(
+    const Op &op,
+    map<hobject_t, map<pg_shard_t, vector<pair<int, int>>>> *shards)
+{
+    if (!cct->_conf.get_val<bool>("osd_ec_partial_stripe_delta_writes") ||
+        !ec_impl->supports_parity_delta()) {
+        return false;
+    }
+    for (auto &&hpair : op.plan.to_read) {
+        auto iter = op.plan.delta_writes.find(hpair.first);
+        if (iter == op.plan.delta_writes.end()) {
+            return false;
+        }
+        // in-flight writes to the object are only visible through the cache
+        if (cache.contains_object(hpair.first)) {
+            dout(20) << __func__ << ": " << hpair.first
+                     << " has writes in flight" << dendl;
+            return false;
+        }
+        set<int> want = ECTransaction::get_delta_shards(
+                            sinfo, ec_impl, iter->second);
+        if (want.size() >= ec_impl->get_chunk_count()) {
+            return false;
+        }
+        // each of them must be read: minimum_to_decode would substitute
+        // other shards for missing ones
+        auto &need = (*shards)[hpair.first];
+        if (get_min_avail_to_read_shards(
+                hpair.first, want, false, false, &need) < 0 ||
+            need.size() != want.size()) {
+            return false;
+        }
+        for (auto &&i : need) {
+            if (!want.count(i.first.shard)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct DeltaReadComplete :
+    public GenContext<pair<RecoveryMessages *, ECBackend::read_result_t & > &> {
+    ECBackend *ec;
+    ceph_tid_t tid;
+    hobject_t hoid;
+    set<int> want;
+    DeltaReadComplete(
+        ECBackend *ec,
+        ceph_tid_t tid,
+        const hobject_t &hoid,
+        const set<int> &want)
+        : ec(ec), tid(tid), hoid(hoid), want(want) {}
+    void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override
+    {
+        auto iter = ec->tid_to_op_map.find(tid);
+        ceph_assert(iter != ec->tid_to_op_map.end());
+        ECBackend::Op *op = &(iter->second);
+        ECBackend::read_result_t &res = in.second;
+        bool ok = res.r == 0;
+        auto &result = op->delta_read_result[hoid];
+        for (auto &&extent : res.returned) {
+            if (!ok) {
+                break;
+            }
+            pair<uint64_t, uint64_t> chunk_off_len =
+                ec->sinfo.aligned_offset_len_to_chunk(
+                    make_pair(extent.get<0>(), extent.get<1>()));
+            for (auto &&shard : want) {
+                auto biter = std::find_if(
+                                 extent.get<2>().begin(), extent.get<2>().end(),
+                [&](const auto &i) {
+                    return i.first.shard == shard;
+                });
+                if (biter == extent.get<2>().end() ||
+                    biter->second.length() != chunk_off_len.second) {
+                    ok = false;
+                    break;
+                }
+                result[shard].insert(
+                    chunk_off_len.first, chunk_off_len.second, biter->second);
+            }
+        }
+        ec->finish_delta_read(op, ok);
+    }
+};
+
+void ECBackend::start_delta_reads(
+    Op *op,
+    map<hobject_t, map<pg_shard_t, vector<pair<int, int>>>> &shards)
+{
+    map<hobject_t, set<int>> want_to_read;
+    map<hobject_t, read_request_t> for_read_op;
+    for (auto &&hpair : op->plan.to_read) {
+        list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+        for (auto &&extent : hpair.second) {
+            to_read.push_back(boost::make_tuple(extent.first, extent.second, 0));
+        }
+        auto &need = shards.at(hpair.first);
+        set<int> want;
+        for (auto &&i : need) {
+            want.insert(i.first.shard);
+        }
+        for_read_op.insert(
+                       make_pair(
+                           hpair.first,
+                           read_request_t(
+                               to_read,
+                               need,
+                               false,
+                               new DeltaReadComplete(this, op->tid, hpair.first, want))));
+        want_to_read.insert(make_pair(hpair.first, std::move(want)));
+    }
+    op->delta_reads_pending = for_read_op.size();
+    start_read_op(
+        CEPH_MSG_PRIO_DEFAULT,
+        want_to_read,
+        for_read_op,
+        OpRequestRef(),
+        false, false);
+}
+
+void ECBackend::finish_delta_read(Op *op, bool ok)
+{
+    ceph_assert(op->delta_reads_pending);
+    if (!ok) {
+        op->delta_read_failed = true;
+    }
+    if (--op->delta_reads_pending) {
+        return;
+    }
+    if (op->delta_read_failed) {
+        // Re-encode the stripes instead.  The op stays a delta_write so
+        // later rmw ops keep waiting for it, as it still bypasses the
+        // cache.
+        dout(10) << __func__ << ": delta reads failed, reading whole stripes for "
+                 << *op << dendl;
+        op->delta_read_failed = false;
+        op->delta_read_result.clear();
+        op->remote_read = op->plan.to_read;
+        objects_read_async_no_cache(
+            op->remote_read,
+        [this, op](map<hobject_t, pair<int, extent_map> > &&results) {
+            for (auto &&i : results) {
+                op->remote_read_result.emplace(i.first, i.second.second);
+            }
+            check_ops();
+        });
+        return;
+    }
+    check_ops();
+}
+
 bool ECBackend::try_state_to_reads()
 {
     if (waiting_state.empty()) {
@@ -1967,17 +2243,38 @@ bool ECBackend::try_state_to_reads()
         return false;
     }
 
+    if (op->requires_rmw()) {
+        if (const Op *delta = get_delta_write_in_flight(*op)) {
+            dout(20) << __func__ << ": blocking " << *op
+                     << " because it requires an rmw and delta write "
+                     << delta->tid << " to the same object has not committed"
+                     << dendl;
+            return false;
+        }
+    }
+
+    map<hobject_t, map<pg_shard_t, vector<pair<int, int>>>> delta_shards;
     if (!pipeline_state.caching_enabled()) {
         op->using_cache = false;
     } else if (op->invalidates_cache()) {
         dout(20) << __func__ << ": invalidating cache after this op"
                  << dendl;
         pipeline_state.invalidate();
+    } else if (op->requires_rmw() &&
+               get_delta_write_shards(*op, &delta_shards)) {
+        op->using_cache = false;
+        op->delta_write = true;
     }
 
     waiting_state.pop_front();
     waiting_reads.push_back(*op);
 
+    if (op->delta_write) {
+        dout(10) << __func__ << ": " << *op << dendl;
+        start_delta_reads(op, delta_shards);
+        return true;
+    }
+
     if (op->using_cache) {
         cache.open_write_pin(op->pin);
 
@@ -2076,6 +2373,7 @@ bool ECBackend::try_reads_to_commit()
             get_parent()->get_info().pgid.pgid,
             sinfo,
             op->remote_read_result,
+            op->delta_read_result,
             op->log_entries,
             &written,
             &trans,
@@ -2104,7 +2402,16 @@ bool ECBackend::try_reads_to_commit()
         written_set[i.first] = i.second.get_interval_set();
     }
     dout(20) << __func__ << ": written_set: " << written_set << dendl;
-    ceph_assert(written_set == op->plan.will_write);
+    if (op->delta_read_result.empty()) {
+        ceph_assert(written_set == op->plan.will_write);
+    } else {
+        // stripes updated from deltas are not written out in full
+        auto will_write = op->plan.will_write;
+        for (auto &&hpair : op->delta_read_result) {
+            will_write[hpair.first].subtract(op->plan.to_read.at(hpair.first));
+        }
+        ceph_assert(written_set == will_write);
+    }
 
     if (op->using_cache) {
         for (auto &&hpair : written) {
@@ -2114,6 +2421,7 @@ bool ECBackend::try_reads_to_commit()
     }
     op->remote_read.clear();
     op->remote_read_result.clear();
+    op->delta_read_result.clear();
 
     ObjectStore::Transaction empty;
     bool should_write_local = false;
@@ -2272,6 +2580,8 @@ void ECBackend::objects_read_async(
     map<hobject_t, std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > >
     reads;
 
+    // objects_read_and_reconstruct widens these to whole stripes only
+    // when it has to decode them
     uint32_t flags = 0;
     extent_set es;
     for (list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
@@ -2279,11 +2589,7 @@ void ECBackend::objects_read_async(
              to_read.begin();
          i != to_read.end();
          ++i) {
-        pair<uint64_t, uint64_t> tmp =
-            sinfo.offset_len_to_stripe_bounds(
-                make_pair(i->first.get<0>(), i->first.get<1>()));
-
-        es.union_insert(tmp.first, tmp.second);
+        es.union_insert(i->first.get<0>(), i->first.get<1>());
         flags |= i->first.get<2>();
     }
 
@@ -2390,32 +2696,55 @@ struct CallClientContexts :
     ECBackend *ec;
     ECBackend::ClientAsyncReadStatus *status;
     list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    bool fast_read;
+    bool direct;
     CallClientContexts(
         hobject_t hoid,
         ECBackend *ec,
         ECBackend::ClientAsyncReadStatus *status,
-        const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read)
-        : hoid(hoid), ec(ec), status(status), to_read(to_read) {}
-    void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override
+        const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+        bool fast_read,
+        bool direct)
+        : hoid(hoid), ec(ec), status(status), to_read(to_read),
+          fast_read(fast_read), direct(direct) {}
+    int reassemble(ECBackend::read_result_t &res, extent_map *result)
     {
-        ECBackend::read_result_t &res = in.second;
-        extent_map result;
-        if (res.r != 0) {
-            goto out;
-        }
         ceph_assert(res.returned.size() == to_read.size());
         ceph_assert(res.errors.empty());
         for (auto &&read : to_read) {
-            pair<uint64_t, uint64_t> adjusted =
-                ec->sinfo.offset_len_to_stripe_bounds(
-                    make_pair(read.get<0>(), read.get<1>()));
-            ceph_assert(res.returned.front().get<0>() == adjusted.first);
-            ceph_assert(res.returned.front().get<1>() == adjusted.second);
+            ceph_assert(res.returned.front().get<0>() == read.get<0>());
+            ceph_assert(res.returned.front().get<1>() == read.get<1>());
+            map<int, bufferlist> shards;
+            for (auto &&j : res.returned.front().get<2>()) {
+                shards[j.first.shard] = std::move(j.second);
+            }
+            bufferlist bl;
+            int r = ECUtil::reassemble_extent(
+                        ec->sinfo,
+                        ec->ec_impl,
+                        make_pair(read.get<0>(), read.get<1>()),
+                        shards,
+                        &bl);
+            if (r < 0) {
+                return r;
+            }
+            if (bl.length()) {
+                result->insert(read.get<0>(), bl.length(), std::move(bl));
+            }
+            res.returned.pop_front();
+        }
+        return 0;
+    }
+    int decode(ECBackend::read_result_t &res, extent_map *result)
+    {
+        ceph_assert(res.errors.empty());
+        extent_map decoded;
+        for (auto &&extent : res.returned) {
             map<int, bufferlist> to_decode;
             bufferlist bl;
             for (map<pg_shard_t, bufferlist>::iterator j =
-                     res.returned.front().get<2>().begin();
-                 j != res.returned.front().get<2>().end();
+                     extent.get<2>().begin();
+                 j != extent.get<2>().end();
                  ++j) {
                 to_decode[j->first.shard] = std::move(j->second);
             }
@@ -2425,25 +2754,166 @@ struct CallClientContexts :
                         to_decode,
                         &bl);
             if (r < 0) {
-                res.r = r;
-                goto out;
+                return r;
             }
+            decoded.insert(extent.get<0>(), bl.length(), std::move(bl));
+        }
+        res.returned.clear();
+        for (auto &&read : to_read) {
+            auto range = decoded.get_containing_range(read.get<0>(), read.get<1>());
+            ceph_assert(range.first != range.second);
+            ceph_assert(range.first.get_off() <= read.get<0>());
             bufferlist trimmed;
             trimmed.substr_of(
-                       bl,
-                       read.get<0>() - adjusted.first,
+                       range.first.get_val(),
+                       read.get<0>() - range.first.get_off(),
                        std::min(read.get<1>(),
-                                bl.length() - (read.get<0>() - adjusted.first)));
-            result.insert(
+                                range.first.get_len() -
+                                (read.get<0>() - range.first.get_off())));
+            result->insert(
                       read.get<0>(), trimmed.length(), std::move(trimmed));
-            res.returned.pop_front();
         }
-out:
+        return 0;
+    }
+    void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override
+    {
+        ECBackend::read_result_t &res = in.second;
+        extent_map result;
+        if (res.r == 0) {
+            res.r = direct ? reassemble(res, &result) : decode(res, &result);
+        }
+        if (res.r != 0 && direct &&
+            ec->start_reconstructing_read(hoid, to_read, fast_read, status) == 0) {
+            // a data shard failed us, the stripes are read again to decode
+            // them from the others
+            ldpp_dout(ec->get_parent()->get_dpp(), 10) << __func__ << " " << hoid
+                    << " direct read failed r=" << res.r << ", reconstructing" << dendl;
+            return;
+        }
         status->complete_object(hoid, res.r, std::move(result));
         ec->kick_reads();
     }
 };
 
+bool ECBackend::get_direct_read_shards(
+    const hobject_t &hoid,
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    map<pg_shard_t, vector<pair<int, int>>> *need)
+{
+    if (!cct->_conf.get_val<bool>("osd_ec_partial_reads")) {
+        return false;
+    }
+    set<int> data_shards;
+    get_want_to_read_shards(&data_shards);
+    set<int> want;
+    for (auto &&read : to_read) {
+        for (auto &&shard : data_shards) {
+            if (get_direct_read_range(shard, read).second) {
+                want.insert(shard);
+            }
+        }
+    }
+    if (want.empty()) {
+        return false;
+    }
+
+    set<int> have;
+    map<shard_id_t, pg_shard_t> shards;
+    set<pg_shard_t> error_shards;
+    get_all_avail_shards(hoid, error_shards, have, shards, false);
+
+    vector<pair<int, int>> subchunks;
+    subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
+    for (auto &&shard : want) {
+        if (!have.count(shard)) {
+            dout(20) << __func__ << ": " << hoid << " shard " << shard
+                     << " unavailable, reconstructing" << dendl;
+            need->clear();
+            return false;
+        }
+        need->insert(make_pair(shards[shard_id_t(shard)], subchunks));
+    }
+    return true;
+}
+
+int ECBackend::add_reconstructing_read(
+    const hobject_t &hoid,
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    bool fast_read,
+    ClientAsyncReadStatus *status,
+    map<hobject_t, set<int>> *want_to_read,
+    map<hobject_t, read_request_t> *for_read_op)
+{
+    set<int> want;
+    get_want_to_read_shards(&want);
+
+    map<pg_shard_t, vector<pair<int, int>>> shards;
+    int r = get_min_avail_to_read_shards(
+                hoid,
+                want,
+                false,
+                fast_read,
+                &shards);
+    if (r < 0) {
+        return r;
+    }
+
+    uint32_t flags = 0;
+    extent_set es;
+    for (auto &&read : to_read) {
+        pair<uint64_t, uint64_t> tmp =
+            sinfo.offset_len_to_stripe_bounds(
+                make_pair(read.get<0>(), read.get<1>()));
+        es.union_insert(tmp.first, tmp.second);
+        flags |= read.get<2>();
+    }
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > stripes;
+    for (auto &&extent : es) {
+        stripes.push_back(boost::make_tuple(extent.first, extent.second, flags));
+    }
+
+    CallClientContexts *c = new CallClientContexts(
+        hoid,
+        this,
+        status,
+        to_read,
+        fast_read,
+        false);
+    for_read_op->insert(
+                   make_pair(
+                       hoid,
+                       read_request_t(
+                           stripes,
+                           shards,
+                           false,
+                           c)));
+    want_to_read->insert(make_pair(hoid, want));
+    return 0;
+}
+
+int ECBackend::start_reconstructing_read(
+    const hobject_t &hoid,
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    bool fast_read,
+    ClientAsyncReadStatus *status)
+{
+    map<hobject_t, set<int>> want_to_read;
+    map<hobject_t, read_request_t> for_read_op;
+    int r = add_reconstructing_read(
+                hoid, to_read, fast_read, status, &want_to_read, &for_read_op);
+    if (r < 0) {
+        return r;
+    }
+    dout(10) << __func__ << ": " << hoid << dendl;
+    start_read_op(
+        CEPH_MSG_PRIO_DEFAULT,
+        want_to_read,
+        for_read_op,
+        OpRequestRef(),
+        fast_read, false);
+    return 0;
+}
+
 void ECBackend::objects_read_and_reconstruct(
     const map<hobject_t,
     std::list<boost::tuple<uint64_t, uint64_t, uint32_t> >
@@ -2459,42 +2929,64 @@ void ECBackend::objects_read_and_reconstruct(
     }
 
     map<hobject_t, set<int>> obj_want_to_read;
-    set<int> want_to_read;
-    get_want_to_read_shards(&want_to_read);
-
     map<hobject_t, read_request_t> for_read_op;
+    map<hobject_t, set<int>> direct_want_to_read;
+    map<hobject_t, read_request_t> for_direct_read_op;
     for (auto &&to_read : reads) {
         map<pg_shard_t, vector<pair<int, int>>> shards;
-        int r = get_min_avail_to_read_shards(
+        if (get_direct_read_shards(to_read.first, to_read.second, &shards)) {
+            // every data shard we need is there: ask each of them for just
+            // its part of the extents, there is nothing to decode
+            set<int> want;
+            for (auto &&i : shards) {
+                want.insert(i.first.shard);
+            }
+            CallClientContexts *c = new CallClientContexts(
+                to_read.first,
+                this,
+                &(in_progress_client_reads.back()),
+                to_read.second,
+                fast_read,
+                true);
+            for_direct_read_op.insert(
+                                  make_pair(
+                                      to_read.first,
+                                      read_request_t(
+                                          to_read.second,
+                                          shards,
+                                          false,
+                                          c,
+                                          true)));
+            direct_want_to_read.insert(make_pair(to_read.first, want));
+            continue;
+        }
+
+        int r = add_reconstructing_read(
                     to_read.first,
-                    want_to_read,
-                    false,
+                    to_read.second,
                     fast_read,
-                    &shards);
+                    &(in_progress_client_reads.back()),
+                    &obj_want_to_read,
+                    &for_read_op);
         ceph_assert(r == 0);
-
-        CallClientContexts *c = new CallClientContexts(
-            to_read.first,
-            this,
-            &(in_progress_client_reads.back()),
-            to_read.second);
-        for_read_op.insert(
-                       make_pair(
-                           to_read.first,
-                           read_request_t(
-                               to_read.second,
-                               shards,
-                               false,
-                               c)));
-        obj_want_to_read.insert(make_pair(to_read.first, want_to_read));
     }
 
-    start_read_op(
-        CEPH_MSG_PRIO_DEFAULT,
-        obj_want_to_read,
-        for_read_op,
-        OpRequestRef(),
-        fast_read, false);
+    if (!for_direct_read_op.empty()) {
+        start_read_op(
+            CEPH_MSG_PRIO_DEFAULT,
+            direct_want_to_read,
+            for_direct_read_op,
+            OpRequestRef(),
+            false, false);
+    }
+    if (!for_read_op.empty()) {
+        start_read_op(
+            CEPH_MSG_PRIO_DEFAULT,
+            obj_want_to_read,
+            for_read_op,
+            OpRequestRef(),
+            fast_read, false);
+    }
     return;
 }
 
@@ -2503,19 +2995,59 @@ int ECBackend::send_all_remaining_reads(
     const hobject_t &hoid,
     ReadOp &rop)
 {
-    set<int> already_read;
+    map<int, vector<pair<int, int>>> already_read;
     const set<pg_shard_t> &ots = rop.obj_to_source[hoid];
+    const auto &subchunks = rop.obj_to_subchunks[hoid];
     for (set<pg_shard_t>::iterator i = ots.begin(); i != ots.end(); ++i) {
-        already_read.insert(i->shard);
+        auto s = subchunks.find(*i);
+        ceph_assert(s != subchunks.end());
+        already_read[i->shard] = s->second;
     }
     dout(10) << __func__ << " have/error shards=" << already_read << dendl;
     map<pg_shard_t, vector<pair<int, int>>> shards;
+    set<int> stale;
     int r = get_remaining_shards(hoid, already_read, rop.want_to_read[hoid],
-                                 rop.complete[hoid], &shards, rop.for_recovery);
+                                 rop.complete[hoid], &shards, &stale,
+                                 rop.for_recovery);
     if (r) {
         return r;
     }
 
+    // buffers holding other sub-chunks than the new plan decodes from would
+    // not line up with the rest; drop them, the shard is read again if needed.
+    // Forget the shard as a source too, so a later failure doesn't count it
+    // as already read and a down osd doesn't cancel a read it no longer serves
+    if (!stale.empty()) {
+        dout(10) << __func__ << " dropping stale shards=" << stale << dendl;
+        for (auto &&extent : rop.complete[hoid].returned) {
+            auto &bufs = extent.get<2>();
+            for (auto b = bufs.begin(); b != bufs.end();) {
+                if (stale.count(b->first.shard)) {
+                    b = bufs.erase(b);
+                } else {
+                    ++b;
+                }
+            }
+        }
+        auto &sources = rop.obj_to_source[hoid];
+        auto &subchunks = rop.obj_to_subchunks[hoid];
+        for (auto i = sources.begin(); i != sources.end();) {
+            if (!stale.count(i->shard)) {
+                ++i;
+                continue;
+            }
+            subchunks.erase(*i);
+            auto s = rop.source_to_obj.find(*i);
+            if (s != rop.source_to_obj.end()) {
+                s->second.erase(hoid);
+                if (s->second.empty()) {
+                    rop.source_to_obj.erase(s);
+                }
+            }
+            i = sources.erase(i);
+        }
+    }
+
     list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets =
         rop.to_read.find(hoid)->second.to_read;
     GenContext<pair<RecoveryMessages *, read_result_t & > &> *c =
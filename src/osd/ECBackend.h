@@ -132,6 +132,11 @@ public:
      * maintain a queue of in progress reads (@see in_progress_client_reads)
      * to ensure that we always call the completion callback in order.
      *
+     * When every data shard an object's extents touch is available, only
+     * those shards are read, and only the byte ranges of the extents they
+     * hold, without decoding.  Otherwise, or if one of them fails, the
+     * surrounding stripes are read from enough shards to decode them.
+     *
      * Another subtly is that while we may read a degraded object, we will
      * still only perform a client read from shards in the acting std::set.  This
      * ensures that we won't ever have to restart a client initiated read in
@@ -224,6 +229,22 @@ private:
         }
     }
 
+    /// the range of chunk offsets a direct read of extent asks shard for
+    std::pair<uint64_t, uint64_t> get_direct_read_range(
+        int shard,
+        const boost::tuple<uint64_t, uint64_t, uint32_t> &extent) const
+    {
+        const std::vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+        for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i) {
+            int chunk = (int)chunk_mapping.size() > i ? chunk_mapping[i] : i;
+            if (chunk == shard) {
+                return sinfo.offset_len_to_chunk_range(
+                           i, std::make_pair(extent.get<0>(), extent.get<1>()));
+            }
+        }
+        return std::make_pair(0, 0);
+    }
+
     /**
      * Recovery
      *
@@ -360,13 +381,18 @@ public:
         std::map<pg_shard_t, std::vector<std::pair<int, int>>> need;
         bool want_attrs;
         GenContext<std::pair<RecoveryMessages *, read_result_t & > &> *cb;
+        // to_read need not be stripe aligned: each data shard in need is
+        // only asked for the part of the extents stored on it, nothing is
+        // decoded (@see get_direct_read_range)
+        bool direct;
         read_request_t(
             const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
             const std::map<pg_shard_t, std::vector<std::pair<int, int>>> &need,
             bool want_attrs,
-            GenContext<std::pair<RecoveryMessages *, read_result_t & > &> *cb)
+            GenContext<std::pair<RecoveryMessages *, read_result_t & > &> *cb,
+            bool direct = false)
             : to_read(to_read), need(need), want_attrs(want_attrs),
-              cb(cb) {}
+              cb(cb), direct(direct) {}
     };
     friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -390,6 +416,9 @@ public:
 
         std::map<hobject_t, std::set<pg_shard_t>> obj_to_source;
         std::map<pg_shard_t, std::set<hobject_t> > source_to_obj;
+        /// sub-chunks requested from each source, per object
+        std::map<hobject_t,
+                 std::map<pg_shard_t, std::vector<std::pair<int, int>>>> obj_to_subchunks;
 
         void dump(ceph::Formatter *f) const;
 
@@ -442,6 +471,29 @@ public:
         const hobject_t &hoid,
         ReadOp &rop);
 
+    /**
+     * The data shards holding the extents of to_read, when all of them
+     * are available so that a direct read needs no reconstruction.
+     */
+    bool get_direct_read_shards(
+        const hobject_t &hoid,
+        const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+        std::map<pg_shard_t, std::vector<std::pair<int, int>>> *need);
+
+    /// reads the stripes around to_read from enough shards to decode them
+    int add_reconstructing_read(
+        const hobject_t &hoid,
+        const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+        bool fast_read,
+        ClientAsyncReadStatus *status,
+        std::map<hobject_t, std::set<int>> *want_to_read,
+        std::map<hobject_t, read_request_t> *for_read_op);
+    int start_reconstructing_read(
+        const hobject_t &hoid,
+        const std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+        bool fast_read,
+        ClientAsyncReadStatus *status);
+
 
     /**
      * Client writes
@@ -490,16 +542,27 @@ public:
             return plan.invalidates_cache;
         }
 
-        // must be true if requires_rmw(), must be false if invalidates_cache()
+        // must be true if requires_rmw() unless delta_write, must be false
+        // if invalidates_cache()
         bool using_cache = true;
 
+        // Partial stripe overwrite updating parity from deltas, bypassing
+        // the cache; later rmw ops on its objects wait until it committed.
+        // See try_state_to_reads.
+        bool delta_write = false;
+
         /// In progress read state;
         std::map<hobject_t, extent_set> pending_read; // subset already being read
         std::map<hobject_t, extent_set> remote_read; // subset we must read
         std::map<hobject_t, extent_map> remote_read_result;
+        /// shard -> chunk extents read for delta_write, empty to re-encode
+        std::map<hobject_t, std::map<int, extent_map>> delta_read_result;
+        unsigned delta_reads_pending = 0;
+        bool delta_read_failed = false;
         bool read_in_progress() const
         {
-            return !remote_read.empty() && remote_read_result.empty();
+            return delta_reads_pending ||
+                   (!remote_read.empty() && remote_read_result.empty());
         }
 
         /// In progress write state.
@@ -585,6 +648,16 @@ public:
     eversion_t completed_to;
     eversion_t committed_to;
     void start_rmw(Op *op, PGTransactionUPtr &&t);
+    /// an uncommitted delta write to one of the objects op must read
+    const Op *get_delta_write_in_flight(const Op &op) const;
+    bool get_delta_write_shards(
+        const Op &op,
+        std::map<hobject_t, std::map<pg_shard_t, std::vector<std::pair<int, int>>>> *shards);
+    void start_delta_reads(
+        Op *op,
+        std::map<hobject_t, std::map<pg_shard_t, std::vector<std::pair<int, int>>>> &shards);
+    friend struct DeltaReadComplete;
+    void finish_delta_read(Op *op, bool ok);
     bool try_state_to_reads();
     bool try_reads_to_commit();
     bool try_finish_rmw();
@@ -684,14 +757,29 @@ public:
         std::map<pg_shard_t, std::vector<std::pair<int, int>>> *to_read   ///< [out] shards, corresponding subchunks to read
     ); ///< @return error code, 0 on success
 
+    /// Returns the shards (and sub-chunks) still to read to reconstruct
+    /// want once some of the shards in avail failed.  A shard already read
+    /// with other sub-chunks than the new plan needs (a CLAY repair falling
+    /// back to a full decode) is read again and reported in stale, as are
+    /// the shards the new plan does not use at all.
     int get_remaining_shards(
         const hobject_t &hoid,
-        const std::set<int> &avail,
+        const std::map<int, std::vector<std::pair<int, int>>> &avail,
         const std::set<int> &want,
         const read_result_t &result,
         std::map<pg_shard_t, std::vector<std::pair<int, int>>> *to_read,
+        std::set<int> *stale,
         bool for_recovery);
 
+    /// Splits a new read plan need against the sub-chunks already read
+    /// (avail) into the shards to (re)read and the stale shards whose
+    /// buffers the new plan cannot use.
+    static void get_remaining_reads(
+        const std::map<int, std::vector<std::pair<int, int>>> &need,
+        const std::map<int, std::vector<std::pair<int, int>>> &avail,
+        std::map<int, std::vector<std::pair<int, int>>> *to_read,
+        std::set<int> *stale);
+
     int objects_get_attrs(
         const hobject_t &hoid,
         std::map<std::string, ceph::buffer::list, std::less<>> *out) override;
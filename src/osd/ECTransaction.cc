@@ -94,12 +94,148 @@ void encode_and_write(
     }
 }
 
+static bufferlist get_shard_extent(
+    const map<int, extent_map> &shards,
+    int shard,
+    uint64_t off,
+    uint64_t len)
+{
+    auto iter = shards.find(shard);
+    ceph_assert(iter != shards.end());
+    bufferlist bl;
+    for (auto &&extent : iter->second.intersect(off, len)) {
+        ceph_assert(extent.get_off() == off + bl.length());
+        bl.append(extent.get_val());
+    }
+    ceph_assert(bl.length() == len);
+    return bl;
+}
+
+void ECTransaction::delta_and_write(
+    pg_t pgid,
+    const hobject_t &oid,
+    const ECUtil::stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ecimpl,
+    uint64_t offset,
+    uint64_t length,
+    const extent_map &to_write,
+    const map<int, extent_map> &old_shards,
+    uint32_t flags,
+    map<shard_id_t, ObjectStore::Transaction> *transactions,
+    DoutPrefixProvider *dpp)
+{
+    ceph_assert(sinfo.logical_offset_is_stripe_aligned(offset));
+    ceph_assert(sinfo.logical_offset_is_stripe_aligned(length));
+
+    const uint64_t chunk_size = sinfo.get_chunk_size();
+    const vector<int> &chunk_mapping = ecimpl->get_chunk_mapping();
+    const unsigned k = ecimpl->get_data_chunk_count();
+    for (uint64_t stripe = offset;
+         stripe < offset + length;
+         stripe += sinfo.get_stripe_width()) {
+        const uint64_t chunk_off =
+            sinfo.aligned_logical_offset_to_chunk_offset(stripe);
+        map<int, bufferlist> new_chunks;
+        map<int, bufferlist> data_delta;
+        for (unsigned i = 0; i < k; ++i) {
+            const uint64_t chunk_start = stripe + i * chunk_size;
+            auto updates = to_write.intersect(chunk_start, chunk_size);
+            if (updates.empty()) {
+                continue;
+            }
+            int shard = (int)chunk_mapping.size() > (int)i ? chunk_mapping[i] : i;
+            bufferlist old_bl = get_shard_extent(
+                                    old_shards, shard, chunk_off, chunk_size);
+            bufferlist new_bl;
+            uint64_t pos = chunk_start;
+            for (auto &&update : updates) {
+                if (update.get_off() > pos) {
+                    bufferlist keep;
+                    keep.substr_of(old_bl, pos - chunk_start, update.get_off() - pos);
+                    new_bl.claim_append(keep);
+                }
+                new_bl.append(update.get_val());
+                pos = update.get_off() + update.get_len();
+            }
+            if (pos < chunk_start + chunk_size) {
+                bufferlist keep;
+                keep.substr_of(old_bl, pos - chunk_start,
+                               chunk_start + chunk_size - pos);
+                new_bl.claim_append(keep);
+            }
+            data_delta[shard] = ECUtil::buffer_xor(old_bl, new_bl);
+            new_chunks[shard] = std::move(new_bl);
+        }
+        if (new_chunks.empty()) {
+            continue;
+        }
+
+        map<int, bufferlist> parity_delta;
+        int r = ECUtil::encode_parity_delta(
+                    sinfo, ecimpl, data_delta, &parity_delta);
+        ceph_assert(r == 0);
+        for (auto &&[shard, delta] : parity_delta) {
+            new_chunks[shard] = ECUtil::buffer_xor(
+                                    get_shard_extent(
+                                        old_shards, shard, chunk_off, chunk_size),
+                                    delta);
+        }
+
+        ldpp_dout(dpp, 20) << __func__ << ": " << oid
+                           << " stripe " << stripe
+                           << " updating shards " << new_chunks.size()
+                           << dendl;
+        for (auto &&[shard, bl] : new_chunks) {
+            auto iter = transactions->find(shard_id_t(shard));
+            if (iter == transactions->end()) {
+                continue;
+            }
+            iter->second.write(
+                coll_t(spg_t(pgid, iter->first)),
+                ghobject_t(oid, ghobject_t::NO_GEN, iter->first),
+                chunk_off,
+                bl.length(),
+                bl,
+                flags);
+        }
+    }
+}
+
+set<int> ECTransaction::get_delta_shards(
+    const ECUtil::stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ecimpl,
+    const extent_set &written)
+{
+    const uint64_t chunk_size = sinfo.get_chunk_size();
+    const vector<int> &chunk_mapping = ecimpl->get_chunk_mapping();
+    auto chunk_to_shard = [&](int chunk) {
+        return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+    };
+
+    set<int> shards;
+    for (auto &&extent : written) {
+        const uint64_t end = extent.first + extent.second;
+        for (uint64_t off = extent.first; off < end;
+             off = (off / chunk_size + 1) * chunk_size) {
+            shards.insert(chunk_to_shard(
+                              (off % sinfo.get_stripe_width()) / chunk_size));
+        }
+    }
+    for (unsigned i = ecimpl->get_data_chunk_count();
+         i < ecimpl->get_chunk_count();
+         ++i) {
+        shards.insert(chunk_to_shard(i));
+    }
+    return shards;
+}
+
 void ECTransaction::generate_transactions(
     WritePlan &plan,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t, extent_map> &partial_extents,
+    const map<hobject_t, map<int, extent_map>> &delta_reads,
     vector<pg_log_entry_t> &entries,
     map<hobject_t, extent_map> *written_map,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -544,6 +680,63 @@ void ECTransaction::generate_transactions(
         for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
             want.insert(i);
         }
+        auto save_rollback_extent = [&](uint64_t off, uint64_t len) {
+            if (!entry) {
+                return;
+            }
+            uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
+                                        off);
+            uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
+                                       len);
+            ldpp_dout(dpp, 20) << "generate_transactions: overwriting "
+                               << restore_from << "~" << restore_len
+                               << dendl;
+            if (rollback_extents.empty()) {
+                for (auto &&st : *transactions) {
+                    st.second.touch(
+                          coll_t(spg_t(pgid, st.first)),
+                          ghobject_t(oid, entry->version.version, st.first));
+                }
+            }
+            rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+            // every shard saves the extent, even those a delta write leaves
+            // alone, so that rolling back the extent is the same everywhere
+            for (auto &&st : *transactions) {
+                st.second.clone_range(
+                      coll_t(spg_t(pgid, st.first)),
+                      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+                      ghobject_t(oid, entry->version.version, st.first),
+                      restore_from,
+                      restore_len,
+                      restore_from);
+            }
+        };
+
+        auto delta_iter = delta_reads.find(oid);
+        if (delta_iter != delta_reads.end()) {
+            auto stripes_iter = plan.to_read.find(oid);
+            ceph_assert(stripes_iter != plan.to_read.end());
+            for (auto &&stripes : stripes_iter->second) {
+                ldpp_dout(dpp, 20) << "generate_transactions: delta overwrite "
+                                   << stripes.first << "~" << stripes.second
+                                   << dendl;
+                save_rollback_extent(stripes.first, stripes.second);
+                delta_and_write(
+                    pgid,
+                    oid,
+                    sinfo,
+                    ecimpl,
+                    stripes.first,
+                    stripes.second,
+                    to_write.intersect(stripes.first, stripes.second),
+                    delta_iter->second,
+                    fadvise_flags,
+                    transactions,
+                    dpp);
+                to_write.erase(stripes.first, stripes.second);
+            }
+        }
+
         auto to_overwrite = to_write.intersect(0, append_after);
         ldpp_dout(dpp, 20) << "generate_transactions: to_overwrite: "
                            << to_overwrite
@@ -552,32 +745,7 @@ void ECTransaction::generate_transactions(
             ceph_assert(extent.get_off() + extent.get_len() <= append_after);
             ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.get_off()));
             ceph_assert(sinfo.logical_offset_is_stripe_aligned(extent.get_len()));
-            if (entry) {
-                uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
-                                            extent.get_off());
-                uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
-                                           extent.get_len());
-                ldpp_dout(dpp, 20) << "generate_transactions: overwriting "
-                                   << restore_from << "~" << restore_len
-                                   << dendl;
-                if (rollback_extents.empty()) {
-                    for (auto &&st : *transactions) {
-                        st.second.touch(
-                              coll_t(spg_t(pgid, st.first)),
-                              ghobject_t(oid, entry->version.version, st.first));
-                    }
-                }
-                rollback_extents.emplace_back(make_pair(restore_from, restore_len));
-                for (auto &&st : *transactions) {
-                    st.second.clone_range(
-                          coll_t(spg_t(pgid, st.first)),
-                          ghobject_t(oid, ghobject_t::NO_GEN, st.first),
-                          ghobject_t(oid, entry->version.version, st.first),
-                          restore_from,
-                          restore_len,
-                          restore_from);
-                }
-            }
+            save_rollback_extent(extent.get_off(), extent.get_len());
             encode_and_write(
                 pgid,
                 oid,
@@ -30,9 +30,43 @@ struct WritePlan {
     std::map<hobject_t, extent_set> to_read;
     std::map<hobject_t, extent_set> will_write; // superset of to_read
 
+    // Objects whose partial stripes (to_read) are only overwritten, with
+    // the logical extents written within them.  If the plugin supports
+    // it, these stripes may be updated from parity deltas, reading and
+    // writing only the touched data shards and the parity shards.
+    std::map<hobject_t, extent_set> delta_writes;
+
     std::map<hobject_t, ECUtil::HashInfoRef> hash_infos;
 };
 
+/// shards to read and write to update @p written (see
+/// WritePlan::delta_writes) from parity deltas
+std::set<int> get_delta_shards(
+    const ECUtil::stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ecimpl,
+    const extent_set &written);
+
+/**
+ * Overwrite part of the stripes in [offset, offset + length) without
+ * re-encoding them: for each data chunk touched by to_write, compute
+ * the new chunk and its delta from old_shards (the chunks read from
+ * the touched data shards and the parity shards), derive the parity
+ * deltas from the data deltas and write only the touched data chunks
+ * and the updated parity chunks.
+ */
+void delta_and_write(
+    pg_t pgid,
+    const hobject_t &oid,
+    const ECUtil::stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ecimpl,
+    uint64_t offset,
+    uint64_t length,
+    const extent_map &to_write,
+    const std::map<int, extent_map> &old_shards,
+    uint32_t flags,
+    std::map<shard_id_t, ObjectStore::Transaction> *transactions,
+    DoutPrefixProvider *dpp);
+
 template <typename F>
 WritePlan get_write_plan(
     const ECUtil::stripe_info_t &sinfo,
@@ -161,6 +195,20 @@ WritePlan get_write_plan(
             projected_size = truncating_to;
         }
 
+        auto to_read_iter = plan.to_read.find(i.first);
+        if (to_read_iter != plan.to_read.end() &&
+            !i.second.deletes_first() &&
+            !i.second.is_fresh_object() &&
+            !i.second.truncate &&
+            raw_write_set.range_end() <= orig_size) {
+            extent_set delta_writes;
+            delta_writes.intersection_of(raw_write_set, to_read_iter->second);
+            ldpp_dout(dpp, 20) << __func__ << ": partial stripe overwrites "
+                               << delta_writes << " may use parity deltas"
+                               << dendl;
+            plan.delta_writes[i.first] = std::move(delta_writes);
+        }
+
         ldpp_dout(dpp, 20) << __func__ << ": " << i.first
                            << " projected size "
                            << projected_size
@@ -187,6 +235,7 @@ void generate_transactions(
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const std::map<hobject_t, extent_map> &partial_extents,
+    const std::map<hobject_t, std::map<int, extent_map>> &delta_reads,
     std::vector<pg_log_entry_t> &entries,
     std::map<hobject_t, extent_map> *written,
     std::map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -1,6 +1,7 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 
 #include <errno.h>
+#include <cstring>
 #include "include/encoding.h"
 #include "ECUtil.h"
 
@@ -167,6 +168,133 @@ int ECUtil::encode(
     return 0;
 }
 
+int ECUtil::encode_parity_delta(
+    const stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ec_impl,
+    const map<int, bufferlist> &data_delta,
+    map<int, bufferlist> *parity_delta)
+{
+    ceph_assert(ec_impl->supports_parity_delta());
+    ceph_assert(parity_delta);
+    ceph_assert(parity_delta->empty());
+    if (data_delta.empty()) {
+        return 0;
+    }
+
+    uint64_t chunk_size = sinfo.get_chunk_size();
+    uint64_t total_size = data_delta.begin()->second.length();
+    ceph_assert(total_size % chunk_size == 0);
+
+    const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    auto chunk_to_shard = [&](int chunk) {
+        return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+    };
+    unsigned k = ec_impl->get_data_chunk_count();
+    set<int> want;
+    for (unsigned i = k; i < ec_impl->get_chunk_count(); ++i) {
+        want.insert(chunk_to_shard(i));
+    }
+
+    // Encode a stripe holding the deltas, with zeros for the unchanged
+    // data chunks: by linearity its parity is the parity delta.
+    for (uint64_t off = 0; off < total_size; off += chunk_size) {
+        bufferlist stripe;
+        for (unsigned i = 0; i < k; ++i) {
+            auto iter = data_delta.find(chunk_to_shard(i));
+            if (iter == data_delta.end()) {
+                stripe.append_zero(chunk_size);
+            } else {
+                ceph_assert(iter->second.length() == total_size);
+                bufferlist bl;
+                bl.substr_of(iter->second, off, chunk_size);
+                stripe.claim_append(bl);
+            }
+        }
+        map<int, bufferlist> encoded;
+        int r = ec_impl->encode(want, stripe, &encoded);
+        if (r < 0) {
+            return r;
+        }
+        for (auto &&i : want) {
+            ceph_assert(encoded[i].length() == chunk_size);
+            (*parity_delta)[i].claim_append(encoded[i]);
+        }
+    }
+    return 0;
+}
+
+bufferlist ECUtil::buffer_xor(const bufferlist &a, const bufferlist &b)
+{
+    ceph_assert(a.length() == b.length());
+    bufferptr out = ceph::buffer::create(a.length());
+    a.cbegin().copy(a.length(), out.c_str());
+    char *dst = out.c_str();
+    for (auto &&p : b.buffers()) {
+        const char *src = p.c_str();
+        unsigned len = p.length();
+        unsigned i = 0;
+        for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+            uint64_t x, y;
+            memcpy(&x, dst + i, sizeof(x));
+            memcpy(&y, src + i, sizeof(y));
+            x ^= y;
+            memcpy(dst + i, &x, sizeof(x));
+        }
+        for (; i < len; ++i) {
+            dst[i] ^= src[i];
+        }
+        dst += len;
+    }
+    bufferlist bl;
+    bl.push_back(std::move(out));
+    return bl;
+}
+
+int ECUtil::reassemble_extent(
+    const stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ec_impl,
+    pair<uint64_t, uint64_t> in,
+    map<int, bufferlist> &shards,
+    bufferlist *out)
+{
+    uint64_t chunk_size = sinfo.get_chunk_size();
+    uint64_t stripe_width = sinfo.get_stripe_width();
+    const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    unsigned k = ec_impl->get_data_chunk_count();
+
+    // where the buffer of each data chunk starts, in chunk offsets
+    vector<uint64_t> chunk_start(k);
+    for (unsigned i = 0; i < k; ++i) {
+        chunk_start[i] = sinfo.offset_len_to_chunk_range(i, in).first;
+    }
+
+    uint64_t pos = in.first;
+    uint64_t end = in.first + in.second;
+    while (pos < end) {
+        unsigned i = (pos % stripe_width) / chunk_size;
+        int shard = (int)chunk_mapping.size() > (int)i ? chunk_mapping[i] : i;
+        auto iter = shards.find(shard);
+        if (iter == shards.end()) {
+            return -EIO;
+        }
+        uint64_t len = std::min(end - pos, chunk_size - (pos % chunk_size));
+        uint64_t off = (pos / stripe_width) * chunk_size + (pos % chunk_size) -
+                       chunk_start[i];
+        if (off >= iter->second.length()) {
+            break;
+        }
+        bufferlist piece;
+        piece.substr_of(iter->second, off,
+                        std::min<uint64_t>(len, iter->second.length() - off));
+        out->claim_append(piece);
+        if (off + len > iter->second.length()) {
+            break;
+        }
+        pos += len;
+    }
+    return 0;
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
                               map<int, bufferlist> &to_append)
 {
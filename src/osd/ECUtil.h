@@ -91,6 +91,26 @@ public:
                            (in.first - off) + in.second);
         return std::make_pair(off, len);
     }
+    /**
+     * The range of chunk offsets of data chunk **chunk** (the position in
+     * the stripe, not the shard) holding the bytes of the logical extent
+     * **in**, empty if the extent does not touch that chunk.
+     */
+    std::pair<uint64_t, uint64_t> offset_len_to_chunk_range(
+        unsigned chunk,
+        std::pair<uint64_t, uint64_t> in) const
+    {
+        // bytes of the chunk stored before the logical offset
+        auto chunk_bytes_before = [&](uint64_t offset) {
+            uint64_t in_stripe = offset % stripe_width;
+            uint64_t start = chunk * chunk_size;
+            return (offset / stripe_width) * chunk_size +
+                   (in_stripe <= start ? 0 :
+                    std::min(in_stripe - start, chunk_size));
+        };
+        uint64_t off = chunk_bytes_before(in.first);
+        return std::make_pair(off, chunk_bytes_before(in.first + in.second) - off);
+    }
 };
 
 int decode(
@@ -112,6 +132,36 @@ int encode(
     const std::set<int> &want,
     std::map<int, ceph::buffer::list> *out);
 
+/**
+ * Compute the change in the parity chunks caused by the change (old
+ * xor new) of the data chunks in **data_delta**, the other data chunks
+ * being unchanged.  Each buffer in **data_delta** holds the same whole
+ * number of chunks.  Requires ec_impl->supports_parity_delta().
+ */
+int encode_parity_delta(
+    const stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ec_impl,
+    const std::map<int, ceph::buffer::list> &data_delta,
+    std::map<int, ceph::buffer::list> *parity_delta);
+
+/// returns a xor b, both of the same length
+ceph::buffer::list buffer_xor(
+    const ceph::buffer::list &a,
+    const ceph::buffer::list &b);
+
+/**
+ * Rebuild the logical extent **in** from the ranges of the data shards
+ * it touches, as given by stripe_info_t::offset_len_to_chunk_range(),
+ * without decoding.  **out** stops short where a shard returned less
+ * than asked for.
+ */
+int reassemble_extent(
+    const stripe_info_t &sinfo,
+    ceph::ErasureCodeInterfaceRef &ec_impl,
+    std::pair<uint64_t, uint64_t> in,
+    std::map<int, ceph::buffer::list> &shards,
+    ceph::buffer::list *out);
+
 class HashInfo
 {
     uint64_t total_chunk_size = 0;
@@ -500,6 +500,12 @@ public:
         write_pin &pin,
         const extent_map &extents);
 
+    /// true if any in-flight write has extents of oid pinned
+    bool contains_object(const hobject_t &oid) const
+    {
+        return per_object_caches.find(oid, Cmp()) != per_object_caches.end();
+    }
+
     /**
      * Release all buffers pinned by pin
      */
@@ -2585,6 +2585,17 @@ int OSD::set_numa_affinity()
     } else {
         dout(1) << __func__ << " not setting numa affinity" << dendl;
     }
+    if (auto size = cct->_conf.get_val<Option::size_t>("osd_buffer_hugepage_pool_size");
+        size) {
+        int r = ceph::buffer::enable_hugepage_pool(size, numa_node);
+        if (r < 0) {
+            derr << __func__ << " unable to enable hugepage buffer pool: "
+                 << cpp_strerror(r) << dendl;
+        } else {
+            dout(1) << __func__ << " hugepage buffer pool of " << byte_u_t(size)
+                    << " on numa node " << numa_node << dendl;
+        }
+    }
     return 0;
 }
 
@@ -10747,6 +10758,7 @@ int OSDShard::_wake_pg_slot(
     for (auto i = slot->to_process.rbegin();
          i != slot->to_process.rend();
          ++i) {
+        queued_pgs.add(*i);
         scheduler->enqueue_front(std::move(*i));
         count++;
     }
@@ -10754,6 +10766,7 @@ int OSDShard::_wake_pg_slot(
     for (auto i = slot->waiting.rbegin();
          i != slot->waiting.rend();
          ++i) {
+        queued_pgs.add(*i);
         scheduler->enqueue_front(std::move(*i));
         count++;
     }
@@ -10765,6 +10778,7 @@ int OSDShard::_wake_pg_slot(
         // items are waiting for maps we don't have yet.  FIXME, maybe,
         // someday, if we decide this inefficiency matters
         for (auto j = i->second.rbegin(); j != i->second.rend(); ++j) {
+            queued_pgs.add(*j);
             scheduler->enqueue_front(std::move(*j));
             count++;
         }
@@ -10774,6 +10788,15 @@ int OSDShard::_wake_pg_slot(
     return count;
 }
 
+bool OSDShard::_queued_pgs_idle() const
+{
+    return queued_pgs.none_busy([this](const spg_t &pgid) {
+        auto p = pg_slots.find(pgid);
+        return p != pg_slots.end() &&
+               (p->second->num_running || !p->second->to_process.empty());
+    });
+}
+
 void OSDShard::identify_splits_and_merges(
     const OSDMapRef &as_of_osdmap,
     set<pair<spg_t, epoch_t>> *split_pgs,
@@ -11042,6 +11065,16 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
     // peek at spg_t
     sdata->shard_lock.lock();
+    if (work_stealing &&
+        sdata->scheduler->empty() &&
+        (!is_smallest_thread_index || sdata->context_queue.empty())) {
+        // nothing of our own to do; help a busier shard before sleeping
+        sdata->shard_lock.unlock();
+        if (_steal(shard_index, hb)) {
+            return;
+        }
+        sdata->shard_lock.lock();
+    }
     if (sdata->scheduler->empty() &&
         (!is_smallest_thread_index || sdata->context_queue.empty())) {
         std::unique_lock wait_lock{sdata->sdata_wait_lock};
@@ -11052,7 +11085,9 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
             dout(20) << __func__ << " empty q, waiting" << dendl;
             osd->cct->get_heartbeat_map()->clear_timeout(hb);
             sdata->shard_lock.unlock();
+            ++sdata->idle_threads;
             sdata->sdata_cond.wait(wait_lock);
+            --sdata->idle_threads;
             wait_lock.unlock();
             sdata->shard_lock.lock();
             if (sdata->scheduler->empty() &&
@@ -11134,6 +11169,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
     // Access the stored item
     auto item = std::move(std::get<OpSchedulerItem>(work_item));
+    sdata->queued_pgs.remove(item);
     if (osd->is_stopping()) {
         sdata->shard_lock.unlock();
         for (auto c : oncommits) {
@@ -11143,6 +11179,75 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
         return;    // OSD shutdown, discard.
     }
 
+    _process_item(sdata, std::move(item), oncommits, hb);
+}
+
+bool OSD::ShardedOpWQ::_steal(uint32_t shard_index, heartbeat_handle_d *hb)
+{
+    for (uint32_t i = 1; i < osd->num_shards; i++) {
+        auto sdata = osd->shards[(shard_index + i) % osd->num_shards];
+        ceph_assert(sdata);
+        sdata->steal_wakeup_pending = false;
+        if (sdata->idle_threads > 0) {
+            // it has threads of its own waiting for work
+            continue;
+        }
+        sdata->shard_lock.lock();
+        if (sdata->scheduler->empty() || osd->is_stopping()) {
+            sdata->shard_lock.unlock();
+            continue;
+        }
+        osd->logger->inc(l_osd_op_shard_imbalance);
+        if (!sdata->_queued_pgs_idle()) {
+            // the head item may belong to a pg that is running already; we
+            // would only wait for its lock while our own shard goes unserved
+            sdata->shard_lock.unlock();
+            continue;
+        }
+
+        // take the head item just like a thread of that shard would, so the
+        // scheduler's order and accounting are unchanged, and run it as one
+        // more thread of the shard
+        WorkItem work_item = sdata->scheduler->dequeue();
+        auto item = std::get_if<OpSchedulerItem>(&work_item);
+        if (!item) {
+            // scheduled in the future, leave it to the shard's own threads
+            sdata->shard_lock.unlock();
+            continue;
+        }
+
+        sdata->queued_pgs.remove(*item);
+        dout(20) << __func__ << " shard " << shard_index << " took " << *item
+                 << " from shard " << sdata->shard_id << dendl;
+        osd->logger->inc(l_osd_op_shard_steal);
+        list<Context *> oncommits;
+        _process_item(sdata, std::move(*item), oncommits, hb);
+        return true;
+    }
+    return false;
+}
+
+bool OSD::ShardedOpWQ::_wake_idle_shard(uint32_t shard_index)
+{
+    for (uint32_t i = 1; i < osd->num_shards; i++) {
+        auto sdata = osd->shards[(shard_index + i) % osd->num_shards];
+        ceph_assert(sdata);
+        if (sdata->idle_threads > 0) {
+            std::lock_guard l{sdata->sdata_wait_lock};
+            sdata->sdata_cond.notify_one();
+            return true;
+        }
+    }
+    return false;
+}
+
+void OSD::ShardedOpWQ::_process_item(
+    OSDShard *sdata,
+    OpSchedulerItem&& item,
+    list<Context *> &oncommits,
+    heartbeat_handle_d *hb)
+{
+    uint32_t shard_index = sdata->shard_id;
     const auto token = item.get_ordering_token();
     auto r = sdata->pg_slots.emplace(token, nullptr);
     if (r.second) {
@@ -11385,6 +11490,7 @@ void OSD::ShardedOpWQ::_enqueue(OpSchedulerItem&& item)
     {
         std::lock_guard l{sdata->shard_lock};
         empty = sdata->scheduler->empty();
+        sdata->queued_pgs.add(item);
         sdata->scheduler->enqueue(std::move(item));
     }
 
@@ -11396,6 +11502,15 @@ void OSD::ShardedOpWQ::_enqueue(OpSchedulerItem&& item)
             sdata->sdata_cond.notify_one();
         }
     }
+
+    if (work_stealing && !empty && sdata->idle_threads == 0 &&
+        !sdata->steal_wakeup_pending.exchange(true)) {
+        // this shard is backed up while its threads are all busy; one
+        // wakeup at a time, until a thread of another shard looked at it
+        if (!_wake_idle_shard(shard_index)) {
+            sdata->steal_wakeup_pending = false;
+        }
+    }
 }
 
 void OSD::ShardedOpWQ::_enqueue_front(OpSchedulerItem&& item)
@@ -11425,6 +11540,7 @@ void OSD::ShardedOpWQ::_enqueue_front(OpSchedulerItem&& item)
     } else {
         dout(20) << __func__ << " " << item << dendl;
     }
+    sdata->queued_pgs.add(item);
     sdata->scheduler->enqueue_front(std::move(item));
     sdata->shard_lock.unlock();
     std::lock_guard l{sdata->sdata_wait_lock};
@@ -11445,6 +11561,7 @@ void OSD::ShardedOpWQ::stop_for_fast_shutdown()
             auto work_item = sdata->scheduler->dequeue();
             work_count++;
         }
+        sdata->queued_pgs.clear();
         sdata->shard_lock.unlock();
     }
 }
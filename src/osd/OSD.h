@@ -1096,6 +1096,17 @@ struct OSDShard {
 
     bool stop_waiting = false;
 
+    /// threads waiting on sdata_cond for the queue to fill
+    std::atomic<int> idle_threads = {0};
+
+    /// another shard's idle thread was woken to help with our queue
+    std::atomic<bool> steal_wakeup_pending = {false};
+
+    /// items in the scheduler by pg, so that another shard's thread only
+    /// takes an item when that can't make it wait for a running pg
+    ceph::osd::scheduler::QueuedPGCounts queued_pgs;
+    bool _queued_pgs_idle() const;
+
     ContextQueue context_queue;
 
     void _attach_pg(OSDShardPGSlot *slot, PG *pg);
@@ -1680,13 +1691,16 @@ protected:
     {
         OSD *osd;
         bool m_fast_shutdown = false;
+        /// idle threads take items of other shards
+        const bool work_stealing;
     public:
         ShardedOpWQ(OSD *o,
                     ceph::timespan ti,
                     ceph::timespan si,
                     ShardedThreadPool *tp)
             : ShardedThreadPool::ShardedWQ<OpSchedulerItem>(ti, si, tp),
-              osd(o)
+              osd(o),
+              work_stealing(o->cct->_conf.get_val<bool>("osd_op_queue_work_stealing"))
         {
         }
 
@@ -1698,6 +1712,20 @@ protected:
         /// try to do some work
         void _process(uint32_t thread_index, ceph::heartbeat_handle_d *hb) override;
 
+        /// run an item dequeued from sdata (shard_lock held, dropped on return)
+        void _process_item(
+            OSDShard *sdata,
+            OpSchedulerItem&& item,
+            std::list<Context *> &oncommits,
+            ceph::heartbeat_handle_d *hb);
+
+        /// run one item of another shard; false if there was none to take
+        bool _steal(uint32_t shard_index, ceph::heartbeat_handle_d *hb);
+
+        /// wake an idle thread of another shard to help this one; false if
+        /// there was none
+        bool _wake_idle_shard(uint32_t shard_index);
+
         void stop_for_fast_shutdown();
 
         /// enqueue a new item
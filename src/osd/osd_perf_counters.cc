@@ -320,6 +320,13 @@ PerfCounters *build_osd_logger(CephContext *cct)
     osd_plb.add_u64_counter(
                l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+    osd_plb.add_u64_counter(
+               l_osd_op_shard_steal, "op_shard_steal",
+               "Op queue items run by a thread of another shard");
+    osd_plb.add_u64_counter(
+               l_osd_op_shard_imbalance, "op_shard_imbalance",
+               "Times an idle shard thread found another shard's queue backed up");
+
     return osd_plb.create_perf_counters();
 }
 
@@ -131,6 +131,9 @@ enum {
     l_osd_pg_fastinfo,
     l_osd_pg_biginfo,
 
+    l_osd_op_shard_steal,
+    l_osd_op_shard_imbalance,
+
     l_osd_last,
 };
 
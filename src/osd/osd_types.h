@@ -1213,6 +1213,7 @@ public:
         DEDUP_CHUNK_ALGORITHM,
         DEDUP_CDC_CHUNK_SIZE,
         PG_NUM_MAX, // max pg_num
+        READAHEAD_MAX_BYTES, // objectstore readahead limit, < 0 disables
     };
 
     enum type_t {
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <map>
 #include <ostream>
 #include <variant>
 
@@ -63,6 +64,46 @@ public:
 std::ostream &operator<<(std::ostream &lhs, const OpScheduler &);
 using OpSchedulerRef = std::unique_ptr<OpScheduler>;
 
+/**
+ * Number of items each PG has waiting in an OpScheduler.
+ *
+ * The schedulers can't show their next item without dequeuing (and, for
+ * mClock, charging) it.  When none of the PGs with queued items is busy,
+ * whatever dequeue() returns next belongs to a PG nobody is running.
+ */
+class QueuedPGCounts
+{
+    std::map<spg_t, unsigned> counts;
+public:
+    void add(const OpSchedulerItem &item)
+    {
+        ++counts[item.get_ordering_token()];
+    }
+    void remove(const OpSchedulerItem &item)
+    {
+        auto p = counts.find(item.get_ordering_token());
+        ceph_assert(p != counts.end());
+        if (--p->second == 0) {
+            counts.erase(p);
+        }
+    }
+    void clear()
+    {
+        counts.clear();
+    }
+    /// true unless busy(pgid) holds for a pg with queued items
+    template <typename F>
+    bool none_busy(F &&busy) const
+    {
+        for (auto &[pgid, n] : counts) {
+            if (busy(pgid)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 OpSchedulerRef make_scheduler(
     CephContext *cct, int whoami, uint32_t num_shards, int shard_id,
     bool is_rotational, std::string_view osd_objectstore, MonClient *monc);
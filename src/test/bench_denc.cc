@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "include/denc.h"
+#include "include/encoding.h"
+#include "common/hobject.h"
+#include "osd/osd_types.h"
+#include "os/bluestore/bluestore_types.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static void usage(const char *name)
+{
+    cout << name << " [--iterations <n>] [<corpus objects dir>]\n"
+         << "\t Time decoding of varint arrays and, when given a corpus\n"
+         << "\t directory (e.g. ceph-object-corpus/archive/<version>/objects),\n"
+         << "\t of the encoded instances found there for the types below.\n"
+         << "\t --iterations: number of passes over the data (default 1000).\n";
+}
+
+static void report(const string &what, size_t objects, size_t bytes,
+                   unsigned iterations, chrono::duration<double> elapsed)
+{
+    double secs = elapsed.count();
+    cout << what << ": " << objects << " objects, " << bytes << " bytes, "
+         << secs << " s, "
+         << (double)objects * iterations / secs << " objects/s, "
+         << (double)bytes * iterations / (1024 * 1024) / secs << " MB/s"
+         << std::endl;
+}
+
+static void bench_varint(unsigned iterations)
+{
+    // a mix of the value sizes seen in extent lengths and use trackers
+    vector<uint32_t> in(1 << 16);
+    mt19937 rng(0);
+    for (auto &v : in) {
+        v = rng() >> (rng() % 32);
+    }
+    bufferlist bl;
+    {
+        size_t s = 0;
+        denc_varint_array(in.data(), in.size(), s);
+        auto a = bl.get_contiguous_appender(s);
+        denc_varint_array(in.data(), in.size(), a);
+    }
+    bl.rebuild();
+    vector<uint32_t> out(in.size());
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned it = 0; it < iterations; it++) {
+        auto p = bl.front().cbegin();
+        for (auto &v : out) {
+            denc_varint(v, p);
+        }
+    }
+    report("varint", in.size(), bl.length(), iterations,
+           chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    for (unsigned it = 0; it < iterations; it++) {
+        auto p = bl.front().cbegin();
+        denc_varint_array(out.data(), out.size(), p);
+    }
+    report("varint_array", in.size(), bl.length(), iterations,
+           chrono::steady_clock::now() - start);
+    if (in != out) {
+        cerr << "varint_array decode mismatch" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+template<typename T>
+static void bench_type(const fs::path &dir, unsigned iterations)
+{
+    vector<bufferlist> objects;
+    size_t bytes = 0;
+    for (auto &entry : fs::directory_iterator(dir)) {
+        bufferlist bl;
+        string error;
+        if (bl.read_file(entry.path().c_str(), &error) < 0) {
+            cerr << "failed to read " << entry.path() << ": " << error
+                 << std::endl;
+            continue;
+        }
+        bytes += bl.length();
+        bl.rebuild();
+        objects.push_back(std::move(bl));
+    }
+    if (objects.empty()) {
+        return;
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (auto &bl : objects) {
+            T t;
+            auto p = bl.cbegin();
+            decode(t, p);
+        }
+    }
+    report(dir.filename().string(), objects.size(), bytes, iterations,
+           chrono::steady_clock::now() - start);
+}
+
+int main(int argc, const char **argv)
+{
+    unsigned iterations = 1000;
+    const char *corpus = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (!corpus) {
+            corpus = argv[i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!iterations) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench_varint(iterations);
+    if (!corpus) {
+        return EXIT_SUCCESS;
+    }
+
+    const map<string, function<void(const fs::path &, unsigned)>> types = {
+        {"hobject_t", bench_type<hobject_t>},
+        {"ghobject_t", bench_type<ghobject_t>},
+        {"pg_log_entry_t", bench_type<pg_log_entry_t>},
+        {"bluestore_blob_use_tracker_t", bench_type<bluestore_blob_use_tracker_t>},
+        {"bluestore_onode_t", bench_type<bluestore_onode_t>},
+    };
+    for (auto &[name, bench] : types) {
+        fs::path dir = fs::path(corpus) / name;
+        if (fs::is_directory(dir)) {
+            bench(dir, iterations);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -29,6 +29,7 @@
 #include "include/utime.h"
 #include "include/coredumpctl.h"
 #include "include/encoding.h"
+#include "include/scope_guard.h"
 #include "common/buffer_instrumentation.h"
 #include "common/environment.h"
 #include "common/Clock.h"
@@ -156,6 +157,49 @@ TEST(BufferRaw, ostream)
     EXPECT_GT(stream.str().size(), stream.str().find("len 1 nref 1)"));
 }
 
+#if defined(__linux__)
+TEST(BufferRaw, hugepage_pool)
+{
+    ASSERT_EQ(0, buffer::enable_hugepage_pool(8 << 20, -1));
+    auto disable = make_scope_guard([] {
+        buffer::disable_hugepage_pool();
+    });
+    auto &pool = mempool::get_pool(mempool::mempool_buffer_pool);
+    size_t len = 3 * CEPH_PAGE_SIZE;
+    size_t size_class = CEPH_PAGE_SIZE;
+    while (size_class < len) {
+        size_class <<= 1;
+    }
+
+    bufferptr a = buffer::create_page_aligned(len);
+    EXPECT_EQ(0u, (uintptr_t)a.c_str() % size_class);
+    memset(a.c_str(), 0xff, a.length());
+    size_t in_use = pool.allocated_bytes();
+    EXPECT_GT(in_use, 0u);
+    // free blocks of this class plus the slack of a
+    EXPECT_EQ(size_class - len, in_use % size_class);
+    a = bufferptr();
+    size_t idle = pool.allocated_bytes();
+    EXPECT_EQ(in_use + len, idle);
+    EXPECT_EQ(0u, idle % size_class);
+
+    // served from the free list, not from a new chunk
+    bufferptr b = buffer::create_page_aligned(len);
+    EXPECT_EQ(in_use, pool.allocated_bytes());
+
+    // too large for the pool
+    bufferptr c = buffer::create_page_aligned(4 << 20);
+    EXPECT_EQ(in_use, pool.allocated_bytes());
+
+    // no longer served once disabled, but b still goes back to the pool
+    buffer::disable_hugepage_pool();
+    bufferptr d = buffer::create_page_aligned(len);
+    EXPECT_EQ(in_use, pool.allocated_bytes());
+    b = bufferptr();
+    EXPECT_EQ(idle, pool.allocated_bytes());
+}
+#endif
+
 //
 // +-----------+                +-----+
 // |           |                |     |
@@ -2649,6 +2693,26 @@ TEST(BufferList, crc32c_append)
     ASSERT_EQ(bl1.crc32c(0), bl2.crc32c(0));
 }
 
+TEST(BufferList, crc32c_multi)
+{
+    // more nodes than a crc window, none of them with a cached crc yet
+    bufferlist bl;
+    for (int j = 0; j < 37; ++j) {
+        bufferptr bp(buffer::create_page_aligned(j % 5 ? 4096 : 100 + j));
+        for (unsigned i = 0; i < bp.length(); ++i) {
+            bp[i] = rand();
+        }
+        bl.append(bp);
+    }
+    bufferlist flat;
+    flat.append(bl.to_str());
+
+    ASSERT_EQ(flat.crc32c(0), bl.crc32c(0));
+    // again, now from the cached values
+    ASSERT_EQ(flat.crc32c(0), bl.crc32c(0));
+    ASSERT_EQ(flat.crc32c(1234), bl.crc32c(1234));
+}
+
 TEST(BufferList, crc32c_zeros)
 {
     char buffer[4 * 1024];
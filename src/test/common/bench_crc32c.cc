@@ -0,0 +1,78 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "include/crc32c.h"
+
+using namespace std;
+
+void usage(const char *name)
+{
+    cout << name << " [<block size> [<total size> [<iterations>]]]\n"
+         << "\t block size: size of each checksummed block (default 4096).\n"
+         << "\t total size: bytes checksummed per iteration (default 4 MiB).\n"
+         << "\t iterations: number of passes over the data (default 1000).\n";
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc > 1 && string(argv[1]) == "-h") {
+        usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+    unsigned block_size = argc > 1 ? atoi(argv[1]) : 4096;
+    size_t total = argc > 2 ? atoll(argv[2]) : (4 << 20);
+    unsigned iterations = argc > 3 ? atoi(argv[3]) : 1000;
+    if (!block_size || total < block_size || !iterations) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    unsigned blocks = total / block_size;
+    vector<unsigned char> buf(blocks * block_size);
+    for (auto &c : buf) {
+        c = rand();
+    }
+    vector<const unsigned char *> data(blocks);
+    vector<unsigned> lengths(blocks, block_size);
+    for (unsigned i = 0; i < blocks; i++) {
+        data[i] = buf.data() + i * block_size;
+    }
+    vector<uint32_t> serial(blocks);
+    vector<uint32_t> multi(blocks);
+
+    cout << blocks << " blocks of " << block_size << " bytes, "
+         << iterations << " iterations" << std::endl;
+
+    auto report = [&](const char *what, chrono::duration<double> elapsed) {
+        double mb = (double)buf.size() * iterations / (1024 * 1024);
+        cout << what << ": " << elapsed.count() << " s, "
+             << mb / elapsed.count() << " MB/s" << std::endl;
+    };
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned it = 0; it < iterations; it++) {
+        for (unsigned i = 0; i < blocks; i++) {
+            serial[i] = ceph_crc32c(-1, data[i], lengths[i]);
+        }
+    }
+    report("serial", chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    for (unsigned it = 0; it < iterations; it++) {
+        std::fill(multi.begin(), multi.end(), -1);
+        ceph_crc32c_multi(multi.data(), data.data(), lengths.data(), blocks);
+    }
+    report("multi", chrono::steady_clock::now() - start);
+
+    if (serial != multi) {
+        cerr << "crc mismatch between serial and multi" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
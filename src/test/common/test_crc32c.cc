@@ -280,6 +280,34 @@ TEST(Crc32c, RangeNull)
     }
 }
 
+TEST(Crc32c, Multi)
+{
+    constexpr unsigned N = 13;
+    unsigned char *buf = (unsigned char *)malloc(N * 5000 + 1);
+    for (unsigned i = 0; i < N * 5000 + 1; i++) {
+        buf[i] = rand();
+    }
+
+    for (unsigned n = 0; n <= N; n++) {
+        unsigned char const *data[N];
+        unsigned lengths[N];
+        uint32_t crcs[N];
+        uint32_t expected[N];
+        for (unsigned i = 0; i < n; i++) {
+            // odd starts and mismatched lengths exercise the tails
+            data[i] = buf + i * 5000 + (i & 1);
+            lengths[i] = (i % 3) ? 4096 : rand() % 4999;
+            crcs[i] = rand();
+            expected[i] = ceph_crc32c(crcs[i], data[i], lengths[i]);
+        }
+        ceph_crc32c_multi(crcs, data, lengths, n);
+        for (unsigned i = 0; i < n; i++) {
+            ASSERT_EQ(expected[i], crcs[i]) << "n " << n << " i " << i;
+        }
+    }
+    free(buf);
+}
+
 double estimate_clock_resolution()
 {
     volatile char *p = (volatile char *)malloc(1024);
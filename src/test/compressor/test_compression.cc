@@ -290,6 +290,74 @@ TEST_P(CompressorTest, sharded_input_decompress)
     EXPECT_EQ(res, 0);
 }
 
+TEST_P(CompressorTest, fragmented_round_trip_repeated)
+{
+    // many small, unevenly sized fragments, compressed and decompressed
+    // over and over on the same thread
+    bufferlist orig;
+    for (unsigned i = 0; i < 200; ++i) {
+        bufferptr bp(buffer::create(1 + (i * 37) % 500));
+        for (unsigned j = 0; j < bp.length(); ++j) {
+            bp[j] = "abcdefghij"[(i + j) % 10];
+        }
+        orig.append(bp);
+    }
+    ASSERT_FALSE(orig.is_contiguous());
+    for (unsigned n = 0; n < 10; ++n) {
+        bufferlist compressed;
+        std::optional<int32_t> compressor_message;
+        int r = compressor->compress(orig, compressed, compressor_message);
+        ASSERT_EQ(0, r);
+        // and hand decompress() fragments as well
+        bufferlist fragmented;
+        for (unsigned off = 0; off < compressed.length(); off += 7) {
+            bufferlist tmp;
+            tmp.substr_of(compressed, off, std::min(7u, compressed.length() - off));
+            fragmented.append(tmp);
+        }
+        bufferlist decompressed;
+        r = compressor->decompress(fragmented, decompressed, compressor_message);
+        ASSERT_EQ(0, r);
+        ASSERT_TRUE(decompressed.contents_equal(orig));
+    }
+}
+
+TEST_P(CompressorTest, dictionary)
+{
+    bufferlist content;
+    for (unsigned i = 0; i < 1000; ++i) {
+        content.append("{\"bucket\": \"photos\", \"owner\": \"user-" +
+                       std::to_string(i) + "\", \"acl\": \"private\"}\n");
+    }
+    auto dict = compressor->create_dictionary(content);
+    if (!dict) {
+        // the algorithm has no dictionary support
+        bufferlist in, out;
+        in.append("x");
+        std::optional<int32_t> compressor_message;
+        EXPECT_EQ(0, compressor->compress(in, out, compressor_message, nullptr));
+        return;
+    }
+
+    bufferlist orig;
+    orig.append("{\"bucket\": \"photos\", \"owner\": \"user-1234\", \"acl\": \"private\"}\n");
+    bufferlist with_dict, without_dict;
+    std::optional<int32_t> compressor_message;
+    ASSERT_EQ(0, compressor->compress(orig, with_dict, compressor_message, dict.get()));
+    ASSERT_EQ(0, compressor->compress(orig, without_dict, compressor_message));
+    EXPECT_LT(with_dict.length(), without_dict.length());
+
+    bufferlist decompressed;
+    auto p = with_dict.cbegin();
+    ASSERT_EQ(0, compressor->decompress(p, with_dict.length(), decompressed,
+                                        compressor_message, dict.get()));
+    ASSERT_TRUE(decompressed.contents_equal(orig));
+
+    // data compressed with a dictionary can't be read without it
+    decompressed.clear();
+    EXPECT_NE(0, compressor->decompress(with_dict, decompressed, compressor_message));
+}
+
 void test_compress(CompressorRef compressor, size_t size)
 {
     char *data = (char *) malloc(size);
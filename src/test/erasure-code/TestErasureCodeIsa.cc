@@ -191,6 +191,53 @@ TEST_F(IsaErasureCodeTest, encode_decode)
     encode_decode(4096 + 1);
 }
 
+TEST_F(IsaErasureCodeTest, encode_decode_batch)
+{
+    ErasureCodeIsaDefault Isa(tcache);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "2";
+    Isa.init(profile, &cerr);
+
+    // objects of different sizes, some sharing a chunk size
+    vector<bufferlist> in;
+    for (unsigned size : { 100, 4096, 100, 10000, 4096, 1 }) {
+        bufferlist bl;
+        for (unsigned i = 0; i < size; i++) {
+            bl.append((char)rand());
+        }
+        in.push_back(bl);
+    }
+    set<int> want_to_encode = { 0, 1, 2, 3, 4, 5 };
+    vector<map<int, bufferlist>> encoded;
+    EXPECT_EQ(0, Isa.encode_batch(want_to_encode, in, &encoded));
+    ASSERT_EQ(in.size(), encoded.size());
+    for (unsigned j = 0; j < in.size(); j++) {
+        map<int, bufferlist> expected;
+        EXPECT_EQ(0, Isa.encode(want_to_encode, in[j], &expected));
+        ASSERT_EQ(expected.size(), encoded[j].size());
+        for (auto &&i : expected) {
+            EXPECT_TRUE(i.second.contents_equal(encoded[j][i.first]));
+        }
+    }
+
+    // two chunks are missing from most objects, none from one
+    vector<map<int, bufferlist>> degraded = encoded;
+    for (unsigned j = 1; j < degraded.size(); j++) {
+        degraded[j].erase(0);
+        degraded[j].erase(j % 2 ? 2 : 5);
+    }
+    set<int> want_to_decode = { 0, 1, 2, 3 };
+    vector<map<int, bufferlist>> decoded;
+    EXPECT_EQ(0, Isa.decode_batch(want_to_decode, degraded, &decoded));
+    ASSERT_EQ(in.size(), decoded.size());
+    for (unsigned j = 0; j < in.size(); j++) {
+        for (auto &&i : want_to_decode) {
+            EXPECT_TRUE(encoded[j][i].contents_equal(decoded[j][i]));
+        }
+    }
+}
+
 TEST_F(IsaErasureCodeTest, minimum_to_decode)
 {
     ErasureCodeIsaDefault Isa(tcache);
@@ -131,6 +131,54 @@ TYPED_TEST(ErasureCodeTest, encode_decode)
     }
 }
 
+TYPED_TEST(ErasureCodeTest, encode_decode_batch)
+{
+    TypeParam jerasure;
+    ErasureCodeProfile profile;
+    profile["k"] = "2";
+    profile["m"] = "2";
+    profile["packetsize"] = "8";
+    jerasure.init(profile, &cerr);
+
+    // objects of different sizes, some sharing a chunk size
+    vector<bufferlist> in;
+    for (unsigned size : { 100, 1000, 100, 4000, 1000, 1 }) {
+        bufferlist bl;
+        for (unsigned i = 0; i < size; i++) {
+            bl.append((char)rand());
+        }
+        in.push_back(bl);
+    }
+    set<int> want_to_encode = { 0, 1, 2, 3 };
+    vector<map<int, bufferlist>> encoded;
+    EXPECT_EQ(0, jerasure.encode_batch(want_to_encode, in, &encoded));
+    ASSERT_EQ(in.size(), encoded.size());
+    for (unsigned j = 0; j < in.size(); j++) {
+        map<int, bufferlist> expected;
+        EXPECT_EQ(0, jerasure.encode(want_to_encode, in[j], &expected));
+        ASSERT_EQ(expected.size(), encoded[j].size());
+        for (auto &&i : expected) {
+            EXPECT_TRUE(i.second.contents_equal(encoded[j][i.first]));
+        }
+    }
+
+    // two chunks are missing from most objects, none from one
+    vector<map<int, bufferlist>> degraded = encoded;
+    for (unsigned j = 1; j < degraded.size(); j++) {
+        degraded[j].erase(0);
+        degraded[j].erase(j % 2 ? 1 : 3);
+    }
+    set<int> want_to_decode = { 0, 1 };
+    vector<map<int, bufferlist>> decoded;
+    EXPECT_EQ(0, jerasure.decode_batch(want_to_decode, degraded, &decoded));
+    ASSERT_EQ(in.size(), decoded.size());
+    for (unsigned j = 0; j < in.size(); j++) {
+        for (auto &&i : want_to_decode) {
+            EXPECT_TRUE(encoded[j][i].contents_equal(decoded[j][i]));
+        }
+    }
+}
+
 TYPED_TEST(ErasureCodeTest, minimum_to_decode)
 {
     TypeParam jerasure;
@@ -60,7 +60,14 @@ int ErasureCodeBench::setup(int argc, char **argv)
         ("plugin,p", po::value<string>()->default_value("jerasure"),
          "erasure code plugin name")
         ("workload,w", po::value<string>()->default_value("encode"),
-         "run either encode or decode")
+         "run either encode, decode or overwrite")
+        ("write-size", po::value<int>()->default_value(4096),
+         "size of each partial stripe write of the overwrite workload, which "
+         "compares re-encoding the whole stripe (of --size bytes) with "
+         "updating the parity from the data delta")
+        ("batch,b", po::value<int>()->default_value(1),
+         "encode or decode this many objects of --size bytes per call, "
+         "with encode_batch / decode_batch when greater than 1")
         ("erasures,e", po::value<int>()->default_value(1),
          "number of erasures when decoding")
         ("erased", po::value<vector<int> >(),
@@ -120,6 +127,8 @@ int ErasureCodeBench::setup(int argc, char **argv)
     }
 
     in_size = vm["size"].as<int>();
+    write_size = vm["write-size"].as<int>();
+    batch = vm["batch"].as<int>();
     max_iterations = vm["iterations"].as<int>();
     plugin = vm["plugin"].as<string>();
     workload = vm["workload"].as<string>();
@@ -145,6 +154,9 @@ int ErasureCodeBench::setup(int argc, char **argv)
     if (k <= 0) {
         cout << "parameter k is " << k << ". But k needs to be > 0." << endl;
         return -EINVAL;
+    } else if (batch <= 0) {
+        cout << "--batch is " << batch << ". But it needs to be > 0." << endl;
+        return -EINVAL;
     } else if (m < 0) {
         cout << "parameter m is " << m << ". But m needs to be >= 0." << endl;
         return -EINVAL;
@@ -162,6 +174,8 @@ int ErasureCodeBench::run()
 
     if (workload == "encode") {
         return encode();
+    } else if (workload == "overwrite") {
+        return overwrite();
     } else {
         return decode();
     }
@@ -187,16 +201,187 @@ int ErasureCodeBench::encode()
     for (int i = 0; i < k + m; i++) {
         want_to_encode.insert(i);
     }
+    // each object of a batch has its own buffer, as separate writes would
+    vector<bufferlist> objects(batch);
+    for (auto &object : objects) {
+        object.append(string(in_size, 'X'));
+        object.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+    }
     utime_t begin_time = ceph_clock_now();
     for (int i = 0; i < max_iterations; i++) {
-        std::map<int, bufferlist> encoded;
-        code = erasure_code->encode(want_to_encode, in, &encoded);
+        if (batch > 1) {
+            vector<map<int, bufferlist>> encoded;
+            code = erasure_code->encode_batch(want_to_encode, objects, &encoded);
+        } else {
+            std::map<int, bufferlist> encoded;
+            code = erasure_code->encode(want_to_encode, in, &encoded);
+        }
         if (code) {
             return code;
         }
     }
     utime_t end_time = ceph_clock_now();
-    cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+    cout << (end_time - begin_time) << "\t"
+         << (((uint64_t)max_iterations * batch * in_size) / 1024) << endl;
+    return 0;
+}
+
+static bufferlist xor_chunks(const bufferlist &a, const bufferlist &b)
+{
+    bufferptr out(a.length());
+    const char *pa = a.c_str();
+    const char *pb = b.c_str();
+    for (unsigned i = 0; i < a.length(); i++) {
+        out[i] = pa[i] ^ pb[i];
+    }
+    bufferlist bl;
+    bl.append(std::move(out));
+    return bl;
+}
+
+int ErasureCodeBench::overwrite()
+{
+    ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+    ErasureCodeInterfaceRef erasure_code;
+    stringstream messages;
+    int code = instance.factory(plugin,
+                                g_conf().get_val<std::string>("erasure_code_dir"),
+                                profile, &erasure_code, &messages);
+    if (code) {
+        cerr << messages.str() << endl;
+        return code;
+    }
+    if (!erasure_code->supports_parity_delta()) {
+        cerr << plugin << " does not support parity delta updates" << endl;
+        return -EOPNOTSUPP;
+    }
+
+    unsigned chunk_size = erasure_code->get_chunk_size(in_size);
+    unsigned stripe_width = chunk_size * k;
+    if (write_size <= 0 || (unsigned)write_size > stripe_width) {
+        cerr << "--write-size must be between 1 and the stripe width "
+             << stripe_width << endl;
+        return -EINVAL;
+    }
+
+    bufferlist in;
+    in.append(string(stripe_width, 'X'));
+    in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+    set<int> want_to_encode;
+    set<int> parity;
+    for (int i = 0; i < k + m; i++) {
+        want_to_encode.insert(i);
+        if (i >= k) {
+            parity.insert(i);
+        }
+    }
+    map<int, bufferlist> encoded;
+    code = erasure_code->encode(want_to_encode, in, &encoded);
+    if (code) {
+        return code;
+    }
+    bufferlist update;
+    update.append(string(write_size, 'Y'));
+
+    // offsets of the partial writes, and the data chunks they touch
+    vector<unsigned> offsets(max_iterations);
+    for (auto &off : offsets) {
+        off = rand() % (stripe_width - write_size + 1);
+    }
+    auto touched = [&](unsigned off) {
+        set<int> chunks;
+        for (unsigned c = off / chunk_size;
+             c <= (off + write_size - 1) / chunk_size;
+             c++) {
+            chunks.insert(c);
+        }
+        return chunks;
+    };
+
+    // current path: read the whole stripe, re-encode all chunks
+    uint64_t rmw_reads = 0, rmw_writes = 0;
+    utime_t begin_time = ceph_clock_now();
+    for (auto off : offsets) {
+        bufferlist stripe;
+        stripe.substr_of(in, 0, off);
+        stripe.append(update);
+        bufferlist tail;
+        tail.substr_of(in, off + write_size, stripe_width - off - write_size);
+        stripe.append(tail);
+        map<int, bufferlist> out;
+        code = erasure_code->encode(want_to_encode, stripe, &out);
+        if (code) {
+            return code;
+        }
+        rmw_reads += k;
+        rmw_writes += k + m;
+    }
+    utime_t end_time = ceph_clock_now();
+    cout << "rmw\t" << (end_time - begin_time) << "\t"
+         << (max_iterations * (write_size / 1024)) << "\t"
+         << rmw_reads << "\t" << rmw_writes << endl;
+
+    // delta path: read the touched data chunks and the parity chunks,
+    // encode the data delta and xor it into the parity
+    uint64_t delta_reads = 0, delta_writes = 0;
+    bool checked = false;
+    begin_time = ceph_clock_now();
+    for (auto off : offsets) {
+        set<int> chunks = touched(off);
+        bufferlist delta_stripe;
+        for (int c = 0; c < k; c++) {
+            if (!chunks.count(c)) {
+                delta_stripe.append_zero(chunk_size);
+                continue;
+            }
+            bufferlist chunk = encoded[c];
+            unsigned start = std::max<unsigned>(off, c * chunk_size);
+            unsigned end = std::min<unsigned>(off + write_size, (c + 1) * chunk_size);
+            bufferlist new_chunk;
+            new_chunk.substr_of(chunk, 0, start - c * chunk_size);
+            bufferlist piece;
+            piece.substr_of(update, start - off, end - start);
+            new_chunk.append(piece);
+            bufferlist rest;
+            rest.substr_of(chunk, end - c * chunk_size, (c + 1) * chunk_size - end);
+            new_chunk.append(rest);
+            delta_stripe.append(xor_chunks(chunk, new_chunk));
+        }
+        map<int, bufferlist> parity_delta;
+        code = erasure_code->encode(parity, delta_stripe, &parity_delta);
+        if (code) {
+            return code;
+        }
+        map<int, bufferlist> new_parity;
+        for (auto p : parity) {
+            new_parity[p] = xor_chunks(encoded[p], parity_delta[p]);
+        }
+        if (!checked) {
+            // the first update is compared with a full re-encode
+            checked = true;
+            bufferlist stripe;
+            stripe.substr_of(in, 0, off);
+            stripe.append(update);
+            bufferlist tail;
+            tail.substr_of(in, off + write_size, stripe_width - off - write_size);
+            stripe.append(tail);
+            map<int, bufferlist> expected;
+            erasure_code->encode(parity, stripe, &expected);
+            for (auto p : parity) {
+                if (!expected[p].contents_equal(new_parity[p])) {
+                    cerr << "parity chunk " << p << " from the delta differs "
+                         << "from the re-encoded stripe" << endl;
+                    return -EINVAL;
+                }
+            }
+        }
+        delta_reads += chunks.size() + m;
+        delta_writes += chunks.size() + m;
+    }
+    end_time = ceph_clock_now();
+    cout << "delta\t" << (end_time - begin_time) << "\t"
+         << (max_iterations * (write_size / 1024)) << "\t"
+         << delta_reads << "\t" << delta_writes << endl;
     return 0;
 }
 
@@ -268,6 +453,21 @@ int ErasureCodeBench::decode_erasures(const map<int, bufferlist> &all_chunks,
     return 0;
 }
 
+int ErasureCodeBench::decode_batch(ErasureCodeInterfaceRef erasure_code,
+                                   const set<int> &want_to_read,
+                                   const map<int, bufferlist> &chunks)
+{
+    if (batch == 1) {
+        map<int, bufferlist> decoded;
+        return erasure_code->decode(want_to_read, chunks, &decoded, 0);
+    }
+    // the objects of a batch are missing the same chunks, as after the
+    // loss of an OSD
+    vector<map<int, bufferlist>> objects(batch, chunks);
+    vector<map<int, bufferlist>> decoded;
+    return erasure_code->decode_batch(want_to_read, objects, &decoded);
+}
+
 int ErasureCodeBench::decode()
 {
     ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
@@ -315,8 +515,7 @@ int ErasureCodeBench::decode()
                 return code;
             }
         } else if (erased.size() > 0) {
-            map<int, bufferlist> decoded;
-            code = erasure_code->decode(want_to_read, encoded, &decoded, 0);
+            code = decode_batch(erasure_code, want_to_read, encoded);
             if (code) {
                 return code;
             }
@@ -329,15 +528,15 @@ int ErasureCodeBench::decode()
                 } while (chunks.count(erasure) == 0);
                 chunks.erase(erasure);
             }
-            map<int, bufferlist> decoded;
-            code = erasure_code->decode(want_to_read, chunks, &decoded, 0);
+            code = decode_batch(erasure_code, want_to_read, chunks);
             if (code) {
                 return code;
             }
         }
     }
     utime_t end_time = ceph_clock_now();
-    cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+    cout << (end_time - begin_time) << "\t"
+         << (((uint64_t)max_iterations * batch * in_size) / 1024) << endl;
     return 0;
 }
 
@@ -20,6 +20,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 
 #include <boost/intrusive_ptr.hpp>
@@ -33,6 +34,8 @@
 class ErasureCodeBench
 {
     int in_size;
+    int write_size;
+    int batch;
     int max_iterations;
     int erasures;
     int k;
@@ -56,8 +59,12 @@ public:
                         unsigned i,
                         unsigned want_erasures,
                         ErasureCodeInterfaceRef erasure_code);
+    int decode_batch(ErasureCodeInterfaceRef erasure_code,
+                     const std::set<int> &want_to_read,
+                     const std::map<int, ceph::buffer::list> &chunks);
     int decode();
     int encode();
+    int overwrite();
 };
 
 #endif
@@ -6,6 +6,7 @@
  */
 #include <bit>
 #include <iostream>
+#include <thread>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 #include <boost/random/triangle_distribution.hpp>
@@ -435,6 +436,92 @@ TEST_P(AllocTest, test_alloc_fragmentation_max_chunk_8M)
     }
 }
 
+// every thread ages its own share of the device concurrently, as several
+// kv_sync/finalize/bluefs threads would, and the resulting fragmentation
+// is compared with the single threaded runs above
+TEST_P(AllocTest, test_alloc_mt_aging)
+{
+    std::string allocator_name = GetParam();
+    constexpr uint32_t max_chunk_size = 8 * 1024 * 1024;
+    constexpr uint32_t min_chunk_size = 64 * 1024;
+    for (unsigned threads : {1, 4, 16}) {
+        for (auto &s : scenarios) {
+            if (s.alloc_unit != 65536 || s.capacity != 512) {
+                continue;
+            }
+            std::cout << "Allocator: " << allocator_name << ", threads="
+                      << threads << ", ";
+            PrintTo(s, &std::cout);
+            std::cout << std::endl;
+
+            uint64_t capacity = s.capacity * _1G;
+            cct->_conf->bdev_block_size = s.alloc_unit;
+            init_alloc(allocator_name, capacity, s.alloc_unit);
+            alloc->init_add_free(0, capacity);
+
+            std::atomic<uint64_t> allocs_total = {0}, fragmented_total = {0};
+            auto worker = [&](unsigned seed) {
+                gen_type trng(seed);
+                boost::uniform_int<> D(0, 1);
+                std::vector<bluestore_pextent_t> held;
+                uint64_t lvl = 0;
+                uint64_t high = s.high_mark * capacity / threads;
+                uint64_t low = s.low_mark * capacity / threads;
+                PExtentVector tmp;
+                for (uint32_t i = 0; i <= s.repeats; i++) {
+                    while (lvl < high) {
+                        uint32_t want = D(trng) ? max_chunk_size : min_chunk_size;
+                        tmp.clear();
+                        auto r = alloc->allocate(want, s.alloc_unit, 0, 0, &tmp);
+                        if (r < want) {
+                            if (r > 0) {
+                                held.insert(held.end(), tmp.begin(), tmp.end());
+                                lvl += r;
+                            }
+                            break;
+                        }
+                        lvl += r;
+                        held.insert(held.end(), tmp.begin(), tmp.end());
+                        allocs_total++;
+                        if (tmp.size() > 1) {
+                            fragmented_total++;
+                        }
+                    }
+                    while (lvl > low && !held.empty()) {
+                        size_t pos = trng() % held.size();
+                        interval_set<uint64_t> release_set;
+                        release_set.insert(held[pos].offset, held[pos].length);
+                        alloc->release(release_set);
+                        lvl -= held[pos].length;
+                        held[pos] = held.back();
+                        held.pop_back();
+                    }
+                }
+                interval_set<uint64_t> release_set;
+                for (auto &e : held) {
+                    release_set.insert(e.offset, e.length);
+                }
+                alloc->release(release_set);
+            };
+
+            utime_t start = ceph_clock_now();
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; ++t) {
+                workers.emplace_back(worker, t + 1);
+            }
+            for (auto &w : workers) {
+                w.join();
+            }
+            ASSERT_EQ(alloc->get_free(), capacity);
+            std::cout << "    fragmented allocs="
+                      << 100.0 * fragmented_total / std::max<uint64_t>(allocs_total, 1) << "%"
+                      << " time=" << (ceph_clock_now() - start) * 1000 << "ms"
+                      << " after free frag.score=" << alloc->get_fragmentation_score()
+                      << std::endl;
+        }
+    }
+}
+
 TEST_P(AllocTest, test_bonus_empty_fragmented)
 {
     uint64_t capacity = uint64_t(512) * 1024 * 1024 * 1024; //512 G
@@ -481,4 +568,4 @@ TEST_P(AllocTest, test_bonus_empty_fragmented)
 INSTANTIATE_TEST_SUITE_P(
     Allocator,
     AllocTest,
-    ::testing::Values("stupid", "bitmap", "avl", "btree"));
+    ::testing::Values("stupid", "bitmap", "avl", "btree", "sharded"));
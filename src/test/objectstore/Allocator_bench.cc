@@ -5,6 +5,7 @@
  * Author: Igor Fedotov, ifedotov@suse.com
  */
 #include <iostream>
+#include <thread>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 
@@ -329,6 +330,61 @@ TEST_P(AllocTest, test_alloc_bench_10_300)
     doOverwriteTest(capacity, prefill, overwrite);
 }
 
+TEST_P(AllocTest, test_alloc_bench_mt)
+{
+    uint64_t capacity = uint64_t(256) * 1024 * 1024 * 1024;
+    uint64_t alloc_unit = 4096;
+    uint64_t ops_per_thread = 200000;
+
+    for (unsigned threads : {1, 2, 4, 8, 16}) {
+        init_alloc(capacity, alloc_unit);
+        alloc->init_add_free(0, capacity);
+
+        auto worker = [&](unsigned seed) {
+            gen_type rng(seed);
+            boost::uniform_int<> u1(0, 5); // 4K-128K
+            std::vector<bluestore_pextent_t> held;
+            PExtentVector tmp;
+            for (uint64_t i = 0; i < ops_per_thread; ++i) {
+                tmp.clear();
+                uint32_t want = alloc_unit << u1(rng);
+                auto r = alloc->allocate(want, alloc_unit, 0, 0, &tmp);
+                ASSERT_EQ(r, want);
+                held.insert(held.end(), tmp.begin(), tmp.end());
+                // keep about 1K extents per thread, release a random one
+                if (held.size() > 1024) {
+                    size_t pos = rng() % held.size();
+                    interval_set<uint64_t> release_set;
+                    release_set.insert(held[pos].offset, held[pos].length);
+                    alloc->release(release_set);
+                    held[pos] = held.back();
+                    held.pop_back();
+                }
+            }
+            interval_set<uint64_t> release_set;
+            for (auto &e : held) {
+                release_set.insert(e.offset, e.length);
+            }
+            alloc->release(release_set);
+        };
+
+        utime_t start = ceph_clock_now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back(worker, t + 1);
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+        double elapsed = ceph_clock_now() - start;
+        std::cout << GetParam() << " threads " << threads
+                  << " executed in " << elapsed << "s, "
+                  << uint64_t(threads * ops_per_thread / elapsed)
+                  << " alloc+release/s" << std::endl;
+        EXPECT_EQ(capacity, alloc->get_free());
+    }
+}
+
 TEST_P(AllocTest, mempoolAccounting)
 {
     uint64_t bytes = mempool::bluestore_alloc::allocated_bytes();
@@ -366,4 +422,4 @@ TEST_P(AllocTest, mempoolAccounting)
 INSTANTIATE_TEST_SUITE_P(
     Allocator,
     AllocTest,
-    ::testing::Values("stupid", "bitmap", "avl", "btree", "hybrid"));
+    ::testing::Values("stupid", "bitmap", "avl", "btree", "hybrid", "sharded"));
@@ -632,7 +632,40 @@ TEST_P(AllocTest, test_alloc_50656_first_fit)
     EXPECT_EQ(got, 0x400000);
 }
 
+TEST_P(AllocTest, test_alloc_sharded_contiguous)
+{
+    if (string(GetParam()) != "sharded") {
+        return;
+    }
+    uint64_t block = 0x1000;
+    uint64_t unit = 0x10000;
+    uint64_t size = 1ull << 30;
+
+    init_alloc(size, block);
+
+    // plenty of segments in the wanted size class, none of them long enough
+    for (uint64_t i = 0; i < 80; ++i) {
+        alloc->init_add_free(i * 0x40000, 0x2f000);
+    }
+    // the only one which fits lies behind them
+    alloc->init_add_free(0x1800000, 0x30000);
+
+    PExtentVector extents;
+    auto got = alloc->allocate(0x30000, unit, 0, (int64_t)0, &extents);
+    EXPECT_EQ(got, 0x30000);
+    ASSERT_EQ(extents.size(), 1u);
+    EXPECT_EQ(extents[0].offset, 0x1800000u);
+
+    // a fit in a distant region beats splitting the request in this one
+    alloc->init_add_free(0x30000000, 0x30000);
+    extents.clear();
+    got = alloc->allocate(0x30000, unit, 0, (int64_t)0x100000, &extents);
+    EXPECT_EQ(got, 0x30000);
+    ASSERT_EQ(extents.size(), 1u);
+    EXPECT_EQ(extents[0].offset, 0x30000000u);
+}
+
 INSTANTIATE_TEST_SUITE_P(
     Allocator,
     AllocTest,
-    ::testing::Values("stupid", "bitmap", "avl", "hybrid"));
+    ::testing::Values("stupid", "bitmap", "avl", "hybrid", "sharded"));
@@ -0,0 +1,151 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Compare KernelDevice submission engines (libaio, io_uring, io_uring with
+ * registered buffers) on small random direct writes.
+ *
+ * usage: ceph_test_bdev_bench [--path <file or device>] [--size <bytes>]
+ *          [--block-size <bytes>] [--ops <count>] [--queue-depth <n>]
+ */
+
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <random>
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "common/ceph_context.h"
+#include "common/Clock.h"
+#include "common/errno.h"
+#include "include/stringify.h"
+
+#include "blk/BlockDevice.h"
+
+using namespace std;
+
+struct engine_t {
+    const char *name;
+    bool ioring;
+    unsigned fixed_buffers;
+};
+
+static double cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int run(const engine_t &e, const string &path, uint64_t size,
+               uint64_t block_size, uint64_t ops, unsigned qd)
+{
+    auto &conf = g_ceph_context->_conf;
+    conf.set_val("bdev_ioring", e.ioring ? "true" : "false");
+    conf.set_val("bdev_ioring_fixed_buffers", stringify(e.fixed_buffers));
+    conf.set_val("bdev_ioring_fixed_buffer_size", stringify(block_size));
+    conf.apply_changes(nullptr);
+
+    std::unique_ptr<BlockDevice> bdev(
+        BlockDevice::create(g_ceph_context, path, nullptr, nullptr,
+    [](void *handle, void *aio) {}, nullptr));
+    int r = bdev->open(path);
+    if (r < 0) {
+        cerr << "failed to open " << path << ": " << cpp_strerror(r) << std::endl;
+        return r;
+    }
+
+    bufferlist bl;
+    bl.append_zero(block_size);
+    bl.rebuild_aligned(CEPH_PAGE_SIZE);
+
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<uint64_t> dist(0, size / block_size - 1);
+
+    double cpu_start = cpu_seconds();
+    auto start = mono_clock::now();
+    for (uint64_t done = 0; done < ops; ) {
+        IOContext ioc(g_ceph_context, nullptr);
+        for (unsigned i = 0; i < qd && done < ops; i++, done++) {
+            r = bdev->aio_write(dist(rng) * block_size, bl, &ioc, false);
+            ceph_assert(r == 0);
+        }
+        bdev->aio_submit(&ioc);
+        ioc.aio_wait();
+    }
+    double secs = std::chrono::duration<double>(mono_clock::now() - start).count();
+    double cpu = cpu_seconds() - cpu_start;
+    bdev->close();
+
+    cout << e.name << ": " << ops << " x " << block_size << " writes, qd " << qd
+         << ", " << (uint64_t)(ops / secs) << " iops, "
+         << cpu * 1e6 / ops << " cpu us/op" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    auto args = argv_to_vec(argc, argv);
+    auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_CLIENT,
+                           CODE_ENVIRONMENT_UTILITY,
+                           CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+    common_init_finish(g_ceph_context);
+
+    string path;
+    uint64_t size = 1ull << 30;
+    uint64_t block_size = 4096;
+    uint64_t ops = 100000;
+    unsigned qd = 32;
+    string val;
+    for (auto i = args.begin(); i != args.end(); ) {
+        if (ceph_argparse_double_dash(args, i)) {
+            break;
+        } else if (ceph_argparse_witharg(args, i, &val, "--path", (char *)NULL)) {
+            path = val;
+        } else if (ceph_argparse_witharg(args, i, &val, "--size", (char *)NULL)) {
+            size = strtoull(val.c_str(), nullptr, 10);
+        } else if (ceph_argparse_witharg(args, i, &val, "--block-size", (char *)NULL)) {
+            block_size = strtoull(val.c_str(), nullptr, 10);
+        } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char *)NULL)) {
+            ops = strtoull(val.c_str(), nullptr, 10);
+        } else if (ceph_argparse_witharg(args, i, &val, "--queue-depth", (char *)NULL)) {
+            qd = strtoul(val.c_str(), nullptr, 10);
+        } else {
+            cerr << "unknown argument " << *i << std::endl;
+            return 1;
+        }
+    }
+
+    bool temp_file = path.empty();
+    if (temp_file) {
+        // O_DIRECT is needed, so stay out of /tmp which may be a tmpfs
+        path = "ceph_test_bdev_bench.tmp.block." + stringify(getpid());
+        int fd = ::open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        ceph_assert(fd >= 0);
+        int r = ::ftruncate(fd, size);
+        ceph_assert(r >= 0);
+        ::close(fd);
+    }
+
+    const engine_t engines[] = {
+        { "libaio", false, 0 },
+        { "io_uring", true, 0 },
+        { "io_uring+fixed_buffers", true, qd },
+    };
+    int r = 0;
+    for (auto &e : engines) {
+        r = run(e, path, size, block_size, ops, qd);
+        if (r < 0) {
+            break;
+        }
+    }
+
+    if (temp_file) {
+        ::unlink(path.c_str());
+    }
+    return r < 0 ? 1 : 0;
+}
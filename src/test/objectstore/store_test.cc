@@ -34,6 +34,7 @@
 #include "common/buffer_instrumentation.h"
 #include "common/ceph_argparse.h"
 #include "common/admin_socket.h"
+#include "common/ceph_json.h"
 #include "global/global_init.h"
 #include "common/ceph_mutex.h"
 #include "common/Cond.h"
@@ -1627,6 +1628,511 @@ TEST_P(StoreTestSpecificAUSize, ReproBug41901Test)
 }
 
 
+TEST_P(StoreTest, BluestoreReadaheadTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_readahead_max_bytes", "1048576");
+    SetVal(g_conf(), "bluestore_readahead_trigger_requests", "2");
+    g_conf().apply_changes(nullptr);
+
+    int r;
+    coll_t cid;
+    ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+    const PerfCounters *logger = store->get_perf_counters();
+    auto ch = store->create_new_collection(cid);
+    const uint64_t obj_size = 4 << 20;
+    const uint64_t chunk = 64 << 10;
+    bufferlist data;
+    for (uint64_t i = 0; i < obj_size / chunk; ++i) {
+        data.append(string(chunk, 'a' + i % 26));
+    }
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        t.write(cid, hoid, 0, data.length(), data,
+                CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    auto ra_count = logger->get(l_bluestore_readahead_count);
+    auto hit_bytes = logger->get(l_bluestore_buffer_hit_bytes);
+    for (uint64_t off = 0; off < obj_size; off += chunk) {
+        bufferlist bl, expected;
+        r = store->read(ch, hoid, off, chunk, bl);
+        ASSERT_EQ((int)chunk, r);
+        expected.substr_of(data, off, chunk);
+        ASSERT_TRUE(bl_eq(expected, bl));
+    }
+    ASSERT_GT(logger->get(l_bluestore_readahead_count), ra_count);
+    ASSERT_GT(logger->get(l_bluestore_buffer_hit_bytes), hit_bytes);
+    {
+        ObjectStore::Transaction t;
+        t.remove(cid, hoid);
+        t.remove_collection(cid);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+}
+
+
+TEST_P(StoreTest, BluestoreKvPipelineTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_kv_sync_pipeline", "true");
+    SetVal(g_conf(), "bluestore_kv_finalize_threads", "3");
+    g_conf().apply_changes(nullptr);
+    int r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    const unsigned num_colls = 8;
+    const unsigned num_writes = 64;
+    ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+    vector<coll_t> cids;
+    vector<ObjectStore::CollectionHandle> chs;
+    for (unsigned i = 0; i < num_colls; ++i) {
+        cids.emplace_back(spg_t(pg_t(i, 0)));
+        chs.push_back(store->create_new_collection(cids.back()));
+        ObjectStore::Transaction t;
+        t.create_collection(cids.back(), 0);
+        r = queue_transaction(store, chs.back(), std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    // small overwrites go deferred, so both the commit and the deferred
+    // cleanup paths get spread over the finalize shards
+    vector<std::unique_ptr<C_SaferCond>> conds;
+    for (unsigned w = 0; w < num_writes; ++w) {
+        for (unsigned i = 0; i < num_colls; ++i) {
+            bufferlist bl;
+            bl.append(string(4096, 'a' + (i + w) % 26));
+            ObjectStore::Transaction t;
+            t.write(cids[i], hoid, (w % 16) * 4096, bl.length(), bl);
+            if (w == num_writes - 1) {
+                conds.emplace_back(new C_SaferCond);
+                t.register_on_commit(conds.back().get());
+            }
+            store->queue_transaction(chs[i], std::move(t));
+        }
+    }
+    for (auto &c : conds) {
+        c->wait();
+    }
+    chs.clear();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+    for (unsigned i = 0; i < num_colls; ++i) {
+        auto ch = store->open_collection(cids[i]);
+        ASSERT_TRUE(ch);
+        for (unsigned w = num_writes - 16; w < num_writes; ++w) {
+            bufferlist bl;
+            r = store->read(ch, hoid, (w % 16) * 4096, 4096, bl);
+            ASSERT_EQ(4096, r);
+            ASSERT_EQ(string(4096, 'a' + (i + w) % 26), bl.to_str());
+        }
+        ObjectStore::Transaction t;
+        t.remove(cids[i], hoid);
+        t.remove_collection(cids[i]);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+}
+
+TEST_P(StoreTest, BluestoreAllocationJournalTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_allocation_journal", "true");
+    // small enough to checkpoint a few times while running
+    SetVal(g_conf(), "bluestore_allocation_journal_max_size", "4096");
+    g_conf().apply_changes(nullptr);
+    int r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    const PerfCounters *logger = store->get_perf_counters();
+    coll_t cid;
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    for (unsigned i = 0; i < 256; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        bl.append(string(65536, 'a' + i % 26));
+        ObjectStore::Transaction t;
+        t.write(cid, hoid, 0, bl.length(), bl);
+        if (i >= 8) {
+            // releases, so that some of the space gets reused
+            ghobject_t old(hobject_t(sobject_t("Object " + stringify(i - 8), CEPH_NOSNAP)));
+            t.remove(cid, old);
+        }
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    if (logger->get(l_bluestore_alloc_journal_records) == 0) {
+        GTEST_SKIP() << "allocation info kept in the freelist, skipping";
+    }
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    // checkpoints are written in the background, umount waits for them
+    ASSERT_GT(logger->get(l_bluestore_alloc_journal_checkpoints), 0u);
+    ASSERT_EQ(store->fsck(false), 0);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    ch = store->open_collection(cid);
+    ASSERT_TRUE(ch);
+    ObjectStore::Transaction t;
+    for (unsigned i = 248; i < 256; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        r = store->read(ch, hoid, 0, 65536, bl);
+        ASSERT_EQ(65536, r);
+        ASSERT_EQ(string(65536, 'a' + i % 26), bl.to_str());
+        t.remove(cid, hoid);
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+}
+
+TEST_P(StoreTest, BluestoreAllocationJournalReplayTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_allocation_journal", "true");
+    SetVal(g_conf(), "bluestore_allocation_journal_max_size", "4096");
+    g_conf().apply_changes(nullptr);
+    int r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    const PerfCounters *logger = store->get_perf_counters();
+    coll_t cid;
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    for (unsigned i = 0; i < 64; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        bl.append(string(65536, 'a' + i % 26));
+        ObjectStore::Transaction t;
+        t.write(cid, hoid, 0, bl.length(), bl);
+        if (i % 4 == 3) {
+            ghobject_t old(hobject_t(sobject_t("Object " + stringify(i - 2), CEPH_NOSNAP)));
+            t.remove(cid, old);
+        }
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    if (logger->get(l_bluestore_alloc_journal_records) == 0) {
+        GTEST_SKIP() << "allocation info kept in the freelist, skipping";
+    }
+    {
+        // the txcs before it have been released to the allocator by now
+        ObjectStore::Transaction t;
+        t.touch(cid, ghobject_t(hobject_t(sobject_t("barrier", CEPH_NOSNAP))));
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    store_statfs_t before;
+    r = store->statfs(&before);
+    ASSERT_EQ(r, 0);
+
+    // leave the allocation file as a crash would: the last checkpoint plus
+    // whatever was journaled after it
+    SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "true");
+    g_conf().apply_changes(nullptr);
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "false");
+    g_conf().apply_changes(nullptr);
+
+    uint64_t replayed = logger->get(l_bluestore_alloc_journal_replayed);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+    ASSERT_GT(logger->get(l_bluestore_alloc_journal_replayed), replayed);
+    store_statfs_t after;
+    r = store->statfs(&after);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(before.available, after.available);
+
+    ch = store->open_collection(cid);
+    ASSERT_TRUE(ch);
+    for (unsigned i = 0; i < 64; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        r = store->read(ch, hoid, 0, 65536, bl);
+        if (i % 4 == 1) {
+            ASSERT_EQ(-ENOENT, r);
+            continue;
+        }
+        ASSERT_EQ(65536, r);
+        ASSERT_EQ(string(65536, 'a' + i % 26), bl.to_str());
+    }
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(store->fsck(false), 0);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+}
+
+TEST_P(StoreTest, BluestoreAllocationJournalBlueFSGrowthTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_allocation_journal", "true");
+    SetVal(g_conf(), "bluestore_allocation_journal_max_size", "4096");
+    g_conf().apply_changes(nullptr);
+    int r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+
+    const PerfCounters *logger = store->get_perf_counters();
+    coll_t cid;
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    for (unsigned i = 0; i < 16; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        bl.append(string(65536, 'a' + i % 26));
+        ObjectStore::Transaction t;
+        t.write(cid, hoid, 0, bl.length(), bl);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    if (logger->get(l_bluestore_alloc_journal_records) == 0) {
+        GTEST_SKIP() << "allocation info kept in the freelist, skipping";
+    }
+    BlueStore *bstore = dynamic_cast<BlueStore *>(store.get());
+    ceph_assert(bstore);
+    // BlueFS takes space from the main device behind the journal's back
+    bstore->inject_bluefs_file("db", "store_test_alloc_journal", 16 << 20);
+    store_statfs_t before;
+    r = store->statfs(&before);
+    ASSERT_EQ(r, 0);
+
+    SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "true");
+    g_conf().apply_changes(nullptr);
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "false");
+    g_conf().apply_changes(nullptr);
+
+    r = store->mount();
+    ASSERT_EQ(0, r);
+    store_statfs_t after;
+    r = store->statfs(&after);
+    ASSERT_EQ(r, 0);
+    // the space BlueFS grew into must not be free again
+    ASSERT_EQ(before.available, after.available);
+
+    ch = store->open_collection(cid);
+    ASSERT_TRUE(ch);
+    for (unsigned i = 0; i < 16; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+        bufferlist bl;
+        r = store->read(ch, hoid, 0, 65536, bl);
+        ASSERT_EQ(65536, r);
+        ASSERT_EQ(string(65536, 'a' + i % 26), bl.to_str());
+    }
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(store->fsck(false), 0);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+}
+
+TEST_P(StoreTest, BluestoreAllocationRecoveryThreadsTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    const PerfCounters *logger = store->get_perf_counters();
+    const unsigned num_colls = 8;
+    const unsigned num_objects = 32;
+    int r;
+    std::vector<coll_t> cids;
+    for (unsigned c = 0; c < num_colls; ++c) {
+        coll_t cid(spg_t(pg_t(c, 1), shard_id_t::NO_SHARD));
+        cids.push_back(cid);
+        auto ch = store->create_new_collection(cid);
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 4);
+        for (unsigned i = 0; i < num_objects; ++i) {
+            ghobject_t hoid(hobject_t("obj" + stringify(i), "", CEPH_NOSNAP,
+                                      c | (i << 8), 1, ""));
+            bufferlist bl;
+            bl.append(string(4096 * (1 + i % 4), 'a' + c));
+            t.write(cid, hoid, 0, bl.length(), bl);
+        }
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+
+    // unmount without saving the allocation map and rebuild it from the
+    // onodes, single threaded first
+    auto rebuild = [&](const char *threads, store_statfs_t *st, uint64_t *onodes) {
+        SetVal(g_conf(), "bluestore_allocation_recovery_threads", threads);
+        SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "true");
+        g_conf().apply_changes(nullptr);
+        ASSERT_EQ(0, store->umount());
+        SetVal(g_conf(), "bluestore_debug_omit_allocation_destage", "false");
+        g_conf().apply_changes(nullptr);
+        uint64_t before = logger->get(l_bluestore_alloc_recovery_onodes);
+        ASSERT_EQ(0, store->mount());
+        *onodes = logger->get(l_bluestore_alloc_recovery_onodes) - before;
+        ASSERT_EQ(0, store->statfs(st));
+    };
+    store_statfs_t single, parallel;
+    uint64_t single_onodes = 0, parallel_onodes = 0;
+    ASSERT_NO_FATAL_FAILURE(rebuild("1", &single, &single_onodes));
+    if (single_onodes == 0) {
+        GTEST_SKIP() << "allocation info kept in the freelist, skipping";
+    }
+    ASSERT_GE(single_onodes, num_colls * num_objects);
+    // the ranges must not overlap even where iterators ignore their bounds
+    SetVal(g_conf(), "osd_rocksdb_iterator_bounds_enabled", "false");
+    ASSERT_NO_FATAL_FAILURE(rebuild("4", &parallel, &parallel_onodes));
+    ASSERT_EQ(single_onodes, parallel_onodes);
+    ASSERT_EQ(single.allocated, parallel.allocated);
+    ASSERT_EQ(single.data_stored, parallel.data_stored);
+    SetVal(g_conf(), "osd_rocksdb_iterator_bounds_enabled", "true");
+    g_conf().apply_changes(nullptr);
+    ASSERT_EQ(0, store->umount());
+    ASSERT_EQ(store->fsck(false), 0);
+    ASSERT_EQ(0, store->mount());
+
+    for (unsigned c = 0; c < num_colls; ++c) {
+        auto ch = store->open_collection(cids[c]);
+        ASSERT_TRUE(ch);
+        ObjectStore::Transaction t;
+        for (unsigned i = 0; i < num_objects; ++i) {
+            t.remove(cids[c], ghobject_t(hobject_t("obj" + stringify(i), "", CEPH_NOSNAP,
+                                                   c | (i << 8), 1, "")));
+        }
+        t.remove_collection(cids[c]);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+}
+
+TEST_P(StoreTest, BluestoreCompressionDictTest)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_compression_mode", "force");
+    SetVal(g_conf(), "bluestore_compression_algorithm", "zstd");
+    g_conf().apply_changes(nullptr);
+    BlueStore *bstore = dynamic_cast<BlueStore *>(store.get());
+    ASSERT_TRUE(bstore);
+
+    int poolid = 4374;
+    coll_t cid = coll_t(spg_t(pg_t(0, poolid), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        int r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    auto make_object = [&](unsigned i) {
+        string s;
+        while (s.size() < 12288) {
+            s += "{\"key\": \"obj-" + stringify(i) + "-" + stringify(s.size()) +
+                 "\", \"owner\": \"user-" + stringify(i % 7) +
+                 "\", \"storage_class\": \"STANDARD\"}\n";
+        }
+        return s.substr(0, 12288);
+    };
+    auto oid = [&](unsigned i) {
+        return ghobject_t(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP),
+                                    string(), i, poolid, string()));
+    };
+    for (unsigned i = 0; i < 200; ++i) {
+        bufferlist bl;
+        bl.append(make_object(i));
+        ObjectStore::Transaction t;
+        t.write(cid, oid(i), 0, bl.length(), bl);
+        int r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+
+    const PerfCounters *logger = store->get_perf_counters();
+    ASSERT_EQ(0u, logger->get(l_bluestore_compress_dict_count));
+
+    JSONFormatter f;
+    int r = bstore->train_compression_dict(poolid, 200, 16384, 4096, &f);
+    if (r == -ENOENT) {
+        GTEST_SKIP() << "zstd not available, skipping";
+    }
+    ASSERT_EQ(0, r);
+
+    // written with the dictionary
+    uint64_t compressed = logger->get(l_bluestore_compress_success_count);
+    for (unsigned i = 200; i < 210; ++i) {
+        bufferlist bl;
+        bl.append(make_object(i));
+        ObjectStore::Transaction t;
+        t.write(cid, oid(i), 0, bl.length(), bl);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    compressed = logger->get(l_bluestore_compress_success_count) - compressed;
+    ASSERT_GT(compressed, 0u);
+    ASSERT_EQ(compressed, logger->get(l_bluestore_compress_dict_count));
+    // and still readable once the dictionary comes from the db
+    ch.reset();
+    r = store->umount();
+    ASSERT_EQ(0, r);
+    r = store->mount();
+    ASSERT_EQ(0, r);
+    ch = store->open_collection(cid);
+    ASSERT_TRUE(ch);
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < 210; ++i) {
+        bufferlist bl;
+        r = store->read(ch, oid(i), 0, 12288, bl);
+        ASSERT_EQ(12288, r);
+        ASSERT_EQ(make_object(i), bl.to_str());
+        t.remove(cid, oid(i));
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+}
+
 TEST_P(StoreTestSpecificAUSize, BluestoreStatFSTest)
 {
     if (string(GetParam()) != "bluestore") {
@@ -3830,6 +4336,107 @@ TEST_P(StoreTest, SimpleCloneRangeTest)
 }
 
 #if defined(WITH_BLUESTORE)
+TEST_P(StoreTest, BlueStoreTxcStateLatency)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    SetVal(g_conf(), "bluestore_txc_timeline_sample_rate", "1");
+    g_conf().apply_changes(nullptr);
+
+    {
+        // an unmounted second instance must leave the commands alone
+        BlueStore other(g_ceph_context, "store_test_temp_dir.other");
+    }
+
+    int r;
+    coll_t cid;
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    const unsigned num_writes = 10;
+    for (unsigned i = 0; i < num_writes; ++i) {
+        ghobject_t hoid(hobject_t(sobject_t("txc_lat_" + stringify(i),
+                                            CEPH_NOSNAP)));
+        ObjectStore::Transaction t;
+        bufferlist bl;
+        bl.append(std::string(4096 * (i + 1), 'a'));
+        t.write(cid, hoid, 0, bl.length(), bl);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    ch->flush();
+
+    {
+        // every txc passed through kv_committing
+        const PerfCounters *logger = store->get_perf_counters();
+        JSONFormatter f;
+        logger->dump_formatted_histograms(&f, false,
+                                          "state_kv_committing_lat_histogram");
+        stringstream ss;
+        f.flush(ss);
+        JSONParser parser;
+        ASSERT_TRUE(parser.parse(ss.str().c_str(), ss.str().length()));
+        JSONObj *h = parser.find_obj(logger->get_name());
+        ASSERT_TRUE(h);
+        h = h->find_obj("state_kv_committing_lat_histogram");
+        ASSERT_TRUE(h);
+        std::vector<std::vector<uint64_t>> values;
+        JSONDecoder::decode_json("values", values, h);
+        uint64_t total = 0;
+        for (auto &row : values) {
+            for (auto v : row) {
+                total += v;
+            }
+        }
+        ASSERT_GE(total, num_writes + 1);
+    }
+
+    AdminSocket *admin_socket = g_ceph_context->get_admin_socket();
+    ceph_assert(admin_socket);
+    ceph::bufferlist in, out;
+    ostringstream err;
+    std::string dump;
+    // timelines are recorded just after the txcs leave the sequencer
+    for (int tries = 0; tries < 100; ++tries) {
+        out.clear();
+        r = admin_socket->execute_command(
+        { "{\"prefix\": \"bluestore txc slowest\", \"count\": 5}" },
+        in, err, &out);
+        ASSERT_EQ(r, 0) << err.str();
+        JSONParser parser;
+        ASSERT_TRUE(parser.parse(out.c_str(), out.length()));
+        if (parser.get_array_elements().size() == 5) {
+            dump = out.to_str();
+            break;
+        }
+        usleep(10000);
+    }
+    std::cout << dump << std::endl;
+    ASSERT_FALSE(dump.empty());
+    ASSERT_NE(string::npos, dump.find("\"kv_committing\""));
+
+    r = admin_socket->execute_command(
+    { "{\"prefix\": \"bluestore txc slowest\", \"count\": 0}" },
+    in, err, &out);
+    ASSERT_EQ(r, -EINVAL);
+
+    {
+        ObjectStore::Transaction t;
+        for (unsigned i = 0; i < num_writes; ++i) {
+            t.remove(cid, ghobject_t(hobject_t(sobject_t("txc_lat_" + stringify(i),
+                                                         CEPH_NOSNAP))));
+        }
+        t.remove_collection(cid);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+}
+
 TEST_P(StoreTest, BlueStoreUnshareBlobTest)
 {
     if (string(GetParam()) != "bluestore") {
@@ -8495,6 +9102,89 @@ TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite2)
     }
 }
 
+TEST_P(StoreTestSpecificAUSize, DeferredMergeInBatch)
+{
+    if (string(GetParam()) != "bluestore") {
+        return;
+    }
+    if (smr) {
+        cout << "SKIP: no deferred" << std::endl;
+        return;
+    }
+
+    // submit every deferred write as soon as it is queued for now
+    SetVal(g_conf(), "bluestore_deferred_batch_ops", "1");
+    SetVal(g_conf(), "bluestore_max_defer_interval", "0");
+    StartDeferred(65536);
+
+    int r;
+    coll_t cid;
+    ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+
+    PerfCounters *logger = const_cast<PerfCounters *>(store->get_perf_counters());
+
+    auto ch = store->create_new_collection(cid);
+    {
+        ObjectStore::Transaction t;
+        t.create_collection(cid, 0);
+        bufferlist bl;
+        bl.append(std::string(65536, 'a'));
+        t.write(cid, hoid, 0, bl.length(), bl);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    ch->flush();
+
+    // now let the next four txcs end up in a single batch
+    SetVal(g_conf(), "bluestore_deferred_batch_ops", "4");
+    g_conf().apply_changes(nullptr);
+    logger->reset();
+    struct {
+        uint64_t offset;
+        char c;
+    } writes[] = {
+        { 0x1000, 'b' },
+        { 0x2000, 'c' },  // abuts the first one
+        { 0x2000, 'd' },  // overwrites the second one
+        { 0x8000, 'e' },  // disjoint
+    };
+    for (auto &w : writes) {
+        // chunk aligned overwrites of an allocated blob are deferred
+        ObjectStore::Transaction t;
+        bufferlist bl;
+        bl.append(std::string(0x1000, w.c));
+        t.write(cid, hoid, w.offset, bl.length(), bl);
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+    ch->flush();
+
+    ASSERT_EQ(logger->get(l_bluestore_issued_deferred_writes), 4u);
+    ASSERT_EQ(logger->get(l_bluestore_submitted_deferred_writes), 2u);
+    ASSERT_EQ(logger->get(l_bluestore_deferred_write_merged_ios), 2u);
+    ASSERT_EQ(logger->get(l_bluestore_deferred_write_merged_bytes), 0x1000u);
+    {
+        bufferlist bl, expected;
+        expected.append(std::string(0x1000, 'a'));
+        expected.append(std::string(0x1000, 'b'));
+        expected.append(std::string(0x1000, 'd'));
+        expected.append(std::string(0x5000, 'a'));
+        expected.append(std::string(0x1000, 'e'));
+        r = store->read(ch, hoid, 0, expected.length(), bl);
+        ASSERT_EQ(r, (int)expected.length());
+        ASSERT_TRUE(bl_eq(expected, bl));
+    }
+
+    {
+        ObjectStore::Transaction t;
+        t.remove(cid, hoid);
+        t.remove_collection(cid);
+        cerr << "Cleaning" << std::endl;
+        r = queue_transaction(store, ch, std::move(t));
+        ASSERT_EQ(r, 0);
+    }
+}
+
 TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite3)
 {
 
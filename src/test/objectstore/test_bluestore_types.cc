@@ -15,6 +15,7 @@
 #include "perfglue/heap_profiler.h"
 
 #include <sstream>
+#include <thread>
 
 #define _STR(x) #x
 #define STRINGIFY(x) _STR(x)
@@ -427,6 +428,59 @@ TEST(bluestore_blob_t, csum_bench)
     }
 }
 
+TEST(OnodeCacheShard, lookup_bench)
+{
+    // measure lookup + unpin cost of hot onodes with several threads
+    // hammering the same cache shard
+    const unsigned num_onodes = 1024;
+    const unsigned num_threads = 8;
+    const unsigned lookups = 200000;
+    for (auto type : { "lru", "clock" }) {
+        BlueStore store(g_ceph_context, "", 4096);
+        PerfCounters *logger = const_cast<PerfCounters *>(store.get_perf_counters());
+        BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+                                             g_ceph_context, type, logger);
+        BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+                                              g_ceph_context, "lru", logger);
+        oc->set_max(num_onodes * 2);
+        auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+
+        std::vector<ghobject_t> oids;
+        for (unsigned i = 0; i < num_onodes; ++i) {
+            ghobject_t oid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+            BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), oid, ""));
+            o->exists = true;
+            coll->onode_space.add_onode(oid, o);
+            oids.push_back(oid);
+        }
+
+        ceph::mono_clock::time_point start = ceph::mono_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t] {
+                for (unsigned i = 0; i < lookups; ++i) {
+                    auto o = coll->onode_space.lookup(oids[(i * 7 + t) % num_onodes]);
+                    ceph_assert(o);
+                }
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        ceph::mono_clock::time_point end = ceph::mono_clock::now();
+        auto dur = std::chrono::duration_cast<ceph::timespan>(end - start);
+        cout << "onode cache " << type << ", " << num_threads << " threads, "
+             << (double)dur.count() / (num_threads * lookups) << " ns/lookup"
+             << std::endl;
+
+        uint64_t onodes = 0, pinned = 0;
+        oc->add_stats(&onodes, &pinned);
+        ASSERT_EQ(num_onodes, onodes);
+        ASSERT_EQ(0u, pinned);
+        coll->onode_space.clear();
+    }
+}
+
 TEST(Blob, put_ref)
 {
     {
@@ -1172,6 +1226,55 @@ TEST(ExtentMap, seek_lextent)
     ASSERT_EQ(em.extent_map.end(), em.seek_lextent(500));
 }
 
+TEST(ExtentMap, pack_clean_shards)
+{
+    BlueStore store(g_ceph_context, "", 4096);
+    BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+                                         g_ceph_context, "lru", NULL);
+    BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+                                          g_ceph_context, "lru", NULL);
+
+    auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+    BlueStore::Onode onode(coll.get(), ghobject_t(), "");
+    auto &em = onode.extent_map;
+
+    const uint32_t shard_size = 0x10000;
+    for (uint32_t i = 0; i < 2; ++i) {
+        BlueStore::BlobRef b(new BlueStore::Blob);
+        b->shared_blob = new BlueStore::SharedBlob(coll.get());
+        b->dirty_blob().allocated_test(
+             bluestore_pextent_t(0x100000 + i * shard_size, 0x2000));
+        b->get_ref(coll.get(), 0, 0x2000);
+        em.extent_map.insert(*new BlueStore::Extent(i * shard_size, 0, 0x2000, b));
+
+        bluestore_onode_t::shard_info si;
+        si.offset = i * shard_size;
+        bufferlist bl;
+        unsigned n;
+        ASSERT_FALSE(em.encode_some(si.offset, shard_size, bl, &n));
+        si.bytes = bl.length();
+        onode.onode.extent_map_shards.push_back(si);
+    }
+    em.init_shards(true, false);
+    em.shards[1].dirty = true;
+
+    // only the clean shard gets packed
+    ASSERT_EQ(1u, em.pack_clean_shards());
+    ASSERT_FALSE(em.shards[0].loaded);
+    ASSERT_EQ(em.shards[0].shard_info->bytes, em.shards[0].packed.length());
+    ASSERT_EQ(1u, em.extent_map.size());
+
+    // decoded back from memory, no db access
+    em.fault_range(nullptr, 0, 2 * shard_size);
+    ASSERT_TRUE(em.shards[0].loaded);
+    ASSERT_EQ(0u, em.shards[0].packed.length());
+    ASSERT_EQ(2u, em.extent_map.size());
+    auto p = em.find(0);
+    ASSERT_NE(em.extent_map.end(), p);
+    ASSERT_EQ(0x2000u, p->length);
+    ASSERT_EQ(0x100000u, p->blob->get_blob().get_extents()[0].offset);
+}
+
 TEST(ExtentMap, has_any_lextents)
 {
     BlueStore store(g_ceph_context, "", 4096);
@@ -1944,6 +2047,41 @@ static int test_extents(uint64_t index, extent_t *ext_arr, uint64_t ext_arr_size
 }
 
 //---------------------------------------------------------------------------------
+TEST(bluestore_compression_header_t, dict_id_compat)
+{
+    bluestore_compression_header_t plain(Compressor::COMP_ALG_ZSTD);
+    plain.length = 100;
+    bufferlist bl;
+    encode(plain, bl);
+    // without a dictionary the header stays v2, decodable by older code
+    ASSERT_EQ(2u, (unsigned)(uint8_t)bl[0]);
+    ASSERT_EQ(1u, (unsigned)(uint8_t)bl[1]);
+
+    bluestore_compression_header_t with_dict(plain);
+    with_dict.set_dict(7);
+    bufferlist bl2;
+    encode(with_dict, bl2);
+    ASSERT_EQ(3u, (unsigned)(uint8_t)bl2[0]);
+    ASSERT_EQ(bl.length() + sizeof(uint32_t), bl2.length());
+
+    bluestore_compression_header_t out;
+    auto p = bl2.cbegin();
+    decode(out, p);
+    ASSERT_EQ(7u, out.dict_id);
+    ASSERT_EQ(100u, out.length);
+    ASSERT_EQ(Compressor::COMP_ALG_ZSTD, out.get_alg());
+    // older code takes type as the algorithm, finds none and fails the read
+    ASSERT_NE(Compressor::COMP_ALG_ZSTD, out.type);
+    ASSERT_FALSE(Compressor::create(g_ceph_context, out.type));
+
+    out = bluestore_compression_header_t();
+    p = bl.cbegin();
+    decode(out, p);
+    ASSERT_EQ(0u, out.dict_id);
+    ASSERT_EQ(Compressor::COMP_ALG_ZSTD, out.type);
+    ASSERT_EQ(Compressor::COMP_ALG_ZSTD, out.get_alg());
+}
+
 TEST(SimpleBitmap, basic)
 {
     const uint64_t MAX_EXTENTS_COUNT = 7131177;
@@ -2056,6 +2194,30 @@ static int test_intersections(unsigned test_idx, SimpleBitmap &sbmap, uint8_t ma
 }
 
 //---------------------------------------------------------------------------------
+TEST(DeferredBatch, merge)
+{
+    BlueStore::DeferredBatch b(g_ceph_context, nullptr);
+    bufferlist data;
+    data.append(std::string(0x3000, 'a'));
+    auto p = data.cbegin();
+    b.prepare_write(g_ceph_context, 1, 0x1000, 0x2000, p);
+    // adjacent extent from another txc
+    p = data.cbegin();
+    b.prepare_write(g_ceph_context, 2, 0x3000, 0x1000, p);
+    // overlaps the tail of seq 1
+    p = data.cbegin();
+    b.prepare_write(g_ceph_context, 3, 0x2000, 0x1000, p);
+    // disjoint
+    p = data.cbegin();
+    b.prepare_write(g_ceph_context, 4, 0x10000, 0x1000, p);
+
+    ASSERT_EQ(4u, b.queued_ios);
+    ASSERT_EQ(0x1000u, b.overwritten_bytes);
+    ASSERT_EQ(4u, b.iomap.size());
+    ASSERT_EQ(0x1000, b.seq_bytes[1]);
+    ASSERT_EQ(0x1000, b.seq_bytes[3]);
+}
+
 TEST(SimpleBitmap, intersection)
 {
     const uint64_t MAP_SIZE = 1ULL << 30;  // 1G
@@ -20,6 +20,7 @@
 #include "kv/KeyValueDB.h"
 #include "kv/RocksDBStore.h"
 #include "include/Context.h"
+#include "include/stringify.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 #include "common/Cond.h"
@@ -371,6 +372,84 @@ TEST_P(KVTest, ShardingRMRange)
     fini();
 }
 
+TEST_P(KVTest, MultiGet)
+{
+    // sharded and unsharded prefixes mixed in a single batch
+    std::string cfs(string(GetParam()) == "rocksdb" ? "O(7)=" : "");
+    ASSERT_EQ(0, db->create_and_open(cout, cfs));
+    {
+        KeyValueDB::Transaction t = db->get_transaction();
+        for (size_t i = 0; i < 100; i += 2) {
+            bufferlist value;
+            value.append("O" + stringify(i));
+            t->set("O", "key" + stringify(i), value);
+            value.clear();
+            value.append("P" + stringify(i));
+            t->set("P", "key" + stringify(i), value);
+        }
+        db->submit_transaction_sync(t);
+    }
+
+    std::vector<std::pair<std::string, std::string>> keys;
+    for (size_t i = 0; i < 100; i++) {
+        keys.emplace_back(i % 3 ? "O" : "P", "key" + stringify(i));
+    }
+    std::vector<bufferlist> values;
+    std::vector<int> rs;
+    db->multi_get(keys, &values, &rs);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), rs.size());
+    for (size_t i = 0; i < 100; i++) {
+        if (i % 2) {
+            ASSERT_EQ(-ENOENT, rs[i]);
+            ASSERT_EQ(0u, values[i].length());
+        } else {
+            ASSERT_EQ(0, rs[i]);
+            ASSERT_EQ(keys[i].first + stringify(i), _bl_to_str(values[i]));
+        }
+    }
+
+    fini();
+}
+
+
+TEST_P(KVTest, IteratorViews)
+{
+    // the views must match the copying accessors for both plain and
+    // sharded prefixes
+    std::string cfs(string(GetParam()) == "rocksdb" ? "O(3)=" : "");
+    ASSERT_EQ(0, db->create_and_open(cout, cfs));
+    {
+        KeyValueDB::Transaction t = db->get_transaction();
+        for (size_t i = 0; i < 20; i++) {
+            bufferlist value;
+            value.append("value" + stringify(i));
+            t->set("O", "key" + stringify(i), value);
+            t->set("P", "key" + stringify(i), value);
+        }
+        bufferlist empty;
+        t->set("P", "nil", empty);
+        db->submit_transaction_sync(t);
+    }
+    for (auto prefix : { "O", "P" }) {
+        size_t n = 0;
+        KeyValueDB::Iterator it = db->get_iterator(prefix);
+        for (it->seek_to_first(); it->valid(); it->next(), n++) {
+            ASSERT_EQ(it->key(), it->key_as_sv());
+            ASSERT_EQ(_bl_to_str(it->value()), it->value_as_sv());
+        }
+        ASSERT_EQ(string(prefix) == "P" ? 21u : 20u, n);
+    }
+    {
+        KeyValueDB::WholeSpaceIterator it = db->get_wholespace_iterator();
+        for (it->seek_to_first(); it->valid(); it->next()) {
+            ASSERT_EQ(it->key(), it->key_as_sv());
+            ASSERT_EQ(_bl_to_str(it->value()), it->value_as_sv());
+        }
+    }
+    fini();
+}
+
 
 TEST_P(KVTest, RocksDBColumnFamilyTest)
 {
@@ -478,6 +557,66 @@ TEST_P(KVTest, RocksDBIteratorTest)
     fini();
 }
 
+TEST_P(KVTest, RocksDBTombstoneCompaction)
+{
+    if (string(GetParam()) != "rocksdb") {
+        return;
+    }
+    auto saved_trigger =
+        g_conf().get_val<uint64_t>("rocksdb_tombstone_compact_trigger");
+    auto saved_interval =
+        g_conf().get_val<double>("rocksdb_tombstone_compact_interval");
+    g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_trigger", "100");
+    g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_interval", "600");
+    ASSERT_EQ(0, db->create_and_open(cout, "O(3)"));
+    PerfCounters *logger = db->get_perf_counters();
+    ASSERT_TRUE(logger);
+    for (auto prefix : { "O", "P" }) {
+        KeyValueDB::Transaction t = db->get_transaction();
+        bufferlist value;
+        value.append("value");
+        for (size_t i = 0; i < 1000; i++) {
+            t->set(prefix, "key" + stringify(1000 + i), value);
+        }
+        db->submit_transaction_sync(t);
+        t = db->get_transaction();
+        for (size_t i = 0; i < 999; i++) {
+            t->rmkey(prefix, "key" + stringify(1000 + i));
+        }
+        db->submit_transaction_sync(t);
+
+        KeyValueDB::Iterator it = db->get_iterator(prefix);
+        it->lower_bound(string());
+        ASSERT_TRUE(it->valid());
+        ASSERT_EQ("key1999", it->key());
+    }
+    // one compaction queued for each prefix
+    ASSERT_EQ(2u, logger->get(l_rocksdb_compact_tombstones));
+    {
+        // a repeated scan within the interval must not queue another one
+        KeyValueDB::Iterator it = db->get_iterator("O");
+        it->lower_bound(string());
+        ASSERT_TRUE(it->valid());
+        ASSERT_EQ("key1999", it->key());
+    }
+    ASSERT_EQ(2u, logger->get(l_rocksdb_compact_tombstones));
+    {
+        JSONFormatter f;
+        db->get_statistics(&f);
+        stringstream ss;
+        f.flush(ss);
+        cout << ss.str() << std::endl;
+        ASSERT_NE(string::npos, ss.str().find("rocksdb_tombstone_statistics"));
+        ASSERT_NE(string::npos, ss.str().find("\"O\""));
+        ASSERT_NE(string::npos, ss.str().find("\"P\""));
+    }
+    fini();
+    g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_trigger",
+                                  stringify(saved_trigger));
+    g_ceph_context->_conf.set_val("rocksdb_tombstone_compact_interval",
+                                  stringify(saved_interval));
+}
+
 TEST_P(KVTest, RocksDBShardingIteratorTest)
 {
     if (string(GetParam()) != "rocksdb") {
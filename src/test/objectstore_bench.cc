@@ -32,7 +32,9 @@ static void usage()
          "	 --threads\n"
          "	       number of threads to carry out this workload\n"
          "	 --multi-object\n"
-         "	       have each thread write to a separate object\n" << std::endl;
+         "	       have each thread write to a separate object\n"
+         "	 --multi-collection\n"
+         "	       have each thread write to a separate collection (and sequencer)\n" << std::endl;
     generic_server_usage();
 }
 
@@ -80,10 +82,11 @@ struct Config {
     int repeats;
     int threads;
     bool multi_object;
+    bool multi_collection;
     Config()
         : size(1048576), block_size(4096),
           repeats(1), threads(1),
-          multi_object(false) {}
+          multi_object(false), multi_collection(false) {}
 };
 
 class C_NotifyCond : public Context
@@ -200,6 +203,8 @@ int main(int argc, const char *argv[])
             cfg.threads = atoi(val.c_str());
         } else if (ceph_argparse_flag(args, i, "--multi-object", (char *)nullptr)) {
             cfg.multi_object = true;
+        } else if (ceph_argparse_flag(args, i, "--multi-collection", (char *)nullptr)) {
+            cfg.multi_collection = true;
         } else {
             derr << "Error: can't understand argument: " << *i << "\n" << dendl;
             exit(1);
@@ -216,6 +221,7 @@ int main(int argc, const char *argv[])
     dout(0) << "block-size " << cfg.block_size << dendl;
     dout(0) << "repeats " << cfg.repeats << dendl;
     dout(0) << "threads " << cfg.threads << dendl;
+    dout(0) << "multi-collection " << cfg.multi_collection << dendl;
 
     auto os =
         ObjectStore::create(g_ceph_context,
@@ -270,36 +276,41 @@ int main(int argc, const char *argv[])
 
     dout(10) << "created objectstore " << os.get() << dendl;
 
-    // create a collection
-    spg_t pg;
-    const coll_t cid(pg);
-    ObjectStore::CollectionHandle ch = os->create_new_collection(cid);
-    {
+    // create the collections; each one gets its own sequencer in the store
+    std::vector<coll_t> cids;
+    std::vector<ObjectStore::CollectionHandle> chs;
+    int num_colls = cfg.multi_collection ? cfg.threads : 1;
+    for (int i = 0; i < num_colls; i++) {
+        spg_t pg(pg_t(i, 0));
+        cids.emplace_back(pg);
+        chs.push_back(os->create_new_collection(cids.back()));
+
         ObjectStore::Transaction t;
-        t.create_collection(cid, 0);
-        os->queue_transaction(ch, std::move(t));
+        t.create_collection(cids.back(), 0);
+        os->queue_transaction(chs.back(), std::move(t));
     }
 
     // create the objects
     std::vector<ghobject_t> oids;
-    if (cfg.multi_object) {
+    if (cfg.multi_object || cfg.multi_collection) {
         oids.reserve(cfg.threads);
         for (int i = 0; i < cfg.threads; i++) {
             std::stringstream oss;
             oss << "osbench-thread-" << i;
             oids.emplace_back(hobject_t(sobject_t(oss.str(), CEPH_NOSNAP)));
 
+            int c = cfg.multi_collection ? i : 0;
             ObjectStore::Transaction t;
-            t.touch(cid, oids[i]);
-            int r = os->queue_transaction(ch, std::move(t));
+            t.touch(cids[c], oids[i]);
+            int r = os->queue_transaction(chs[c], std::move(t));
             ceph_assert(r == 0);
         }
     } else {
         oids.emplace_back(hobject_t(sobject_t("osbench", CEPH_NOSNAP)));
 
         ObjectStore::Transaction t;
-        t.touch(cid, oids.back());
-        int r = os->queue_transaction(ch, std::move(t));
+        t.touch(cids[0], oids.back());
+        int r = os->queue_transaction(chs[0], std::move(t));
         ceph_assert(r == 0);
     }
 
@@ -310,7 +321,8 @@ int main(int argc, const char *argv[])
     using namespace std::chrono;
     auto t1 = high_resolution_clock::now();
     for (int i = 0; i < cfg.threads; i++) {
-        const auto &oid = cfg.multi_object ? oids[i] : oids[0];
+        const auto &oid = oids.size() > 1 ? oids[i] : oids[0];
+        const auto &cid = cfg.multi_collection ? cids[i] : cids[0];
         workers.emplace_back(osbench_worker, os.get(), std::ref(cfg),
                              cid, oid, i * cfg.size / cfg.threads);
     }
@@ -329,11 +341,12 @@ int main(int argc, const char *argv[])
             << iops << " iops" << dendl;
 
     // remove the objects
-    ObjectStore::Transaction t;
-    for (const auto &oid : oids) {
-        t.remove(cid, oid);
+    for (size_t i = 0; i < oids.size(); i++) {
+        int c = cfg.multi_collection ? i : 0;
+        ObjectStore::Transaction t;
+        t.remove(cids[c], oids[i]);
+        os->queue_transaction(chs[c], std::move(t));
     }
-    os->queue_transaction(ch, std::move(t));
 
     os->umount();
     return 0;
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <signal.h>
 #include "osd/ECBackend.h"
+#include "erasure-code/ErasureCode.h"
 #include "gtest/gtest.h"
 
 using namespace std;
@@ -60,3 +61,224 @@ TEST(ECUtil, stripe_info_t)
               make_pair((uint64_t)0, 2 * swidth));
 }
 
+TEST(ECUtil, offset_len_to_chunk_range)
+{
+    const uint64_t swidth = 4096;
+    const uint64_t ssize = 4;
+
+    ECUtil::stripe_info_t s(ssize, swidth);
+    const uint64_t csize = s.get_chunk_size();
+
+    // within a single chunk
+    ASSERT_EQ(s.offset_len_to_chunk_range(1, make_pair(csize + 10, (uint64_t)20)),
+              make_pair((uint64_t)10, (uint64_t)20));
+    ASSERT_EQ(s.offset_len_to_chunk_range(0, make_pair(csize + 10, (uint64_t)20)).second,
+              0u);
+    ASSERT_EQ(s.offset_len_to_chunk_range(2, make_pair(csize + 10, (uint64_t)20)).second,
+              0u);
+
+    // straddling two chunks of a stripe
+    ASSERT_EQ(s.offset_len_to_chunk_range(1, make_pair(2 * csize - 10, (uint64_t)20)),
+              make_pair(csize - 10, (uint64_t)10));
+    ASSERT_EQ(s.offset_len_to_chunk_range(2, make_pair(2 * csize - 10, (uint64_t)20)),
+              make_pair((uint64_t)0, (uint64_t)10));
+
+    // across stripes, the bytes of a chunk are contiguous
+    ASSERT_EQ(s.offset_len_to_chunk_range(0, make_pair((uint64_t)10, 2 * swidth)),
+              make_pair((uint64_t)10, 2 * csize));
+    ASSERT_EQ(s.offset_len_to_chunk_range(3, make_pair((uint64_t)10, 2 * swidth)),
+              make_pair((uint64_t)0, 2 * csize));
+    ASSERT_EQ(s.offset_len_to_chunk_range(3, make_pair(swidth - 10, (uint64_t)20)),
+              make_pair(csize - 10, (uint64_t)10));
+
+    // a stripe aligned extent maps to the aligned chunk range on every chunk
+    for (unsigned chunk = 0; chunk < ssize; ++chunk) {
+        ASSERT_EQ(s.offset_len_to_chunk_range(chunk, make_pair(swidth, 10 * swidth)),
+                  s.aligned_offset_len_to_chunk(make_pair(swidth, 10 * swidth)));
+    }
+}
+
+
+// only the chunk layout matters to ECUtil::reassemble_extent()
+class ErasureCodeLayout final : public ceph::ErasureCode
+{
+    unsigned k;
+public:
+    ErasureCodeLayout(unsigned k, const vector<int> &mapping) : k(k)
+    {
+        chunk_mapping = mapping;
+    }
+    unsigned int get_chunk_count() const override
+    {
+        return chunk_mapping.empty() ? k + 1 : chunk_mapping.size();
+    }
+    unsigned int get_data_chunk_count() const override
+    {
+        return k;
+    }
+    unsigned int get_chunk_size(unsigned int object_size) const override
+    {
+        return object_size / k;
+    }
+    int encode_chunks(const set<int> &want_to_encode,
+                      map<int, bufferlist> *encoded) override
+    {
+        ceph_abort();
+        return 0;
+    }
+    int decode_chunks(const set<int> &want_to_read,
+                      const map<int, bufferlist> &chunks,
+                      map<int, bufferlist> *decoded) override
+    {
+        ceph_abort();
+        return 0;
+    }
+};
+
+// the ranges of the data shards a direct read of **in** gets back
+static map<int, bufferlist> direct_read(
+    const ECUtil::stripe_info_t &s,
+    const vector<int> &mapping,
+    const bufferlist &object,
+    pair<uint64_t, uint64_t> in)
+{
+    const uint64_t swidth = s.get_stripe_width();
+    const uint64_t csize = s.get_chunk_size();
+    map<int, bufferlist> shards;
+    for (unsigned chunk = 0; chunk < swidth / csize; ++chunk) {
+        bufferlist chunk_bl;
+        for (uint64_t off = chunk * csize; off < object.length(); off += swidth) {
+            bufferlist bl;
+            bl.substr_of(object, off, csize);
+            chunk_bl.claim_append(bl);
+        }
+        auto range = s.offset_len_to_chunk_range(chunk, in);
+        if (range.second) {
+            int shard = mapping.empty() ? chunk : mapping[chunk];
+            shards[shard].substr_of(chunk_bl, range.first, range.second);
+        }
+    }
+    return shards;
+}
+
+TEST(ECUtil, reassemble_extent)
+{
+    const uint64_t swidth = 4096;
+    const uint64_t ssize = 4;
+
+    ECUtil::stripe_info_t s(ssize, swidth);
+    const uint64_t csize = s.get_chunk_size();
+
+    bufferlist object;
+    for (unsigned i = 0; i < 3 * swidth; ++i) {
+        object.append((char)(i * 7 + i / 13));
+    }
+    auto expected = [&](pair<uint64_t, uint64_t> in) {
+        bufferlist bl;
+        bl.substr_of(object, in.first, in.second);
+        return bl;
+    };
+
+    // an LRC style layout puts the data chunks on shards 1, 2, 4 and 5
+    for (auto &&mapping : {
+             vector<int>{}, vector<int>{1, 2, 4, 5}
+         }) {
+        ceph::ErasureCodeInterfaceRef ec_impl(
+            new ErasureCodeLayout(ssize, mapping));
+        for (auto &&in : {
+                 // unaligned, within a chunk
+                 make_pair(csize + 10, (uint64_t)20),
+                 // unaligned, straddling two chunks
+                 make_pair(2 * csize - 10, (uint64_t)20),
+                 // into the next stripe
+                 make_pair(swidth - 10, (uint64_t)20),
+                 // several stripes, unaligned at both ends
+                 make_pair((uint64_t)10, 2 * swidth + 100),
+                 // whole stripes
+                 make_pair(swidth, 2 * swidth)
+             }) {
+            auto shards = direct_read(s, mapping, object, in);
+            bufferlist out;
+            ASSERT_EQ(0, ECUtil::reassemble_extent(s, ec_impl, in, shards, &out));
+            ASSERT_TRUE(out.contents_equal(expected(in)))
+                << "mapping " << mapping << " extent " << in;
+        }
+
+        // a shard returning less than asked for (end of the object) cuts
+        // the extent short where its data is missing
+        auto in = make_pair((uint64_t)10, 2 * swidth);
+        auto shards = direct_read(s, mapping, object, in);
+        int shard2 = mapping.empty() ? 2 : mapping[2];
+        shards[shard2].splice(100, shards[shard2].length() - 100);
+        bufferlist out;
+        ASSERT_EQ(0, ECUtil::reassemble_extent(s, ec_impl, in, shards, &out));
+        ASSERT_TRUE(out.contents_equal(
+                        expected(make_pair(in.first, 2 * csize + 100 - in.first))));
+
+        // a shard holding part of the extent is missing altogether
+        shards = direct_read(s, mapping, object, in);
+        shards.erase(shards.rbegin()->first);
+        out.clear();
+        ASSERT_EQ(-EIO, ECUtil::reassemble_extent(s, ec_impl, in, shards, &out));
+    }
+}
+
+
+TEST(ECBackend, get_remaining_reads)
+{
+    typedef map<int, vector<pair<int, int>>> plan_t;
+    // a CLAY(k=4, m=2, d=5) repair of shard 0 reads half the planes of each
+    // helper, as runs of sub-chunks
+    const vector<pair<int, int>> planes = {{0, 2}, {4, 2}};
+    const vector<pair<int, int>> full = {{0, 8}};
+
+    {
+        // a helper failed but the repair still has d helpers: only the
+        // replacement is read, with the same planes, nothing is stale
+        plan_t avail = {{1, planes}, {2, planes}, {3, planes}, {4, planes}, {5, planes}};
+        plan_t need = {{1, planes}, {2, planes}, {3, planes}, {5, planes}, {6, planes}};
+        plan_t to_read;
+        set<int> stale;
+        ECBackend::get_remaining_reads(need, avail, &to_read, &stale);
+        ASSERT_EQ(to_read, (plan_t{{6, planes}}));
+        ASSERT_EQ(stale, set<int>{4});
+
+        // the stale shard is no longer a source and the replacement is read
+        // with the new plan; a second helper failing now leaves too few
+        // helpers, and the failed first helper must not be counted as read
+        for (auto &&i : stale) {
+            avail.erase(i);
+        }
+        for (auto &&p : to_read) {
+            avail[p.first] = p.second;
+        }
+        ASSERT_EQ(avail, need);
+        need = {{1, full}, {2, full}, {3, full}, {6, full}};
+        to_read.clear();
+        stale.clear();
+        ECBackend::get_remaining_reads(need, avail, &to_read, &stale);
+        ASSERT_EQ(to_read, need);
+        ASSERT_EQ(stale, (set<int>{1, 2, 3, 5, 6}));
+    }
+    {
+        // too few helpers left for a repair: the fallback decode needs full
+        // chunks, so the helpers read for the repair are read again
+        plan_t avail = {{1, planes}, {2, planes}, {3, planes}, {4, planes}, {5, planes}};
+        plan_t need = {{1, full}, {2, full}, {3, full}, {5, full}};
+        plan_t to_read;
+        set<int> stale;
+        ECBackend::get_remaining_reads(need, avail, &to_read, &stale);
+        ASSERT_EQ(to_read, need);
+        ASSERT_EQ(stale, (set<int>{1, 2, 3, 4, 5}));
+    }
+    {
+        // whole chunk reads (jerasure): shards already read are kept
+        plan_t avail = {{0, full}, {1, full}, {2, full}};
+        plan_t need = {{1, full}, {2, full}, {3, full}};
+        plan_t to_read;
+        set<int> stale;
+        ECBackend::get_remaining_reads(need, avail, &to_read, &stale);
+        ASSERT_EQ(to_read, (plan_t{{3, full}}));
+        ASSERT_EQ(stale, set<int>{0});
+    }
+}
@@ -1,6 +1,9 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 
 #include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include "gtest/gtest.h"
 
@@ -55,8 +58,9 @@ public:
     struct MockDmclockItem : public PGOpQueueable {
         op_scheduler_class scheduler_class;
 
-        MockDmclockItem(op_scheduler_class _scheduler_class) :
-            PGOpQueueable(spg_t()),
+        MockDmclockItem(op_scheduler_class _scheduler_class,
+                        spg_t pgid = spg_t()) :
+            PGOpQueueable(pgid),
             scheduler_class(_scheduler_class) {}
 
         MockDmclockItem()
@@ -275,3 +279,95 @@ TEST_F(mClockSchedulerTest, TestAllQueuesEnqueueDequeue)
 
     ASSERT_TRUE(q.empty());
 }
+
+// An idle thread of another shard helping a backed up one takes the head
+// item with dequeue(), the same as the shard's own threads do, and never
+// puts anything back: items still come out once each, in the scheduler's
+// order, whichever thread runs them.
+TEST_F(mClockSchedulerTest, TestStealHeadItem)
+{
+    const unsigned NUM = 200;
+    for (unsigned i = 0; i < NUM; ++i) {
+        for (auto &&c : {
+                 client1, client2
+             }) {
+            q.enqueue(create_item(i, c, op_scheduler_class::client));
+            std::this_thread::sleep_for(std::chrono::microseconds(1));
+        }
+    }
+    q.enqueue(create_item(NUM, client3, op_scheduler_class::immediate));
+
+    std::mutex lock; // the owning shard's shard_lock
+    std::vector<std::pair<unsigned, OpSchedulerItem>> taken;
+    auto worker = [&](unsigned id) {
+        while (true) {
+            std::lock_guard l{lock};
+            if (q.empty()) {
+                return;
+            }
+            WorkItem work_item = q.dequeue();
+            if (auto item = std::get_if<OpSchedulerItem>(&work_item)) {
+                taken.emplace_back(id, std::move(*item));
+            }
+        }
+    };
+    std::thread owner(worker, 0);
+    std::thread stealer(worker, 1);
+    owner.join();
+    stealer.join();
+
+    ASSERT_EQ(NUM * 2 + 1, taken.size());
+    ASSERT_EQ(client3, taken.front().second.get_owner());
+    std::map<uint64_t, epoch_t> next = {{client1, 0}, {client2, 0}};
+    for (auto t = taken.begin() + 1; t != taken.end(); ++t) {
+        auto niter = next.find(t->second.get_owner());
+        ASSERT_FALSE(niter == next.end());
+        ASSERT_EQ(niter->second, t->second.get_map_epoch());
+        niter->second++;
+    }
+    ASSERT_TRUE(q.empty());
+}
+
+TEST_F(mClockSchedulerTest, TestStealOnlyForIdlePGs)
+{
+    spg_t hot(pg_t(0, 1)), cold(pg_t(1, 1));
+    QueuedPGCounts queued;
+    std::set<spg_t> running;
+    auto busy = [&](const spg_t &pgid) {
+        return running.count(pgid) > 0;
+    };
+    epoch_t e = 0;
+    for (auto pgid : {hot, hot, cold, cold}) {
+        auto item = create_item(e++, client1, op_scheduler_class::client, pgid);
+        queued.add(item);
+        q.enqueue(std::move(item));
+    }
+
+    // a thread of the owning shard is running the hot pg all along
+    running.insert(hot);
+    unsigned stolen = 0, owned = 0;
+    while (!q.empty()) {
+        bool steal = queued.none_busy(busy);
+        auto item = get_item(q.dequeue());
+        queued.remove(item);
+        if (steal) {
+            // never an item that would wait for the running pg's lock
+            ASSERT_FALSE(busy(item.get_ordering_token()));
+            ++stolen;
+        } else {
+            ++owned;
+        }
+    }
+    ASSERT_EQ(2u, owned);
+    ASSERT_EQ(2u, stolen);
+    ASSERT_TRUE(queued.none_busy(busy));
+
+    // once the cold pg is running too, nothing queued for it is taken
+    running.insert(cold);
+    auto item = create_item(e++, client1, op_scheduler_class::client, cold);
+    queued.add(item);
+    q.enqueue(std::move(item));
+    ASSERT_FALSE(queued.none_busy(busy));
+    running.erase(cold);
+    ASSERT_TRUE(queued.none_busy(busy));
+}
@@ -15,6 +15,7 @@
 #include <gtest/gtest.h>
 #include "osd/PGTransaction.h"
 #include "osd/ECTransaction.h"
+#include "erasure-code/ErasureCode.h"
 
 #include "test/unit.cc"
 
@@ -131,3 +132,220 @@ TEST(ectransaction, many_writes)
     ASSERT_EQ(0u, plan.to_read.size());
     ASSERT_EQ(1u, plan.will_write.size());
 }
+
+// k=2 m=1 xor code: linear, so it supports parity deltas
+class ErasureCodeXor final : public ceph::ErasureCode
+{
+public:
+    unsigned int get_chunk_count() const override
+    {
+        return 3;
+    }
+    unsigned int get_data_chunk_count() const override
+    {
+        return 2;
+    }
+    unsigned int get_chunk_size(unsigned int object_size) const override
+    {
+        return object_size / 2;
+    }
+    bool supports_parity_delta() const override
+    {
+        return true;
+    }
+    int encode_chunks(const std::set<int> &want_to_encode,
+                      std::map<int, bufferlist> *encoded) override
+    {
+        const char *a = (*encoded)[0].c_str();
+        const char *b = (*encoded)[1].c_str();
+        char *p = (*encoded)[2].c_str();
+        for (unsigned i = 0; i < (*encoded)[0].length(); i++) {
+            p[i] = a[i] ^ b[i];
+        }
+        return 0;
+    }
+    int decode_chunks(const std::set<int> &want_to_read,
+                      const std::map<int, bufferlist> &chunks,
+                      std::map<int, bufferlist> *decoded) override
+    {
+        ceph_abort();
+        return 0;
+    }
+};
+
+static bufferlist random_bl(unsigned len, unsigned seed)
+{
+    bufferptr bp(len);
+    for (unsigned i = 0; i < len; i++) {
+        bp.c_str()[i] = (char)(rand_r(&seed) & 0xff);
+    }
+    bufferlist bl;
+    bl.append(bp);
+    return bl;
+}
+
+static std::map<uint64_t, bufferlist> get_writes(ObjectStore::Transaction &t)
+{
+    std::map<uint64_t, bufferlist> writes;
+    auto i = t.begin();
+    while (i.have_op()) {
+        auto op = i.decode_op();
+        EXPECT_EQ((uint32_t)ObjectStore::Transaction::OP_WRITE, (uint32_t)op->op);
+        bufferlist bl;
+        i.decode_bl(bl);
+        EXPECT_EQ((uint64_t)op->len, (uint64_t)bl.length());
+        writes[op->off] = bl;
+    }
+    return writes;
+}
+
+TEST(ectransaction, delta_write_plan)
+{
+    hobject_t h;
+    ECUtil::stripe_info_t sinfo(2, 8192);
+    auto get_hinfo = [&](const hobject_t &i) {
+        ECUtil::HashInfoRef ref(new ECUtil::HashInfo(3));
+        ref->set_projected_total_logical_size(sinfo, 4 * 8192);
+        return ref;
+    };
+    bufferlist a;
+    a.append_zero(512);
+
+    {
+        // overwrite within the object: may use parity deltas
+        PGTransactionUPtr t(new PGTransaction);
+        t->write(h, 8192 + 100, a.length(), a, 0);
+        t->write(h, 3 * 8192 + 4096, a.length(), a, 0);
+        auto plan = ECTransaction::get_write_plan(
+                        sinfo, std::move(t), get_hinfo, &dpp);
+        extent_set stripes;
+        stripes.insert(8192, 8192);
+        stripes.insert(3 * 8192, 8192);
+        ASSERT_EQ(stripes, plan.to_read[h]);
+        ASSERT_EQ(1u, plan.delta_writes.count(h));
+        extent_set written;
+        written.insert(8192 + 100, 512);
+        written.insert(3 * 8192 + 4096, 512);
+        ASSERT_EQ(written, plan.delta_writes[h]);
+    }
+    {
+        // extending the object: the tail stripe is re-encoded
+        PGTransactionUPtr t(new PGTransaction);
+        t->write(h, 4 * 8192 - 100, a.length(), a, 0);
+        auto plan = ECTransaction::get_write_plan(
+                        sinfo, std::move(t), get_hinfo, &dpp);
+        ASSERT_EQ(1u, plan.to_read.count(h));
+        ASSERT_EQ(0u, plan.delta_writes.count(h));
+    }
+    {
+        // truncating
+        PGTransactionUPtr t(new PGTransaction);
+        t->truncate(h, 3 * 8192);
+        t->write(h, 100, a.length(), a, 0);
+        auto plan = ECTransaction::get_write_plan(
+                        sinfo, std::move(t), get_hinfo, &dpp);
+        ASSERT_EQ(1u, plan.to_read.count(h));
+        ASSERT_EQ(0u, plan.delta_writes.count(h));
+    }
+}
+
+TEST(ectransaction, get_delta_shards)
+{
+    ECUtil::stripe_info_t sinfo(2, 8192);
+    ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+
+    extent_set written;
+    written.insert(100, 200);
+    ASSERT_EQ(std::set<int>({0, 2}),
+              ECTransaction::get_delta_shards(sinfo, ec, written));
+
+    // straddling both data chunks
+    written.clear();
+    written.insert(4000, 200);
+    ASSERT_EQ(std::set<int>({0, 1, 2}),
+              ECTransaction::get_delta_shards(sinfo, ec, written));
+
+    // the second data chunk of two stripes
+    written.clear();
+    written.insert(4096 + 10, 10);
+    written.insert(8192 + 4096 + 10, 10);
+    ASSERT_EQ(std::set<int>({1, 2}),
+              ECTransaction::get_delta_shards(sinfo, ec, written));
+}
+
+TEST(ecutil, encode_parity_delta)
+{
+    ECUtil::stripe_info_t sinfo(2, 8192);
+    ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+    const std::set<int> all = {0, 1, 2};
+
+    // two stripes, the first data chunk of each changes
+    bufferlist old_data = random_bl(2 * 8192, 1);
+    bufferlist new_data;
+    for (unsigned stripe = 0; stripe < 2; stripe++) {
+        bufferlist chunk0 = random_bl(4096, 2 + stripe);
+        bufferlist chunk1;
+        chunk1.substr_of(old_data, stripe * 8192 + 4096, 4096);
+        new_data.claim_append(chunk0);
+        new_data.claim_append(chunk1);
+    }
+    std::map<int, bufferlist> old_shards, new_shards;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, old_data, all, &old_shards));
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, new_data, all, &new_shards));
+
+    std::map<int, bufferlist> data_delta, parity_delta;
+    data_delta[0] = ECUtil::buffer_xor(old_shards[0], new_shards[0]);
+    ASSERT_EQ(0, ECUtil::encode_parity_delta(sinfo, ec, data_delta, &parity_delta));
+    ASSERT_EQ(1u, parity_delta.size());
+    ASSERT_TRUE(ECUtil::buffer_xor(old_shards[2], parity_delta[2])
+                .contents_equal(new_shards[2]));
+}
+
+TEST(ectransaction, delta_and_write)
+{
+    hobject_t h;
+    pg_t pgid(0, 1);
+    ECUtil::stripe_info_t sinfo(2, 8192);
+    ceph::ErasureCodeInterfaceRef ec(new ErasureCodeXor);
+    const std::set<int> all = {0, 1, 2};
+
+    bufferlist old_data = random_bl(8192, 1);
+    std::map<int, bufferlist> old_shards;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, old_data, all, &old_shards));
+
+    // overwrite 100~200 of the first data chunk
+    bufferlist update = random_bl(200, 2);
+    bufferlist new_data;
+    {
+        bufferlist head, tail;
+        head.substr_of(old_data, 0, 100);
+        tail.substr_of(old_data, 300, 8192 - 300);
+        new_data.append(head);
+        new_data.append(update);
+        new_data.append(tail);
+    }
+    std::map<int, bufferlist> new_shards;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec, new_data, all, &new_shards));
+
+    // only the touched data shard and the parity shard were read
+    std::map<int, extent_map> read;
+    read[0].insert(0, 4096, old_shards[0]);
+    read[2].insert(0, 4096, old_shards[2]);
+    extent_map to_write;
+    to_write.insert(100, 200, update);
+
+    std::map<shard_id_t, ObjectStore::Transaction> transactions;
+    for (auto i : all) {
+        transactions[shard_id_t(i)];
+    }
+    ECTransaction::delta_and_write(
+        pgid, h, sinfo, ec, 0, 8192, to_write, read, 0, &transactions, &dpp);
+
+    auto writes = get_writes(transactions[shard_id_t(0)]);
+    ASSERT_EQ(1u, writes.size());
+    ASSERT_TRUE(writes[0].contents_equal(new_shards[0]));
+    ASSERT_TRUE(get_writes(transactions[shard_id_t(1)]).empty());
+    writes = get_writes(transactions[shard_id_t(2)]);
+    ASSERT_EQ(1u, writes.size());
+    ASSERT_TRUE(writes[0].contents_equal(new_shards[2]));
+}
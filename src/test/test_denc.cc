@@ -770,3 +770,80 @@ TEST(denc, no_copy_if_segmented_and_lengthy)
         ASSERT_EQ(CEPH_PAGE_SIZE * 2, Legacy::n_decode);
     }
 }
+
+// bytewise reference encoding of a varint
+static void varint_reference(uint64_t v, string *out)
+{
+    do {
+        uint8_t byte = v & 0x7f;
+        v >>= 7;
+        if (v) {
+            byte |= 0x80;
+        }
+        out->push_back(byte);
+    } while (v);
+}
+
+TEST(denc, varint)
+{
+    vector<uint64_t> values{0, 1, 0x7f, 0x80, 0x3fff, 0x4000};
+    for (unsigned bits = 1; bits < 64; ++bits) {
+        values.push_back((1ull << bits) - 1);
+        values.push_back(1ull << bits);
+        values.push_back((1ull << bits) | 0x55);
+    }
+    values.push_back(UINT64_MAX);
+    for (auto v : values) {
+        string expected;
+        varint_reference(v, &expected);
+
+        bufferlist bl;
+        {
+            size_t s = 0;
+            denc_varint(v, s);
+            auto a = bl.get_contiguous_appender(s);
+            denc_varint(v, a);
+        }
+        ASSERT_EQ(expected, bl.to_str()) << v;
+
+        // decode right at the end of the buffer (bytewise path) and with
+        // trailing bytes (word-at-a-time path)
+        for (unsigned pad : {0, 8}) {
+            bufferptr bp = buffer::create(expected.size() + pad);
+            bp.zero();
+            memcpy(bp.c_str(), expected.data(), expected.size());
+            auto p = bp.cbegin();
+            uint64_t out = 0;
+            denc_varint(out, p);
+            ASSERT_EQ(v, out);
+            ASSERT_EQ(expected.size(), p.get_offset());
+        }
+    }
+}
+
+TEST(denc, varint_array)
+{
+    vector<uint32_t> in(1000);
+    for (size_t i = 0; i < in.size(); ++i) {
+        in[i] = (i % 5 == 0) ? UINT32_MAX >> (i % 32) : i * 4096;
+    }
+    bufferlist bl;
+    {
+        size_t s = 0;
+        denc_varint_array(in.data(), in.size(), s);
+        auto a = bl.get_contiguous_appender(s);
+        denc_varint_array(in.data(), in.size(), a);
+    }
+    string expected;
+    for (auto v : in) {
+        varint_reference(v, &expected);
+    }
+    ASSERT_EQ(expected, bl.to_str());
+
+    bufferptr bp(bl.c_str(), bl.length());
+    auto p = bp.cbegin();
+    vector<uint32_t> out(in.size());
+    denc_varint_array(out.data(), out.size(), p);
+    ASSERT_EQ(in, out);
+    ASSERT_TRUE(p.end());
+}